@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <array>
 #include "DrawingWindow.h"
+#include "Log.h"
 // On some platforms you may need to include <cstring> (if you compiler can't find memset !)
 
 DrawingWindow::DrawingWindow() {}
@@ -22,15 +24,85 @@ DrawingWindow::DrawingWindow(int w, int h, bool fullscreen) : width(w), height(h
 	int PIXELFORMAT = SDL_PIXELFORMAT_ARGB8888;
 	texture = SDL_CreateTexture(renderer, PIXELFORMAT, SDL_TEXTUREACCESS_STATIC, width, height);
 	if (!texture) printMessageAndQuit("Could not allocate texture: ", SDL_GetError());
+
+	tileColumns = (width + dirtyTileSize - 1) / dirtyTileSize;
+	size_t tileCount = tileColumns * ((height + dirtyTileSize - 1) / dirtyTileSize);
+	present.reset(new PresentBuffers());
+	for (size_t i = 0; i < present->pixels.size(); i++) {
+		present->pixels[i].assign(width * height, 0);
+		present->dirtyTiles[i].assign(tileCount, 0);
+	}
+	present->changedTiles.assign(tileCount, 0);
+	present->unshownTiles.assign(tileCount, 0);
 }
 
+DrawingWindow::DrawingWindow(int w, int h) : width(w), height(h), pixelBuffer(w * h) {}
+
 void DrawingWindow::renderFrame() {
-	SDL_UpdateTexture(texture, nullptr, pixelBuffer.data(), width * sizeof(uint32_t));
+	if (!renderer) return;
+	swapBuffers();
+	presentFrame();
+}
+
+void DrawingWindow::swapBuffers() {
+	if (!present) return;
+	PresentBuffers &buffers = *present;
+	std::copy(pixelBuffer.begin(), pixelBuffer.end(), buffers.pixels[buffers.back].begin());
+	// presentFrame may skip a buffer when several are swapped in between, so the tiles of every buffer since the last
+	// one it took go along, only this thread sets the fresh bit so once it is clear it stays clear until the exchange
+	if (!(buffers.ready.load() & PresentBuffers::freshBit)) {
+		std::fill(buffers.unshownTiles.begin(), buffers.unshownTiles.end(), 0);
+	}
+	for (size_t i = 0; i < buffers.unshownTiles.size(); i++) buffers.unshownTiles[i] |= buffers.changedTiles[i];
+	buffers.dirtyTiles[buffers.back] = buffers.unshownTiles;
+	buffers.back = buffers.ready.exchange(buffers.back | PresentBuffers::freshBit) & ~PresentBuffers::freshBit;
+	std::fill(buffers.changedTiles.begin(), buffers.changedTiles.end(), 0);
+}
+
+void DrawingWindow::presentFrame() {
+	if (!renderer) return;
+	PresentBuffers &buffers = *present;
+	// nothing new is shown again from the texture
+	if (buffers.ready.load() & PresentBuffers::freshBit) {
+		buffers.front = buffers.ready.exchange(buffers.front) & ~PresentBuffers::freshBit;
+		const std::vector<uint32_t> &pixels = buffers.pixels[buffers.front];
+		int pitch = int(width * sizeof(uint32_t));
+		if (!isTrackingDirtyTiles || buffers.isTextureStale) {
+			SDL_UpdateTexture(texture, nullptr, pixels.data(), pitch);
+		} else {
+			// one upload for every run of changed tiles along a row of tiles
+			const std::vector<uint8_t> &dirtyTiles = buffers.dirtyTiles[buffers.front];
+			for (size_t row = 0; row * tileColumns < dirtyTiles.size(); row++) {
+				const uint8_t *tiles = dirtyTiles.data() + row * tileColumns;
+				size_t column = 0;
+				while (column < tileColumns) {
+					if (!tiles[column]) {
+						column++;
+						continue;
+					}
+					size_t end = column;
+					while (end < tileColumns && tiles[end]) end++;
+					SDL_Rect rect;
+					rect.x = int(column * dirtyTileSize);
+					rect.y = int(row * dirtyTileSize);
+					rect.w = int(std::min(end * dirtyTileSize, width)) - rect.x;
+					rect.h = int(std::min((row + 1) * dirtyTileSize, height)) - rect.y;
+					SDL_UpdateTexture(texture, &rect, pixels.data() + size_t(rect.y) * width + rect.x, pitch);
+					column = end;
+				}
+			}
+		}
+		buffers.isTextureStale = false;
+	}
 	SDL_RenderClear(renderer);
 	SDL_RenderCopy(renderer, texture, nullptr, nullptr);
 	SDL_RenderPresent(renderer);
 }
 
+void DrawingWindow::markAllTilesChanged() {
+	if (isTrackingDirtyTiles && present) std::fill(present->changedTiles.begin(), present->changedTiles.end(), 1);
+}
+
 void DrawingWindow::saveBMP(const std::string &filename) const {
 	auto surface = SDL_CreateRGBSurfaceFrom((void *) pixelBuffer.data(), width, height, 32,
 	                                        width * sizeof(uint32_t),
@@ -58,16 +130,15 @@ void DrawingWindow::savePPM(const std::string &filename) const {
 bool DrawingWindow::pollForInputEvents(SDL_Event &event) {
 	if (SDL_PollEvent(&event)) {
 		if ((event.type == SDL_QUIT) || ((event.type == SDL_KEYDOWN) && (event.key.keysym.sym == SDLK_ESCAPE))) {
+			if (beforeQuit) beforeQuit();
 			SDL_DestroyTexture(texture);
 			SDL_DestroyRenderer(renderer);
 			SDL_DestroyWindow(window);
 			SDL_Quit();
 			printMessageAndQuit("Exiting", nullptr);
 		}
-		SDL_Event dummy;
-		// Clear the event queue by getting all available events
-		// This seems like bad practice (because it will skip some events) however preventing backlog is paramount !
-		while (SDL_PollEvent(&dummy));
+		// the queued events are not thrown away any more, the caller handles them all before it starts rendering, so
+		// a backlog of held keys only costs their camera steps
 		return true;
 	}
 	return false;
@@ -75,19 +146,32 @@ bool DrawingWindow::pollForInputEvents(SDL_Event &event) {
 
 void DrawingWindow::setPixelColour(size_t x, size_t y, uint32_t colour) {
 	if ((x >= width) || (y >= height)) {
-		std::cout << x << "," << y << " not on visible screen area" << std::endl;
-	} else pixelBuffer[(y * width) + x] = colour;
+		LOG_WARNING(LogCategory::Window, x << "," << y << " not on visible screen area");
+	} else {
+		pixelBuffer[(y * width) + x] = colour;
+		if (isTrackingDirtyTiles && present) present->changedTiles[(y / dirtyTileSize) * tileColumns + x / dirtyTileSize] = 1;
+	}
 }
 
 uint32_t DrawingWindow::getPixelColour(size_t x, size_t y) {
 	if ((x >= width) || (y >= height)) {
-		std::cout << x << "," << y << " not on visible screen area" << std::endl;
+		LOG_WARNING(LogCategory::Window, x << "," << y << " not on visible screen area");
 		return -1;
 	} else return pixelBuffer[(y * width) + x];
 }
 
+uint32_t *DrawingWindow::getPixelBuffer() {
+	markAllTilesChanged();
+	return pixelBuffer.data();
+}
+
 void DrawingWindow::clearPixels() {
 	std::fill(pixelBuffer.begin(), pixelBuffer.end(), 0);
+	markAllTilesChanged();
+}
+
+void DrawingWindow::setTitle(const std::string &title) {
+	if (window) SDL_SetWindowTitle(window, title.c_str());
 }
 
 void printMessageAndQuit(const std::string &message, const char *error) {
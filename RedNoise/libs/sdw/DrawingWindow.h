@@ -1,7 +1,11 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <iostream>
 #include <fstream>
+#include <functional>
+#include <memory>
 #include <vector>
 #include "SDL.h"
 
@@ -10,23 +14,61 @@ class DrawingWindow {
 public:
 	size_t width;
 	size_t height;
+	// called before the window is closed by pollForInputEvents, to stop threads that still draw into it
+	std::function<void()> beforeQuit;
+	// presentFrame uploads only the tiles drawn since the frame before, for renders that add a few rows at a time
+	bool isTrackingDirtyTiles = false;
 
 private:
-	SDL_Window *window;
-	SDL_Renderer *renderer;
-	SDL_Texture *texture;
+	static const size_t dirtyTileSize = 32;
+
+	// three buffers between swapBuffers and presentFrame, each side swaps its own buffer with the ready one in a
+	// single atomic exchange, so neither waits for the other and the screen never shows half a swap
+	struct PresentBuffers {
+		static const int freshBit = 4;   // set on ready until presentFrame takes it
+		std::array<std::vector<uint32_t>, 3> pixels;
+		// per buffer, the tiles that changed since the last buffer presentFrame took before this one
+		std::array<std::vector<uint8_t>, 3> dirtyTiles;
+		std::atomic<int> ready{1};
+		int back = 2;                          // only swapBuffers touches it
+		int front = 0;                         // only presentFrame touches it
+		bool isTextureStale = true;            // the texture has never been uploaded
+		std::vector<uint8_t> changedTiles;     // drawn since the last swap
+		std::vector<uint8_t> unshownTiles;     // drawn since the last buffer presentFrame took
+	};
+
+	void markAllTilesChanged();
+
+	SDL_Window *window = nullptr;
+	SDL_Renderer *renderer = nullptr;
+	SDL_Texture *texture = nullptr;
 	std::vector<uint32_t> pixelBuffer;
+	size_t tileColumns = 0;
+	std::unique_ptr<PresentBuffers> present;   // only windows that show something have them
 
 public:
 	DrawingWindow();
 	DrawingWindow(int w, int h, bool fullscreen);
+	// only the pixel buffer without SDL, for processes that render but never show anything (tile workers)
+	DrawingWindow(int w, int h);
+	// swapBuffers then presentFrame, for a window drawn and shown by the same thread
 	void renderFrame();
+	// hands what the pixel buffer holds now to presentFrame, called by the thread that draws, it copies the pixels and
+	// never waits for presentFrame
+	void swapBuffers();
+	// shows the pixels of the last swapBuffers, may run on another thread than the one drawing
+	void presentFrame();
 	void savePPM(const std::string &filename) const;
 	void saveBMP(const std::string &filename) const;
 	bool pollForInputEvents(SDL_Event &event);
 	void setPixelColour(size_t x, size_t y, uint32_t colour);
 	uint32_t getPixelColour(size_t x, size_t y);
+	// raw row-major access for renderers that clip their own writes, no bounds checking here, the whole window counts
+	// as changed for the dirty tiles
+	uint32_t *getPixelBuffer();
 	void clearPixels();
+	// the caption of the window, for the few numbers worth seeing while it renders, a headless window ignores it
+	void setTitle(const std::string &title);
 };
 
 void printMessageAndQuit(const std::string &message, const char *error);
@@ -0,0 +1,84 @@
+#include "Log.h"
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+
+namespace {
+	// Info and above is shown by default, per triangle / per pixel tracing has to be switched on
+	std::array<std::atomic<int>, size_t(LogCategory::Count)> categoryLevels{};
+	std::once_flag levelsInitialised;
+	std::mutex outputMutex;
+
+	void initialiseLevels() {
+		for (auto &level : categoryLevels) level = int(LogLevel::Info);
+	}
+
+	const char *levelName(LogLevel level) {
+		switch (level) {
+			case LogLevel::Trace: return "TRACE";
+			case LogLevel::Debug: return "DEBUG";
+			case LogLevel::Info: return "INFO";
+			case LogLevel::Warning: return "WARN";
+			case LogLevel::Error: return "ERROR";
+			default: return "";
+		}
+	}
+
+	const char *categoryName(LogCategory category) {
+		switch (category) {
+			case LogCategory::App: return "app";
+			case LogCategory::Window: return "window";
+			case LogCategory::Camera: return "camera";
+			case LogCategory::Loader: return "loader";
+			case LogCategory::Raster: return "raster";
+			case LogCategory::RayTrace: return "raytrace";
+			default: return "";
+		}
+	}
+
+	int64_t nowMilliseconds() {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+void setLogLevel(LogCategory category, LogLevel level) {
+	std::call_once(levelsInitialised, initialiseLevels);
+	categoryLevels[size_t(category)] = int(level);
+}
+
+void setLogLevel(LogLevel level) {
+	for (size_t i = 0; i < size_t(LogCategory::Count); i++) setLogLevel(LogCategory(i), level);
+}
+
+bool isLogEnabled(LogCategory category, LogLevel level) {
+	std::call_once(levelsInitialised, initialiseLevels);
+	return int(level) >= categoryLevels[size_t(category)];
+}
+
+void writeLogMessage(LogLevel level, LogCategory category, const std::string &message, uint32_t suppressed) {
+	std::lock_guard<std::mutex> lock(outputMutex);
+	std::cout << "[" << levelName(level) << "][" << categoryName(category) << "] " << message;
+	if (suppressed > 0) std::cout << " (" << suppressed << " similar messages suppressed)";
+	std::cout << std::endl;
+}
+
+LogRateLimiter::LogRateLimiter(uint32_t maxPerSecond) :
+		maxPerSecond(maxPerSecond),
+		windowStart(nowMilliseconds()),
+		count(0),
+		dropped(0) {}
+
+bool LogRateLimiter::allow(uint32_t &suppressed) {
+	int64_t now = nowMilliseconds();
+	int64_t start = windowStart.load();
+	// only the thread that wins the exchange resets the window
+	if (now - start >= 1000 && windowStart.compare_exchange_strong(start, now)) count = 0;
+	if (count.fetch_add(1) < maxPerSecond) {
+		suppressed = dropped.exchange(0);
+		return true;
+	}
+	dropped++;
+	return false;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+// Logging is compiled in for debug builds only, unless REDNOISE_LOGGING is defined explicitly.
+// When it is 0 the LOG_* macros expand to nothing and their arguments are never evaluated.
+#ifndef REDNOISE_LOGGING
+#ifdef NDEBUG
+#define REDNOISE_LOGGING 0
+#else
+#define REDNOISE_LOGGING 1
+#endif
+#endif
+
+// How many messages a single LOG_* call site may print per second before it is throttled
+#ifndef REDNOISE_LOG_RATE
+#define REDNOISE_LOG_RATE 20
+#endif
+
+enum class LogLevel { Trace, Debug, Info, Warning, Error, Off };
+
+enum class LogCategory { App, Window, Camera, Loader, Raster, RayTrace, Count };
+
+void setLogLevel(LogCategory category, LogLevel level);
+void setLogLevel(LogLevel level);
+bool isLogEnabled(LogCategory category, LogLevel level);
+void writeLogMessage(LogLevel level, LogCategory category, const std::string &message, uint32_t suppressed);
+
+// Lets at most maxPerSecond messages through in every one second window.
+// The number of messages dropped in the previous window is handed back with the next one that passes.
+class LogRateLimiter {
+public:
+	explicit LogRateLimiter(uint32_t maxPerSecond);
+	bool allow(uint32_t &suppressed);
+
+private:
+	uint32_t maxPerSecond;
+	std::atomic<int64_t> windowStart;
+	std::atomic<uint32_t> count;
+	std::atomic<uint32_t> dropped;
+};
+
+#if REDNOISE_LOGGING
+#define LOG(level, category, expr) \
+	do { \
+		if (isLogEnabled(category, level)) { \
+			static LogRateLimiter logLimiter_(REDNOISE_LOG_RATE); \
+			uint32_t logSuppressed_ = 0; \
+			if (logLimiter_.allow(logSuppressed_)) { \
+				std::ostringstream logStream_; \
+				logStream_ << expr; \
+				writeLogMessage(level, category, logStream_.str(), logSuppressed_); \
+			} \
+		} \
+	} while (0)
+#else
+#define LOG(level, category, expr) do {} while (0)
+#endif
+
+#define LOG_TRACE(category, expr) LOG(LogLevel::Trace, category, expr)
+#define LOG_DEBUG(category, expr) LOG(LogLevel::Debug, category, expr)
+#define LOG_INFO(category, expr) LOG(LogLevel::Info, category, expr)
+#define LOG_WARNING(category, expr) LOG(LogLevel::Warning, category, expr)
+#define LOG_ERROR(category, expr) LOG(LogLevel::Error, category, expr)
@@ -3,18 +3,18 @@
 #include <glm/glm.hpp>
 #include <string>
 #include <array>
+#include <cstdint>
 #include "Colour.h"
 #include "TexturePoint.h"
 
 struct ModelTriangle {
 	std::array<glm::vec3, 3> vertices{};
 	std::array<TexturePoint, 3> texturePoints{};
-	Colour colour{};
+	std::array<uint32_t, 3> vertexIndices{};  // position of each corner in the OBJ vertex list, shared corners share an index
 	glm::vec3 normal{};
-    bool isMirror = false;
-    bool isGlass = false;
+	uint16_t materialId = 0;  // index into the material table of the scene, colour, mirror and glass are looked up there
 
 	ModelTriangle();
-	ModelTriangle(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, Colour trigColour);
+	ModelTriangle(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, uint16_t material);
 	friend std::ostream &operator<<(std::ostream &os, const ModelTriangle &triangle);
 };
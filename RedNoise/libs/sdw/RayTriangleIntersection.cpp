@@ -6,6 +6,18 @@ RayTriangleIntersection::RayTriangleIntersection(const glm::vec3 &point, float d
 		distanceFromCamera(distance),
 		intersectedTriangle(triangle),
 		triangleIndex(index) {}
+RayTriangleIntersection::RayTriangleIntersection(const glm::vec3 &point, float distance, const ModelTriangle &triangle, size_t index,
+                                                 float u, float v) :
+		intersectionPoint(point),
+		distanceFromCamera(distance),
+		intersectedTriangle(triangle),
+		triangleIndex(index),
+		u(u),
+		v(v) {}
+
+glm::vec3 RayTriangleIntersection::barycentricWeights() const {
+	return glm::vec3(1.0f - u - v, u, v);
+}
 
 std::ostream &operator<<(std::ostream &os, const RayTriangleIntersection &intersection) {
 	os << "Intersection is at [" << intersection.intersectionPoint[0] << "," << intersection.intersectionPoint[1] << "," <<
@@ -9,8 +9,14 @@ struct RayTriangleIntersection {
 	float distanceFromCamera;
 	ModelTriangle intersectedTriangle;
 	size_t triangleIndex;
+	// barycentric coordinates of the hit, the weights of vertices[1] and vertices[2]
+	float u = 0.0f;
+	float v = 0.0f;
 
 	RayTriangleIntersection();
 	RayTriangleIntersection(const glm::vec3 &point, float distance, const ModelTriangle &triangle, size_t index);
+	RayTriangleIntersection(const glm::vec3 &point, float distance, const ModelTriangle &triangle, size_t index, float u, float v);
+	// the weights of the three vertices, for interpolating anything stored per vertex
+	glm::vec3 barycentricWeights() const;
 	friend std::ostream &operator<<(std::ostream &os, const RayTriangleIntersection &intersection);
 };
@@ -3,14 +3,22 @@
 #include "Utils.h"
 
 std::vector<std::string> split(const std::string &line, char delimiter) {
-	auto haystack = line;
 	std::vector<std::string> tokens;
-	size_t pos;
-	while ((pos = haystack.find(delimiter)) != std::string::npos) {
-		tokens.push_back(haystack.substr(0, pos));
-		haystack.erase(0, pos + 1);
-	}
-	// Push the remaining chars onto the vector
-	tokens.push_back(haystack);
+	split(line, delimiter, tokens);
 	return tokens;
 }
+
+void split(const std::string &line, char delimiter, std::vector<std::string> &tokens) {
+	size_t count = 0;
+	size_t start = 0;
+	while (true) {
+		size_t end = line.find(delimiter, start);
+		if (end == std::string::npos) end = line.size();
+		if (count == tokens.size()) tokens.emplace_back();
+		tokens[count++].assign(line, start, end - start);
+		// the remaining chars after the last delimiter are a token too, even when there are none
+		if (end == line.size()) break;
+		start = end + 1;
+	}
+	tokens.resize(count);
+}
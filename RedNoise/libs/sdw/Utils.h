@@ -4,3 +4,6 @@
 #include <vector>
 
 std::vector<std::string> split(const std::string &line, char delimiter);
+// the same tokens written into tokens, whose strings keep their memory from the line before, so a loader that
+// splits every line into the same vector stops going to the heap once it has seen its longest lines
+void split(const std::string &line, char delimiter, std::vector<std::string> &tokens);
@@ -0,0 +1,45 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef REDNOISE_COUNT_ALLOCATIONS
+
+namespace {
+    std::atomic<uint64_t> allocationCount{0};
+}
+
+// the array forms fall back to these
+void *operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void *memory = std::malloc(size > 0 ? size : 1)) return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+uint64_t heapAllocationCount() {
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+bool isCountingHeapAllocations() {
+    return true;
+}
+
+#else
+
+uint64_t heapAllocationCount() {
+    return 0;
+}
+
+bool isCountingHeapAllocations() {
+    return false;
+}
+
+#endif
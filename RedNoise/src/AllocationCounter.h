@@ -0,0 +1,11 @@
+#ifndef REDNOISE_ALLOCATIONCOUNTER_H
+#define REDNOISE_ALLOCATIONCOUNTER_H
+
+#include <cstdint>
+
+// the calls to the global operator new of the whole program so far, only counted in builds with
+// REDNOISE_COUNT_ALLOCATIONS, which replaces operator new with one that counts, always 0 in the others
+uint64_t heapAllocationCount();
+bool isCountingHeapAllocations();
+
+#endif //REDNOISE_ALLOCATIONCOUNTER_H
@@ -0,0 +1,99 @@
+#include "AnimationRendering.h"
+#include "HardShadowRendering.h"
+#include "RotateCamera.h"
+#include "Parallel.h"
+#include "Log.h"
+#include "RenderJob.h"
+#include <chrono>
+#include <map>
+#include <memory>
+
+AnimationSettings animationSettings;
+
+CameraPath makeOrbitPath(const glm::vec3 &start, const glm::vec3 &centre, float stepAngle, int frameCount) {
+    CameraPath path;
+    // every frame is rotated from the start, adding up the steps would add up their rounding too
+    for (int i = 0; i < frameCount; i++) path.positions.push_back(orbitCameraAroundY(start, stepAngle * i, centre));
+    return path;
+}
+
+CameraPath makeKeyframePath(const std::vector<glm::vec3> &keyframes, int framesPerSegment) {
+    CameraPath path;
+    for (size_t i = 0; i + 1 < keyframes.size(); i++) {
+        for (int frame = 0; frame < framesPerSegment; frame++) {
+            path.positions.push_back(glm::mix(keyframes[i], keyframes[i + 1], float(frame) / float(framesPerSegment)));
+        }
+    }
+    if (!keyframes.empty()) path.positions.push_back(keyframes.back());
+    return path;
+}
+
+void renderRayTracedAnimation(int width, int height, const std::string &filename, float focalLength,
+                              const std::string &materialFilename, int signalForShading, const CameraPath &path,
+                              const FrameWriter &writeFrame) {
+    auto start = std::chrono::steady_clock::now();
+    // everything the frames share is set up here once, the frames only read it
+    const std::vector<ModelTriangle> triangles = loadOBJ(filename, 0.35, materialFilename);
+    glm::vec3 modelCenter = calculateModelCenter(triangles);
+    const SceneLights &lights = getSceneLights(filename);
+    float ambientLight = 0.3f;  // ambient light intensity
+    selectShadowMap(filename, triangles, lights);
+    bool isGouraud = getShadingModel(signalForShading) == ShadingModel::Gouraud;
+    const SceneTriangles sceneTriangles = splitTriangles(triangles, getMaterials(materialFilename));
+    RenderKernels kernels = selectRenderKernels(signalForShading, sceneTriangles);
+
+    unsigned int threadCount = animationSettings.threadCount > 0 ? animationSettings.threadCount : workerThreadCount();
+    int maxFramesInFlight = int(threadCount) * std::max(1, animationSettings.framesInFlightPerThread);
+    int frameCount = int(path.positions.size());
+
+    std::mutex mutex;
+    std::condition_variable frameFinished;
+    std::map<int, std::unique_ptr<DrawingWindow>> finishedFrames;
+    auto renderFrameAt = [&](int frameIndex) {
+        std::unique_ptr<DrawingWindow> frame(new DrawingWindow(width, height));
+        // the camera and the gouraud lighting belong to this thread, the bake depends on where the camera is
+        cameraPosition = path.positions[frameIndex];
+        cameraOrientation = lookAt(modelCenter);
+        VertexLighting vertexLighting;
+        if (isGouraud) bakeVertexLighting(vertexLighting, triangles, lights, ambientLight);
+        activeVertexLighting = isGouraud ? &vertexLighting : nullptr;
+        kernels.renderFrame(*frame, wholeWindow(*frame), sceneTriangles, lights, ambientLight, focalLength);
+        activeVertexLighting = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finishedFrames[frameIndex] = std::move(frame);
+        }
+        frameFinished.notify_one();
+    };
+
+    {
+        ThreadPool pool(threadCount);
+        int submittedFrames = 0;
+        for (int frameIndex = 0; frameIndex < frameCount; frameIndex++) {
+            // the frames already submitted return at their first row, the pool still has to finish them
+            if (isRenderCancelled()) break;
+            // later frames may finish first, they wait in finishedFrames until it is their turn
+            for (; submittedFrames < frameCount && submittedFrames < frameIndex + maxFramesInFlight; submittedFrames++) {
+                int submitted = submittedFrames;
+                pool.submit([&renderFrameAt, submitted]() { renderFrameAt(submitted); });
+            }
+            std::unique_ptr<DrawingWindow> frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                frameFinished.wait(lock, [&]() { return finishedFrames.count(frameIndex) > 0; });
+                frame = std::move(finishedFrames[frameIndex]);
+                finishedFrames.erase(frameIndex);
+            }
+            if (isRenderCancelled()) break;
+            writeFrame(frameIndex, *frame);
+        }
+    }
+    if (isRenderCancelled()) {
+        LOG_INFO(LogCategory::RayTrace, "Animation cancelled");
+        return;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO(LogCategory::RayTrace, "Rendered " << frameCount << " frames on " << threadCount << " threads in "
+                                    << seconds << " s (" << frameCount / seconds << " frames per second)");
+}
@@ -0,0 +1,36 @@
+#ifndef REDNOISE_ANIMATIONRENDERING_H
+#define REDNOISE_ANIMATIONRENDERING_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <DrawingWindow.h>
+#include "glm/glm.hpp"
+
+// where the camera is in every frame, it always looks at the centre of the model like renderRayTracedScene
+struct CameraPath {
+    std::vector<glm::vec3> positions;
+};
+
+// frameCount frames around the vertical axis through centre, each stepAngle radians further, like holding j
+CameraPath makeOrbitPath(const glm::vec3 &start, const glm::vec3 &centre, float stepAngle, int frameCount);
+// straight lines through the keyframes, framesPerSegment frames from one keyframe to the next, ending on the last one
+CameraPath makeKeyframePath(const std::vector<glm::vec3> &keyframes, int framesPerSegment);
+
+struct AnimationSettings {
+    unsigned int threadCount = 0;   // 0 uses every core
+    int framesInFlightPerThread = 2;   // how far rendering may run ahead of the frame writer
+};
+
+extern AnimationSettings animationSettings;
+
+// gets the frames in order on the calling thread while the later frames are still rendering
+using FrameWriter = std::function<void(int frameIndex, DrawingWindow &frame)>;
+
+// ray traces every frame of the path like renderRayTracedScene, one frame per pool thread, so even small frames keep
+// every core busy, the scene, lights and shadow map are loaded once and shared read only by all frames
+void renderRayTracedAnimation(int width, int height, const std::string &filename, float focalLength,
+                              const std::string &materialFilename, int signalForShading, const CameraPath &path,
+                              const FrameWriter &writeFrame);
+
+#endif //REDNOISE_ANIMATIONRENDERING_H
@@ -0,0 +1,78 @@
+#include "AntiAliasing.h"
+#include <algorithm>
+
+AntiAliasingSettings antiAliasingSettings;
+
+const std::array<glm::vec2, rotatedGridSamples> rotatedGridOffsets = {{
+        glm::vec2(0.125f, 0.375f), glm::vec2(0.375f, -0.125f), glm::vec2(-0.125f, -0.375f), glm::vec2(-0.375f, 0.125f)
+}};
+
+namespace {
+    int channelDifference(uint32_t a, uint32_t b, int shift) {
+        return std::abs(int((a >> shift) & 0xFF) - int((b >> shift) & 0xFF));
+    }
+
+    // 1 or more means the two pixels are on different sides of an edge
+    float edgeStrength(const PixelSample &a, const PixelSample &b, const AntiAliasingSettings &settings) {
+        int colourDifference = std::max({channelDifference(a.colour, b.colour, 16), channelDifference(a.colour, b.colour, 8),
+                                         channelDifference(a.colour, b.colour, 0)});
+        float strength = float(colourDifference) / settings.colourThreshold;
+        bool aHit = a.depth != std::numeric_limits<float>::infinity();
+        bool bHit = b.depth != std::numeric_limits<float>::infinity();
+        if (aHit != bHit) {
+            strength += 1.0f;
+        } else if (aHit) {
+            float relativeDepth = std::abs(a.depth - b.depth) / std::min(a.depth, b.depth);
+            strength += relativeDepth / settings.depthThreshold;
+        }
+        if (a.triangleId != b.triangleId) strength += 0.5f;
+        return strength;
+    }
+}
+
+std::vector<size_t> findEdgePixels(const std::vector<PixelSample> &samples, size_t width, size_t height,
+                                   const AntiAliasingSettings &settings) {
+    std::vector<float> strengths(samples.size(), 0.0f);
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            size_t index = y * width + x;
+            // every pair of neighbours is compared once, both pixels of the pair may need the extra samples
+            if (x + 1 < width) {
+                float strength = edgeStrength(samples[index], samples[index + 1], settings);
+                strengths[index] = std::max(strengths[index], strength);
+                strengths[index + 1] = std::max(strengths[index + 1], strength);
+            }
+            if (y + 1 < height) {
+                float strength = edgeStrength(samples[index], samples[index + width], settings);
+                strengths[index] = std::max(strengths[index], strength);
+                strengths[index + width] = std::max(strengths[index + width], strength);
+            }
+        }
+    }
+
+    std::vector<size_t> edgePixels;
+    for (size_t i = 0; i < strengths.size(); i++) {
+        if (strengths[i] >= 1.0f) edgePixels.push_back(i);
+    }
+    size_t budget = size_t(std::max(0.0f, settings.budget) * samples.size());
+    if (edgePixels.size() > budget) {
+        std::nth_element(edgePixels.begin(), edgePixels.begin() + budget, edgePixels.end(),
+                         [&](size_t a, size_t b) { return strengths[a] > strengths[b]; });
+        edgePixels.resize(budget);
+        // back in scan order, which is kinder to the caches while tracing
+        std::sort(edgePixels.begin(), edgePixels.end());
+    }
+    return edgePixels;
+}
+
+uint32_t averageColours(const uint32_t *colours, int count) {
+    int red = 0, green = 0, blue = 0;
+    for (int i = 0; i < count; i++) {
+        red += (colours[i] >> 16) & 0xFF;
+        green += (colours[i] >> 8) & 0xFF;
+        blue += colours[i] & 0xFF;
+    }
+    // rounded to the nearest value
+    return (255u << 24) | (uint32_t((red + count / 2) / count) << 16) | (uint32_t((green + count / 2) / count) << 8) |
+           uint32_t((blue + count / 2) / count);
+}
@@ -0,0 +1,106 @@
+#ifndef REDNOISE_ANTIALIASING_H
+#define REDNOISE_ANTIALIASING_H
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <vector>
+#include <DrawingWindow.h>
+#include "glm/glm.hpp"
+#include "Log.h"
+#include "RenderJob.h"
+
+// what one camera ray found, the triangle and depth are kept to find the edges
+struct PixelSample {
+    uint32_t colour = 0;
+    long triangleId = -1;     // -1 for the background
+    float depth = std::numeric_limits<float>::infinity();
+};
+
+struct AntiAliasingSettings {
+    bool enabled = true;
+    float budget = 0.1f;            // at most this fraction of the pixels get extra samples in a frame
+    int colourThreshold = 24;       // a neighbour whose colour differs by this much in one channel marks an edge
+    float depthThreshold = 0.05f;   // the same for a relative depth difference
+};
+
+extern AntiAliasingSettings antiAliasingSettings;
+
+// rotated grid supersampling, the four subsamples have different x and different y so near horizontal
+// and near vertical edges both get four distinct positions
+const int rotatedGridSamples = 4;
+extern const std::array<glm::vec2, rotatedGridSamples> rotatedGridOffsets;
+
+// pixels that differ from a neighbour in colour or depth, a different triangle alone (the diagonal of a quad)
+// is not enough but makes the pixel more likely to be flagged, if more pixels than the budget allows are found
+// the strongest edges are kept
+std::vector<size_t> findEdgePixels(const std::vector<PixelSample> &samples, size_t width, size_t height,
+                                   const AntiAliasingSettings &settings);
+
+uint32_t averageColours(const uint32_t *colours, int count);
+
+// a rectangle of pixels in the frame, the whole frame or one tile of it
+struct PixelRect {
+    int x = 0, y = 0, width = 0, height = 0;
+
+    bool contains(int px, int py) const {
+        return px >= x && px < x + width && py >= y && py < y + height;
+    }
+};
+
+inline PixelRect wholeWindow(const DrawingWindow &window) {
+    return PixelRect{0, 0, int(window.width), int(window.height)};
+}
+
+// one sample through every pixel of the region, then rotated grid subsamples only on the edge pixels
+// traceSample(x, y, sampleIndex) shoots a ray through the image point (x, y), pixel centres are at whole numbers,
+// sampleIndex is different for every ray of the frame so it can seed anything random, it does not depend on the region
+// so a tile comes out the same as that part of a whole frame, a cancelled job leaves the rest of the region as it was
+template <typename TraceSample>
+void renderAdaptiveAntiAliased(DrawingWindow &window, const PixelRect &region, TraceSample traceSample) {
+    size_t frameWidth = window.width, frameHeight = window.height;
+    // a tile also traces a one pixel border around it, so the pixels along its edges are compared with the same
+    // neighbours as in a whole frame, the border itself is not written
+    int left = std::max(region.x - 1, 0), top = std::max(region.y - 1, 0);
+    int right = std::min(region.x + region.width + 1, int(frameWidth));
+    int bottom = std::min(region.y + region.height + 1, int(frameHeight));
+    size_t width = size_t(right - left), height = size_t(bottom - top);
+
+    std::vector<PixelSample> samples(width * height);
+    for (size_t y = 0; y < height; y++) {
+        if (isRenderCancelled()) return;
+        showRenderProgress(window);
+        for (size_t x = 0; x < width; x++) {
+            size_t frameX = left + x, frameY = top + y;
+            size_t index = y * width + x;
+            samples[index] = traceSample(float(frameX), float(frameY), uint32_t(frameY * frameWidth + frameX));
+            if (region.contains(int(frameX), int(frameY))) window.setPixelColour(frameX, frameY, samples[index].colour);
+        }
+    }
+    if (!antiAliasingSettings.enabled) return;
+
+    // the budget stays a fraction of the whole frame, edges crowd into some tiles and a per tile limit would cut
+    // them there, so a tile matches the whole frame whenever the frame as a whole stays within its budget
+    AntiAliasingSettings settings = antiAliasingSettings;
+    settings.budget *= float(frameWidth * frameHeight) / float(samples.size());
+    std::vector<size_t> edgePixels = findEdgePixels(samples, width, height, settings);
+    size_t refinedPixels = 0;
+    for (size_t index : edgePixels) {
+        size_t frameX = left + index % width, frameY = top + index / width;
+        if (!region.contains(int(frameX), int(frameY))) continue;
+        if (isRenderCancelled()) return;
+        showRenderProgress(window);
+        std::array<uint32_t, rotatedGridSamples + 1> colours;
+        colours[0] = samples[index].colour;
+        for (int i = 0; i < rotatedGridSamples; i++) {
+            uint32_t sampleIndex = uint32_t((i + 1) * frameWidth * frameHeight + frameY * frameWidth + frameX);
+            colours[i + 1] = traceSample(frameX + rotatedGridOffsets[i].x, frameY + rotatedGridOffsets[i].y, sampleIndex).colour;
+        }
+        window.setPixelColour(frameX, frameY, averageColours(colours.data(), int(colours.size())));
+        refinedPixels++;
+    }
+    LOG_DEBUG(LogCategory::RayTrace, "Anti-aliasing added " << refinedPixels * rotatedGridSamples
+                                     << " rays on " << refinedPixels << " edge pixels");
+}
+
+#endif //REDNOISE_ANTIALIASING_H
@@ -0,0 +1,70 @@
+#include "AreaLight.h"
+#include "HardShadowRendering.h"
+#include "Random.h"
+
+AreaLightSettings areaLightSettings;
+
+AreaLight getCornellBoxAreaLight() {
+    // just below the lamp, like the point light of the hard shadow modes
+    return AreaLight{glm::vec3(-0.1f, 0.89f, -0.15f), glm::vec3(0.2f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.4f)};
+}
+
+namespace {
+    uint32_t reverseBits(uint32_t value, int bitCount) {
+        uint32_t result = 0;
+        for (int i = 0; i < bitCount; i++) {
+            result = (result << 1) | ((value >> i) & 1);
+        }
+        return result;
+    }
+
+    // the even bits of a morton code are x and the odd bits are y
+    void decodeMorton(uint32_t code, uint32_t &x, uint32_t &y) {
+        x = 0;
+        y = 0;
+        for (int bit = 0; bit < 16; bit++) {
+            x |= ((code >> (2 * bit)) & 1) << bit;
+            y |= ((code >> (2 * bit + 1)) & 1) << bit;
+        }
+    }
+}
+
+int sampleAreaLight(const AreaLight &light, const RayTriangleIntersection &intersection,
+                    const std::vector<ModelTriangle> &triangles, const AreaLightSettings &settings,
+                    uint32_t seed, std::vector<LightSample> &samples) {
+    samples.clear();
+    int maxSamples = std::max(1, settings.maxSamples);
+    // the smallest power of two grid that has a stratum for every sample
+    int levels = 0;
+    while ((1 << (2 * levels)) < maxSamples) levels++;
+    int gridSize = 1 << levels;
+
+    uint32_t state = hashSeed(seed);
+    const glm::vec3 &point = intersection.intersectionPoint;
+    auto addSample = [&](int index) {
+        // reversing the morton code makes the first 4 samples land in different quadrants, the first 16 in
+        // different sixteenths and so on
+        uint32_t x, y;
+        decodeMorton(reverseBits(uint32_t(index), 2 * levels), x, y);
+        float s = (x + nextRandom(state)) / gridSize;
+        float t = (y + nextRandom(state)) / gridSize;
+        glm::vec3 position = light.corner + s * light.edgeU + t * light.edgeV;
+
+        glm::vec3 shadowRay = glm::normalize(position - point);
+        RayTriangleIntersection shadowIntersection = getClosestIntersection(point + shadowRay * 0.002f, shadowRay, triangles);
+        samples.push_back({position, !isInShadow(intersection, shadowIntersection, point, position)});
+    };
+
+    int probeSamples = glm::clamp(settings.probeSamples, 1, maxSamples);
+    for (int i = 0; i < probeSamples; i++) addSample(i);
+
+    // fully lit or fully occluded, more samples would only agree with the probes
+    bool allAgree = true;
+    for (const LightSample &sample : samples) {
+        if (sample.isVisible != samples[0].isVisible) allAgree = false;
+    }
+    if (!allAgree) {
+        for (int i = probeSamples; i < maxSamples; i++) addSample(i);
+    }
+    return int(samples.size());
+}
@@ -0,0 +1,43 @@
+#ifndef REDNOISE_AREALIGHT_H
+#define REDNOISE_AREALIGHT_H
+
+#include <vector>
+#include "glm/glm.hpp"
+#include "ModelTriangle.h"
+#include "RayTriangleIntersection.h"
+#include "Denoiser.h"
+
+// a rectangular light, the points on it are corner + s * edgeU + t * edgeV for s, t in [0, 1]
+struct AreaLight {
+    glm::vec3 corner{};
+    glm::vec3 edgeU{};
+    glm::vec3 edgeV{};
+};
+
+struct AreaLightSettings {
+    int probeSamples = 4;   // first pass, if these all agree the point is fully lit or fully occluded
+    int maxSamples = 4;     // upper limit per shaded point, only reached in the penumbra, 16 without the denoiser
+    // stratified light samples are far less noisy than paths, so only small differences are taken for noise
+    DenoiserSettings denoiser{true, 4, 0.1f, 64.0f, 0.05f};
+};
+
+// one point on the light and whether the shaded point can see it
+struct LightSample {
+    glm::vec3 position;
+    bool isVisible;
+};
+
+extern AreaLightSettings areaLightSettings;
+
+// the light under the ceiling lamp of the cornell box, used when a scene's light file has no arealight line
+AreaLight getCornellBoxAreaLight();
+
+// adaptive stratified sampling of the light as seen from the intersection
+// the light is split into a power of two grid of strata that are visited in an order where every prefix is spread
+// over the whole light, so the probe samples cover it evenly and the extra samples fill the gaps between them
+// returns the number of shadow rays that were fired, samples is cleared and refilled so it can be reused
+int sampleAreaLight(const AreaLight &light, const RayTriangleIntersection &intersection,
+                    const std::vector<ModelTriangle> &triangles, const AreaLightSettings &settings,
+                    uint32_t seed, std::vector<LightSample> &samples);
+
+#endif //REDNOISE_AREALIGHT_H
@@ -0,0 +1,250 @@
+#include "BVH.h"
+#include "Parallel.h"
+#include "Log.h"
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+DynamicBVHSettings dynamicBVHSettings;
+
+namespace {
+    const int binCount = 12;
+    const int maxDepth = 60;   // traverseBVH keeps at most one node per level on its stack, and it has room for 64
+
+    float surfaceArea(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+        glm::vec3 size = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    struct BVHBuilder {
+        const std::vector<glm::vec3> &boundsMin;
+        const std::vector<glm::vec3> &boundsMax;
+        std::vector<glm::vec3> centroids;
+        uint32_t maxLeafSize;
+        BVH &bvh;
+
+        void build(uint32_t nodeIndex, uint32_t first, uint32_t count, int depth) {
+            glm::vec3 nodeMin(std::numeric_limits<float>::max()), nodeMax(std::numeric_limits<float>::lowest());
+            glm::vec3 centroidMin = nodeMin, centroidMax = nodeMax;
+            for (uint32_t i = first; i < first + count; i++) {
+                uint32_t primitive = bvh.primitiveOrder[i];
+                nodeMin = glm::min(nodeMin, boundsMin[primitive]);
+                nodeMax = glm::max(nodeMax, boundsMax[primitive]);
+                centroidMin = glm::min(centroidMin, centroids[primitive]);
+                centroidMax = glm::max(centroidMax, centroids[primitive]);
+            }
+            bvh.nodes[nodeIndex] = BVHNode{nodeMin, nodeMax, first, count};
+            if (count <= maxLeafSize || depth >= maxDepth) return;
+
+            glm::vec3 extent = centroidMax - centroidMin;
+            int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+            uint32_t *order = bvh.primitiveOrder.data() + first;
+            uint32_t leftCount = 0;
+            if (extent[axis] > 0.0f) {
+                // sort the centroids into bins along the longest axis and split where the surface area cost is lowest
+                auto binOf = [&](uint32_t primitive) {
+                    int bin = int((centroids[primitive][axis] - centroidMin[axis]) / extent[axis] * binCount);
+                    return std::min(bin, binCount - 1);
+                };
+                glm::vec3 binMin[binCount], binMax[binCount];
+                uint32_t binSize[binCount] = {};
+                for (int bin = 0; bin < binCount; bin++) {
+                    binMin[bin] = glm::vec3(std::numeric_limits<float>::max());
+                    binMax[bin] = glm::vec3(std::numeric_limits<float>::lowest());
+                }
+                for (uint32_t i = 0; i < count; i++) {
+                    int bin = binOf(order[i]);
+                    binMin[bin] = glm::min(binMin[bin], boundsMin[order[i]]);
+                    binMax[bin] = glm::max(binMax[bin], boundsMax[order[i]]);
+                    binSize[bin]++;
+                }
+                float rightArea[binCount];
+                uint32_t rightSize[binCount];
+                glm::vec3 sweepMin(std::numeric_limits<float>::max()), sweepMax(std::numeric_limits<float>::lowest());
+                uint32_t sweepSize = 0;
+                for (int bin = binCount - 1; bin > 0; bin--) {
+                    sweepMin = glm::min(sweepMin, binMin[bin]);
+                    sweepMax = glm::max(sweepMax, binMax[bin]);
+                    sweepSize += binSize[bin];
+                    rightArea[bin] = surfaceArea(sweepMin, sweepMax);
+                    rightSize[bin] = sweepSize;
+                }
+                float bestCost = std::numeric_limits<float>::max();
+                int bestSplit = -1;
+                sweepMin = glm::vec3(std::numeric_limits<float>::max());
+                sweepMax = glm::vec3(std::numeric_limits<float>::lowest());
+                sweepSize = 0;
+                for (int bin = 0; bin < binCount - 1; bin++) {
+                    sweepMin = glm::min(sweepMin, binMin[bin]);
+                    sweepMax = glm::max(sweepMax, binMax[bin]);
+                    sweepSize += binSize[bin];
+                    if (sweepSize == 0 || rightSize[bin + 1] == 0) continue;
+                    float cost = sweepSize * surfaceArea(sweepMin, sweepMax) + rightSize[bin + 1] * rightArea[bin + 1];
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestSplit = bin;
+                    }
+                }
+                if (bestSplit >= 0) {
+                    leftCount = uint32_t(std::partition(order, order + count, [&](uint32_t primitive) {
+                        return binOf(primitive) <= bestSplit;
+                    }) - order);
+                }
+            }
+            if (leftCount == 0 || leftCount == count) {
+                // every centroid in one place, halve by count so the leaves stay small
+                leftCount = count / 2;
+                std::nth_element(order, order + leftCount, order + count, [&](uint32_t a, uint32_t b) {
+                    return centroids[a][axis] < centroids[b][axis];
+                });
+            }
+
+            uint32_t leftChild = uint32_t(bvh.nodes.size());
+            bvh.nodes.resize(bvh.nodes.size() + 2);
+            bvh.nodes[nodeIndex].first = leftChild;
+            bvh.nodes[nodeIndex].count = 0;
+            build(leftChild, first, leftCount, depth + 1);
+            build(leftChild + 1, first + leftCount, count - leftCount, depth + 1);
+        }
+    };
+
+    // refits the subtree under nodeIndex, the nodes at frontierDepth are already refit and only read
+    void refitSubtree(BVH &bvh, const std::vector<glm::vec3> &boundsMin, const std::vector<glm::vec3> &boundsMax,
+                      uint32_t nodeIndex, int depth, int frontierDepth) {
+        if (depth == frontierDepth) return;
+        BVHNode &node = bvh.nodes[nodeIndex];
+        glm::vec3 nodeMin(std::numeric_limits<float>::max()), nodeMax(std::numeric_limits<float>::lowest());
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                nodeMin = glm::min(nodeMin, boundsMin[bvh.primitiveOrder[i]]);
+                nodeMax = glm::max(nodeMax, boundsMax[bvh.primitiveOrder[i]]);
+            }
+        } else {
+            refitSubtree(bvh, boundsMin, boundsMax, node.first, depth + 1, frontierDepth);
+            refitSubtree(bvh, boundsMin, boundsMax, node.first + 1, depth + 1, frontierDepth);
+            const BVHNode &left = bvh.nodes[node.first], &right = bvh.nodes[node.first + 1];
+            nodeMin = glm::min(left.boundsMin, right.boundsMin);
+            nodeMax = glm::max(left.boundsMax, right.boundsMax);
+        }
+        node.boundsMin = nodeMin;
+        node.boundsMax = nodeMax;
+    }
+
+    void collectSubtrees(const BVH &bvh, uint32_t nodeIndex, int depth, int frontierDepth,
+                         std::vector<uint32_t> &subtrees) {
+        const BVHNode &node = bvh.nodes[nodeIndex];
+        if (depth == frontierDepth) {
+            subtrees.push_back(nodeIndex);
+        } else if (node.count == 0) {
+            collectSubtrees(bvh, node.first, depth + 1, frontierDepth, subtrees);
+            collectSubtrees(bvh, node.first + 1, depth + 1, frontierDepth, subtrees);
+        }
+    }
+}
+
+BVH buildBVH(const std::vector<glm::vec3> &boundsMin, const std::vector<glm::vec3> &boundsMax, uint32_t maxLeafSize) {
+    BVH bvh;
+    uint32_t count = uint32_t(boundsMin.size());
+    if (count == 0) return bvh;
+    bvh.primitiveOrder.resize(count);
+    for (uint32_t i = 0; i < count; i++) bvh.primitiveOrder[i] = i;
+    BVHBuilder builder{boundsMin, boundsMax, std::vector<glm::vec3>(count), std::max(maxLeafSize, 1u), bvh};
+    for (uint32_t i = 0; i < count; i++) builder.centroids[i] = (boundsMin[i] + boundsMax[i]) * 0.5f;
+    bvh.nodes.reserve(2 * count);
+    bvh.nodes.resize(1);
+    builder.build(0, 0, count, 0);
+    return bvh;
+}
+
+void computeTriangleBounds(const std::vector<TrianglePositions> &triangles, std::vector<glm::vec3> &boundsMin,
+                           std::vector<glm::vec3> &boundsMax) {
+    boundsMin.resize(triangles.size());
+    boundsMax.resize(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++) {
+        const std::array<glm::vec3, 3> &vertices = triangles[i].vertices;
+        glm::vec3 low = glm::min(glm::min(vertices[0], vertices[1]), vertices[2]);
+        glm::vec3 high = glm::max(glm::max(vertices[0], vertices[1]), vertices[2]);
+        // a little slack, the hit distance of the triangle test and of the slab test round differently
+        glm::vec3 largest = glm::max(glm::abs(low), glm::abs(high));
+        glm::vec3 slack(1e-5f * (1.0f + glm::max(largest.x, glm::max(largest.y, largest.z))));
+        boundsMin[i] = low - slack;
+        boundsMax[i] = high + slack;
+    }
+}
+
+BVH buildBVH(const std::vector<TrianglePositions> &triangles) {
+    std::vector<glm::vec3> boundsMin, boundsMax;
+    computeTriangleBounds(triangles, boundsMin, boundsMax);
+    return buildBVH(boundsMin, boundsMax, 4);
+}
+
+void refitBVH(BVH &bvh, const std::vector<glm::vec3> &boundsMin, const std::vector<glm::vec3> &boundsMax) {
+    if (bvh.nodes.empty()) return;
+    // a few subtrees per thread below the top levels, the top levels are refit afterwards on this thread
+    int frontierDepth = -1;
+    if (bvh.primitiveOrder.size() >= dynamicBVHSettings.parallelRefitSize) {
+        frontierDepth = 0;
+        while ((1u << frontierDepth) < 4 * workerThreadCount() && frontierDepth < 16) frontierDepth++;
+        std::vector<uint32_t> subtrees;
+        collectSubtrees(bvh, 0, 0, frontierDepth, subtrees);
+        parallelFor(subtrees.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) refitSubtree(bvh, boundsMin, boundsMax, subtrees[i], 0, -1);
+        });
+    }
+    refitSubtree(bvh, boundsMin, boundsMax, 0, 0, frontierDepth);
+}
+
+float costBVH(const BVH &bvh) {
+    if (bvh.nodes.empty()) return 0.0f;
+    float rootArea = surfaceArea(bvh.nodes[0].boundsMin, bvh.nodes[0].boundsMax);
+    if (rootArea <= 0.0f) return 0.0f;
+    double cost = 0.0;
+    for (const BVHNode &node : bvh.nodes) {
+        cost += double(surfaceArea(node.boundsMin, node.boundsMax)) * (node.count > 0 ? node.count : 1);
+    }
+    return float(cost / rootArea);
+}
+
+DynamicBVH::DynamicBVH(const std::vector<glm::vec3> &boundsMin, const std::vector<glm::vec3> &boundsMax,
+                       uint32_t maxLeafSize) : bvh(buildBVH(boundsMin, boundsMax, maxLeafSize)), maxLeafSize(maxLeafSize) {
+    builtCost = currentCost = costBVH(bvh);
+}
+
+void DynamicBVH::update(const std::vector<glm::vec3> &boundsMin, const std::vector<glm::vec3> &boundsMax) {
+    if (rebuild && rebuild->isFinished.load(std::memory_order_acquire)) {
+        // built from the bounds of a few updates ago, the refit below catches it up
+        std::swap(bvh, rebuild->bvh);
+        builtCost = rebuild->cost;
+        rebuild.reset();
+        LOG_INFO(LogCategory::RayTrace, "Swapped in the rebuilt BVH over " << boundsMin.size() << " primitives");
+    }
+    refitBVH(bvh, boundsMin, boundsMax);
+    currentCost = costBVH(bvh);
+    if (!rebuild && currentCost > builtCost * dynamicBVHSettings.rebuildCostGrowth) {
+        LOG_INFO(LogCategory::RayTrace, "BVH over " << boundsMin.size() << " primitives refit to " << costGrowth()
+                                        << " times its built cost, rebuilding it in the background");
+        std::shared_ptr<Rebuild> job = std::make_shared<Rebuild>();
+        rebuild = job;
+        uint32_t leafSize = maxLeafSize;
+        std::thread([job, boundsMin, boundsMax, leafSize]() {
+            job->bvh = buildBVH(boundsMin, boundsMax, leafSize);
+            job->cost = costBVH(job->bvh);
+            job->isFinished.store(true, std::memory_order_release);
+        }).detach();
+    }
+}
+
+RayTriangleIntersection intersectBVH(const BVH &bvh, const SceneTriangles &triangles,
+                                     const glm::vec3 &origin, const glm::vec3 &direction) {
+    float closest = std::numeric_limits<float>::infinity();
+    ClosestTriangleHit hit;
+    traverseBVH(bvh, origin, direction, closest, [&](uint32_t index, float &closestDistance) {
+        hit.test(origin, direction, triangles.positions[index].vertices, index, closestDistance);
+    });
+
+    RayTriangleIntersection closestIntersection;
+    closestIntersection.distanceFromCamera = std::numeric_limits<float>::infinity();
+    if (!hit.isHit()) return closestIntersection;
+    return RayTriangleIntersection(origin + closest * direction, closest, triangles[hit.sceneIndex].toModelTriangle(),
+                                   hit.sceneIndex, hit.u, hit.v);
+}
@@ -0,0 +1,160 @@
+#ifndef REDNOISE_BVH_H
+#define REDNOISE_BVH_H
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "glm/glm.hpp"
+#include "RayTriangleIntersection.h"
+#include "SceneTriangles.h"
+
+// 32 bytes, the two children of an inner node are next to each other
+struct BVHNode {
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    uint32_t first;   // inner node: index of the left child, the right one follows it; leaf: first entry of primitiveOrder
+    uint32_t count;   // number of primitives in a leaf, 0 for inner nodes
+};
+
+// bounding volume hierarchy over boxes, the primitives can be triangles, clusters or anything else with a box
+struct BVH {
+    std::vector<BVHNode> nodes;              // nodes[0] is the root
+    std::vector<uint32_t> primitiveOrder;    // primitive indices, every leaf covers a contiguous run
+};
+
+// binned surface area heuristic, leaves hold at most maxLeafSize primitives
+BVH buildBVH(const std::vector<glm::vec3> &boundsMin, const std::vector<glm::vec3> &boundsMax, uint32_t maxLeafSize);
+BVH buildBVH(const std::vector<TrianglePositions> &triangles);
+
+// the boxes buildBVH(triangles) puts around the triangles
+void computeTriangleBounds(const std::vector<TrianglePositions> &triangles, std::vector<glm::vec3> &boundsMin,
+                           std::vector<glm::vec3> &boundsMax);
+
+// recomputes every box bottom up after the primitives moved, the tree keeps its shape so it gets slower to traverse
+// the further they move from where it was built, large trees are refit one subtree per thread
+void refitBVH(BVH &bvh, const std::vector<glm::vec3> &boundsMin, const std::vector<glm::vec3> &boundsMax);
+
+// surface area heuristic cost of a ray through the tree, one per inner node and one per primitive of a leaf, each
+// weighted by the chance of a ray through the root reaching the node
+float costBVH(const BVH &bvh);
+
+struct DynamicBVHSettings {
+    float rebuildCostGrowth = 1.5f;       // a tree refit to this many times the cost it was built with is rebuilt
+    uint32_t parallelRefitSize = 4096;    // trees over fewer primitives are refit on the calling thread
+};
+
+extern DynamicBVHSettings dynamicBVHSettings;
+
+// a BVH over primitives that move, update refits it and once that has made it rebuildCostGrowth times as costly as
+// when it was built a new tree is built on a background thread, the first update after that thread finishes swaps it
+// in, so the thread that updates and renders never waits for a build
+class DynamicBVH {
+public:
+    DynamicBVH() = default;
+    DynamicBVH(const std::vector<glm::vec3> &boundsMin, const std::vector<glm::vec3> &boundsMax, uint32_t maxLeafSize);
+    // the new bounds of the same primitives in the same order, the tree must not be traversed while this runs
+    void update(const std::vector<glm::vec3> &boundsMin, const std::vector<glm::vec3> &boundsMax);
+    const BVH &tree() const { return bvh; }
+    // how many times as costly as when it was built the tree is now
+    float costGrowth() const { return builtCost > 0.0f ? currentCost / builtCost : 1.0f; }
+    bool isRebuilding() const { return rebuild != nullptr; }
+
+private:
+    struct Rebuild {
+        BVH bvh;
+        float cost = 0.0f;
+        std::atomic<bool> isFinished{false};
+    };
+
+    BVH bvh;
+    uint32_t maxLeafSize = 1;
+    float builtCost = 0.0f;
+    float currentCost = 0.0f;
+    std::shared_ptr<Rebuild> rebuild;   // shared with the thread building it, which may outlive this
+};
+
+// the ray triangle test of getClosestIntersection, t is the distance along the ray and u, v the barycentric weights
+// of vertices[1] and vertices[2]
+inline bool intersectRayTriangle(const glm::vec3 &origin, const glm::vec3 &direction,
+                                 const std::array<glm::vec3, 3> &vertices, float &t, float &u, float &v) {
+    glm::vec3 e0 = vertices[1] - vertices[0];
+    glm::vec3 e1 = vertices[2] - vertices[0];
+    glm::vec3 SPVector = origin - vertices[0];
+    glm::mat3 DEMatrix(-direction, e0, e1);
+    glm::vec3 possibleSolution = glm::inverse(DEMatrix) * SPVector;
+    t = possibleSolution.x, u = possibleSolution.y, v = possibleSolution.z;
+    return t > 0 && u >= 0 && u <= 1 && v >= 0 && v <= 1 && u + v <= 1;
+}
+
+// slab test, entry is where the ray enters the box, a box starting beyond maxDistance is a miss
+inline bool intersectBounds(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, const glm::vec3 &origin,
+                            const glm::vec3 &inverseDirection, float maxDistance, float &entry) {
+    glm::vec3 t0 = (boundsMin - origin) * inverseDirection;
+    glm::vec3 t1 = (boundsMax - origin) * inverseDirection;
+    glm::vec3 nearT = glm::min(t0, t1), farT = glm::max(t0, t1);
+    entry = glm::max(glm::max(nearT.x, nearT.y), glm::max(nearT.z, 0.0f));
+    float exit = glm::min(glm::min(farT.x, farT.y), farT.z);
+    return entry <= exit && entry <= maxDistance;
+}
+
+// calls intersectPrimitive(primitiveIndex, closest) for every primitive whose box the ray reaches before closest,
+// nearer children first, intersectPrimitive lowers closest when it finds a nearer hit
+template <typename IntersectPrimitive>
+void traverseBVH(const BVH &bvh, const glm::vec3 &origin, const glm::vec3 &direction, float &closest,
+                 IntersectPrimitive intersectPrimitive) {
+    if (bvh.nodes.empty()) return;
+    glm::vec3 inverseDirection = 1.0f / direction;
+    uint32_t stack[64];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    float entry, leftEntry, rightEntry;
+    while (stackSize > 0) {
+        const BVHNode &node = bvh.nodes[stack[--stackSize]];
+        if (!intersectBounds(node.boundsMin, node.boundsMax, origin, inverseDirection, closest, entry)) continue;
+        if (node.count > 0) {
+            for (uint32_t i = 0; i < node.count; i++) intersectPrimitive(bvh.primitiveOrder[node.first + i], closest);
+            continue;
+        }
+        const BVHNode &left = bvh.nodes[node.first], &right = bvh.nodes[node.first + 1];
+        bool hitsLeft = intersectBounds(left.boundsMin, left.boundsMax, origin, inverseDirection, closest, leftEntry);
+        bool hitsRight = intersectBounds(right.boundsMin, right.boundsMax, origin, inverseDirection, closest, rightEntry);
+        // the nearer child goes on the stack last so it is visited first
+        if (hitsLeft && hitsRight && leftEntry < rightEntry) {
+            stack[stackSize++] = node.first + 1;
+            stack[stackSize++] = node.first;
+        } else {
+            if (hitsLeft) stack[stackSize++] = node.first;
+            if (hitsRight) stack[stackSize++] = node.first + 1;
+        }
+    }
+}
+
+// the nearest triangle a ray hits so far, the triangles are numbered in scene order and on a tie the lower scene index
+// wins, like in the linear loop of getClosestIntersection
+struct ClosestTriangleHit {
+    uint32_t sceneIndex = std::numeric_limits<uint32_t>::max();   // max while nothing was hit
+    float u = 0.0f, v = 0.0f;
+
+    bool isHit() const { return sceneIndex != std::numeric_limits<uint32_t>::max(); }
+
+    // keeps the triangle when the ray hits it before closest, which is then lowered to its distance
+    bool test(const glm::vec3 &origin, const glm::vec3 &direction, const std::array<glm::vec3, 3> &vertices,
+              uint32_t triangleSceneIndex, float &closest) {
+        float t, hitU, hitV;
+        if (!intersectRayTriangle(origin, direction, vertices, t, hitU, hitV)) return false;
+        if (t > closest || (t == closest && triangleSceneIndex >= sceneIndex)) return false;
+        closest = t;
+        sceneIndex = triangleSceneIndex;
+        u = hitU;
+        v = hitV;
+        return true;
+    }
+};
+
+// the same result as getClosestIntersection, triangleIndex is the index into triangles
+RayTriangleIntersection intersectBVH(const BVH &bvh, const SceneTriangles &triangles,
+                                     const glm::vec3 &origin, const glm::vec3 &direction);
+
+#endif //REDNOISE_BVH_H
@@ -0,0 +1,70 @@
+#include "CameraRays.h"
+#include <map>
+#include <memory>
+#include "HardShadowRendering.h"
+
+void AlignedFloats::resize(size_t count) {
+    storage.assign(count + alignment / sizeof(float), 0.0f);
+    void *start = storage.data();
+    size_t space = storage.size() * sizeof(float);
+    first = static_cast<float *>(std::align(alignment, count * sizeof(float), start, space));
+}
+
+glm::vec3 CameraRayTable::computeDirection(float x, float y) const {
+    return computeRayDirection(int(width), int(height), x, y, focalLength, orientation);
+}
+
+namespace {
+    // the sizes a thread keeps tables for before it drops them all
+    const size_t maxTablesPerThread = 4;
+
+    void fillCameraSpace(CameraRayTable &table, size_t width, size_t height, float focalLength) {
+        table.width = width;
+        table.height = height;
+        table.focalLength = focalLength;
+        size_t count = width * height;
+        for (AlignedFloats *component : {&table.cameraX, &table.cameraY, &table.cameraZ,
+                                         &table.worldX, &table.worldY, &table.worldZ}) {
+            component->resize(count);
+        }
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                glm::vec3 direction = computeRayDirection(int(width), int(height), int(x), int(y), focalLength,
+                                                          glm::mat3(1.0f));
+                size_t index = y * width + x;
+                table.cameraX.data()[index] = direction.x;
+                table.cameraY.data()[index] = direction.y;
+                table.cameraZ.data()[index] = direction.z;
+            }
+        }
+    }
+
+    // one matrix vector product per pixel over plain float arrays, the compiler turns it into vector instructions,
+    // the directions stay normalised since the orientation is a rotation
+    void rotate(CameraRayTable &table, const glm::mat3 &orientation) {
+        table.orientation = orientation;
+        const float *cameraX = table.cameraX.data(), *cameraY = table.cameraY.data(), *cameraZ = table.cameraZ.data();
+        float *worldX = table.worldX.data(), *worldY = table.worldY.data(), *worldZ = table.worldZ.data();
+        const float m00 = orientation[0][0], m01 = orientation[0][1], m02 = orientation[0][2];
+        const float m10 = orientation[1][0], m11 = orientation[1][1], m12 = orientation[1][2];
+        const float m20 = orientation[2][0], m21 = orientation[2][1], m22 = orientation[2][2];
+        size_t count = table.width * table.height;
+        for (size_t i = 0; i < count; i++) {
+            worldX[i] = m00 * cameraX[i] + m10 * cameraY[i] + m20 * cameraZ[i];
+            worldY[i] = m01 * cameraX[i] + m11 * cameraY[i] + m21 * cameraZ[i];
+            worldZ[i] = m02 * cameraX[i] + m12 * cameraY[i] + m22 * cameraZ[i];
+        }
+    }
+}
+
+const CameraRayTable &getCameraRayTable(size_t width, size_t height, float focalLength, const glm::mat3 &orientation) {
+    // per thread, the frames of an animation render side by side from different cameras
+    thread_local std::map<std::pair<size_t, size_t>, CameraRayTable> tables;
+    std::pair<size_t, size_t> size(width, height);
+    if (tables.size() >= maxTablesPerThread && tables.find(size) == tables.end()) tables.clear();
+    CameraRayTable &table = tables[size];
+    bool isResized = table.width != width || table.height != height || table.focalLength != focalLength;
+    if (isResized) fillCameraSpace(table, width, height, focalLength);
+    if (isResized || table.orientation != orientation) rotate(table, orientation);
+    return table;
+}
@@ -0,0 +1,55 @@
+#ifndef REDNOISE_CAMERARAYS_H
+#define REDNOISE_CAMERARAYS_H
+
+#include <cstddef>
+#include <vector>
+#include "glm/glm.hpp"
+
+// floats whose first element is 32 bytes aligned, so the loops over them can use whole vector registers
+class AlignedFloats {
+public:
+    AlignedFloats() = default;
+    AlignedFloats(const AlignedFloats &) = delete;
+    AlignedFloats &operator=(const AlignedFloats &) = delete;
+    void resize(size_t count);
+    float *data() { return first; }
+    const float *data() const { return first; }
+    float operator[](size_t index) const { return first[index]; }
+
+private:
+    static const size_t alignment = 32;
+    std::vector<float> storage;
+    float *first = nullptr;
+};
+
+// the directions of the camera rays through the pixel centres, one array per component
+// the camera space ones only depend on the window size and the focal length, the world space ones are those rotated
+// by the orientation, so moving the camera without turning it reuses both and turning it only rotates them again
+struct CameraRayTable {
+    size_t width = 0;
+    size_t height = 0;
+    float focalLength = 0.0f;
+    glm::mat3 orientation{};
+    AlignedFloats cameraX, cameraY, cameraZ;   // normalised, the camera looking down its z axis
+    AlignedFloats worldX, worldY, worldZ;
+
+    // computeRayDirection through (x, y), from the table when it is a pixel centre
+    glm::vec3 direction(float x, float y) const {
+        if (x >= 0.0f && y >= 0.0f) {
+            size_t column = size_t(x), row = size_t(y);
+            if (float(column) == x && float(row) == y && column < width && row < height) {
+                size_t index = row * width + column;
+                return glm::vec3(worldX[index], worldY[index], worldZ[index]);
+            }
+        }
+        return computeDirection(x, y);
+    }
+    // computeRayDirection with this table's camera, for the rays between the pixel centres
+    glm::vec3 computeDirection(float x, float y) const;
+};
+
+// the table of the calling thread for this window size, filled again only when the focal length changed and rotated
+// again only when the orientation did, the thread keeps a few sizes so previews and full frames do not evict each other
+const CameraRayTable &getCameraRayTable(size_t width, size_t height, float focalLength, const glm::mat3 &orientation);
+
+#endif //REDNOISE_CAMERARAYS_H
@@ -0,0 +1,110 @@
+#include "Denoiser.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+    const float kernelWeights[5] = {1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+
+    // one pass with the taps step pixels apart, from source into destination
+    void filterPass(const std::vector<glm::vec3> &source, std::vector<glm::vec3> &destination,
+                    const GuideBuffers &guides, int step, float colourSigma, const DenoiserSettings &settings) {
+        int width = int(guides.width), height = int(guides.height);
+        float colourScale = 1.0f / (colourSigma * colourSigma);
+        parallelFor(guides.height, [&](size_t begin, size_t end) {
+            for (int y = int(begin); y < int(end); y++) {
+                for (int x = 0; x < width; x++) {
+                    size_t centre = size_t(y) * width + x;
+                    float centreDepth = guides.depth[centre];
+                    if (std::isinf(centreDepth)) {
+                        destination[centre] = source[centre];
+                        continue;
+                    }
+                    const glm::vec3 &centreColour = source[centre];
+                    const glm::vec3 &centreNormal = guides.normal[centre];
+                    uint32_t centreMaterial = guides.materialId[centre];
+                    // the depth a neighbour may differ by grows with its distance in pixels
+                    float depthScale = 1.0f / (settings.depthSigma * centreDepth * float(step));
+                    glm::vec3 sum(0.0f);
+                    float weightSum = 0.0f;
+                    for (int dy = -2; dy <= 2; dy++) {
+                        int sampleY = std::min(std::max(y + dy * step, 0), height - 1);
+                        for (int dx = -2; dx <= 2; dx++) {
+                            int sampleX = std::min(std::max(x + dx * step, 0), width - 1);
+                            size_t sample = size_t(sampleY) * width + sampleX;
+                            if (guides.materialId[sample] != centreMaterial || std::isinf(guides.depth[sample])) continue;
+                            // the three edge stopping weights multiplied in one exp, exp(-power * (1 - cos)) is
+                            // close to cos^power for the normals that matter and costs no pow
+                            glm::vec3 colourDifference = source[sample] - centreColour;
+                            float exponent = glm::dot(colourDifference, colourDifference) * colourScale +
+                                             settings.normalPower * (1.0f - glm::dot(centreNormal, guides.normal[sample])) +
+                                             std::abs(guides.depth[sample] - centreDepth) * depthScale;
+                            float weight = kernelWeights[dx + 2] * kernelWeights[dy + 2] * std::exp(-exponent);
+                            sum += weight * source[sample];
+                            weightSum += weight;
+                        }
+                    }
+                    // the centre tap always has a weight, so weightSum is never 0
+                    destination[centre] = sum / weightSum;
+                }
+            }
+        });
+    }
+}
+
+void GuideBuffers::resize(size_t newWidth, size_t newHeight) {
+    width = newWidth;
+    height = newHeight;
+    normal.assign(width * height, glm::vec3(0.0f));
+    depth.assign(width * height, std::numeric_limits<float>::infinity());
+    albedo.assign(width * height, glm::vec3(0.0f));
+    materialId.assign(width * height, 0);
+}
+
+void GuideBuffers::write(size_t index, const RayTriangleIntersection &intersection, const glm::vec3 &surfaceNormal,
+                         const glm::vec3 &surfaceAlbedo) {
+    normal[index] = surfaceNormal;
+    depth[index] = intersection.distanceFromCamera;
+    albedo[index] = surfaceAlbedo;
+    materialId[index] = intersection.intersectedTriangle.materialId;
+}
+
+void denoiseImage(std::vector<glm::vec3> &image, const GuideBuffers &guides, const DenoiserSettings &settings) {
+    if (image.size() != guides.width * guides.height || image.empty()) return;
+    // divide out the albedo, a channel the surface does not reflect is filtered as it is, it is only non zero where
+    // an anti aliased edge pixel took some of it from the surface next to it
+    std::vector<glm::vec3> albedo(image.size());
+    for (size_t i = 0; i < image.size(); i++) {
+        albedo[i] = glm::mix(glm::vec3(1.0f), guides.albedo[i], glm::greaterThan(guides.albedo[i], glm::vec3(0.0f)));
+        if (!std::isinf(guides.depth[i])) image[i] /= albedo[i];
+    }
+    std::vector<glm::vec3> filtered(image.size());
+    float colourSigma = settings.colourSigma;
+    for (int iteration = 0; iteration < settings.iterations; iteration++) {
+        filterPass(image, filtered, guides, 1 << iteration, colourSigma, settings);
+        std::swap(image, filtered);
+        // the wider passes only smooth what is left of the noise, not the shading
+        colourSigma *= 0.5f;
+    }
+    for (size_t i = 0; i < image.size(); i++) {
+        // the background pixels were never divided
+        if (!std::isinf(guides.depth[i])) image[i] *= albedo[i];
+    }
+}
+
+void denoiseWindow(DrawingWindow &window, const GuideBuffers &guides, const DenoiserSettings &settings) {
+    if (guides.width != window.width || guides.height != window.height) return;
+    std::vector<glm::vec3> image(window.width * window.height);
+    uint32_t *pixels = window.getPixelBuffer();
+    for (size_t i = 0; i < image.size(); i++) {
+        image[i] = glm::vec3((pixels[i] >> 16) & 0xFF, (pixels[i] >> 8) & 0xFF, pixels[i] & 0xFF) / 255.0f;
+    }
+    denoiseImage(image, guides, settings);
+    // the background pixels keep what the renderer wrote
+    for (size_t i = 0; i < image.size(); i++) {
+        if (std::isinf(guides.depth[i])) continue;
+        glm::vec3 colour = glm::clamp(image[i], 0.0f, 1.0f) * 255.0f;
+        pixels[i] = (255 << 24) | (int(colour.r) << 16) | (int(colour.g) << 8) | int(colour.b);
+    }
+}
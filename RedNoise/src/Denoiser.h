@@ -0,0 +1,44 @@
+#ifndef REDNOISE_DENOISER_H
+#define REDNOISE_DENOISER_H
+
+#include <cstdint>
+#include <vector>
+#include <DrawingWindow.h>
+#include "glm/glm.hpp"
+#include "RayTriangleIntersection.h"
+
+// every renderer that denoises keeps its own, colourSigma has to follow how noisy its images are
+struct DenoiserSettings {
+    bool enabled = true;
+    int iterations = 4;            // the kernel taps are 1, 2, 4, ... pixels apart, 4 passes reach 30 pixels away
+    float colourSigma = 0.5f;      // neighbours whose light differs by much more than this are left out, halved every pass
+    float normalPower = 64.0f;     // the normal weight is about the cosine between the normals raised to this
+    float depthSigma = 0.05f;      // relative depth difference per pixel of distance that still mixes
+};
+
+// what the renderer saw through the centre of every pixel, the filter only mixes pixels that agree on these
+// materialId is used instead of the triangle, a wall of two triangles would otherwise keep a seam along its diagonal
+struct GuideBuffers {
+    size_t width = 0;
+    size_t height = 0;
+    std::vector<glm::vec3> normal;
+    std::vector<float> depth;             // infinity where the ray left the scene, those pixels are not filtered
+    std::vector<glm::vec3> albedo;        // the surface colour in [0, 1], the light is filtered without it
+    std::vector<uint32_t> materialId;
+
+    // every pixel set to nothing hit
+    void resize(size_t newWidth, size_t newHeight);
+    void write(size_t index, const RayTriangleIntersection &intersection, const glm::vec3 &surfaceNormal,
+               const glm::vec3 &surfaceAlbedo);
+};
+
+// edge avoiding a-trous wavelet filter, a 5x5 b3 spline kernel spread further apart every pass, each tap weighted
+// by how close its light, normal, depth and material are to the centre pixel's
+// the image is divided by the albedo first, so textures and colour edges are not blurred, only the light on them,
+// the rows of every pass are filtered on all cores
+void denoiseImage(std::vector<glm::vec3> &image, const GuideBuffers &guides, const DenoiserSettings &settings);
+
+// the same filter on the pixels already in the window, for renderers that write packed colours
+void denoiseWindow(DrawingWindow &window, const GuideBuffers &guides, const DenoiserSettings &settings);
+
+#endif //REDNOISE_DENOISER_H
@@ -0,0 +1,561 @@
+#include "DistributedRendering.h"
+#include "HardShadowRendering.h"
+#include "Log.h"
+#include "RenderJob.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+DistributedRenderSettings distributedRenderSettings;
+const char tileWorkerFlag[] = "--tile-worker";
+
+namespace {
+    const uint32_t tileRequestMagic = 0x52515431;
+    const uint32_t tileResultMagic = 0x52525431;
+    const size_t messageHeaderSize = 2 * sizeof(uint32_t);
+    const uint32_t maxMessageSize = 256u << 20;
+
+    bool isHostLittleEndian() {
+        const uint16_t one = 1;
+        uint8_t first;
+        std::memcpy(&first, &one, 1);
+        return first == 1;
+    }
+
+    // numbers go over the pipes little endian whatever the machine, a worker started over ssh may be another kind
+    template <typename T>
+    void storeValue(uint8_t *at, const T &value) {
+        std::memcpy(at, &value, sizeof(T));
+        if (!isHostLittleEndian()) std::reverse(at, at + sizeof(T));
+    }
+
+    template <typename T>
+    T loadValue(const uint8_t *at) {
+        uint8_t raw[sizeof(T)];
+        std::memcpy(raw, at, sizeof(T));
+        if (!isHostLittleEndian()) std::reverse(raw, raw + sizeof(T));
+        T value;
+        std::memcpy(&value, raw, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    void appendValue(std::vector<uint8_t> &bytes, const T &value) {
+        bytes.resize(bytes.size() + sizeof(T));
+        storeValue(bytes.data() + bytes.size() - sizeof(T), value);
+    }
+
+    void appendString(std::vector<uint8_t> &bytes, const std::string &text) {
+        appendValue(bytes, uint32_t(text.size()));
+        bytes.insert(bytes.end(), text.begin(), text.end());
+    }
+
+    void appendRect(std::vector<uint8_t> &bytes, const PixelRect &rect) {
+        for (int32_t value : {rect.x, rect.y, rect.width, rect.height}) appendValue(bytes, value);
+    }
+
+    std::vector<uint8_t> startMessage(uint32_t magic) {
+        std::vector<uint8_t> bytes;
+        appendValue(bytes, magic);
+        appendValue(bytes, uint32_t(0));   // the payload length, filled in by finishMessage
+        return bytes;
+    }
+
+    void finishMessage(std::vector<uint8_t> &bytes) {
+        storeValue(bytes.data() + sizeof(uint32_t), uint32_t(bytes.size() - messageHeaderSize));
+    }
+
+    // reads the fields back in the order they were appended, every read fails once the message runs out
+    struct MessageReader {
+        const std::vector<uint8_t> &bytes;
+        size_t offset;
+
+        template <typename T>
+        bool read(T &value) {
+            if (bytes.size() - offset < sizeof(T)) return false;
+            value = loadValue<T>(bytes.data() + offset);
+            offset += sizeof(T);
+            return true;
+        }
+
+        bool readString(std::string &text) {
+            uint32_t size;
+            if (!read(size) || bytes.size() - offset < size) return false;
+            text.assign(reinterpret_cast<const char *>(bytes.data() + offset), size);
+            offset += size;
+            return true;
+        }
+
+        bool readRect(PixelRect &rect) {
+            int32_t x, y, width, height;
+            if (!read(x) || !read(y) || !read(width) || !read(height)) return false;
+            rect = PixelRect{x, y, width, height};
+            return true;
+        }
+    };
+
+    bool checkMagic(const std::vector<uint8_t> &message, uint32_t expected) {
+        return message.size() >= messageHeaderSize && loadValue<uint32_t>(message.data()) == expected;
+    }
+}
+
+std::vector<uint8_t> encodeTileRequest(const TileRequest &request) {
+    std::vector<uint8_t> bytes = startMessage(tileRequestMagic);
+    appendValue(bytes, request.tileId);
+    appendString(bytes, request.objFilename);
+    appendString(bytes, request.materialFilename);
+    appendValue(bytes, request.focalLength);
+    appendValue(bytes, request.signalForShading);
+    appendValue(bytes, request.shadowMode);
+    for (int i = 0; i < 3; i++) appendValue(bytes, request.cameraPosition[i]);
+    for (int column = 0; column < 3; column++) {
+        for (int row = 0; row < 3; row++) appendValue(bytes, request.cameraOrientation[column][row]);
+    }
+    appendValue(bytes, request.frameWidth);
+    appendValue(bytes, request.frameHeight);
+    appendRect(bytes, request.rect);
+    finishMessage(bytes);
+    return bytes;
+}
+
+bool decodeTileRequest(const std::vector<uint8_t> &message, TileRequest &request) {
+    if (!checkMagic(message, tileRequestMagic)) return false;
+    MessageReader reader{message, messageHeaderSize};
+    bool isValid = reader.read(request.tileId) && reader.readString(request.objFilename) &&
+                   reader.readString(request.materialFilename) && reader.read(request.focalLength) &&
+                   reader.read(request.signalForShading) && reader.read(request.shadowMode);
+    for (int i = 0; i < 3; i++) isValid = isValid && reader.read(request.cameraPosition[i]);
+    for (int column = 0; column < 3; column++) {
+        for (int row = 0; row < 3; row++) isValid = isValid && reader.read(request.cameraOrientation[column][row]);
+    }
+    return isValid && reader.read(request.frameWidth) && reader.read(request.frameHeight) && reader.readRect(request.rect);
+}
+
+std::vector<uint8_t> encodeTileResult(const TileResult &result) {
+    std::vector<uint8_t> bytes = startMessage(tileResultMagic);
+    appendValue(bytes, result.tileId);
+    appendRect(bytes, result.rect);
+    bytes.reserve(bytes.size() + result.pixels.size() * sizeof(uint32_t));
+    for (uint32_t pixel : result.pixels) appendValue(bytes, pixel);
+    finishMessage(bytes);
+    return bytes;
+}
+
+bool decodeTileResult(const std::vector<uint8_t> &message, TileResult &result) {
+    if (!checkMagic(message, tileResultMagic)) return false;
+    MessageReader reader{message, messageHeaderSize};
+    if (!reader.read(result.tileId) || !reader.readRect(result.rect)) return false;
+    if (result.rect.width < 0 || result.rect.height < 0) return false;
+    size_t pixelCount = size_t(result.rect.width) * size_t(result.rect.height);
+    if (message.size() - reader.offset != pixelCount * sizeof(uint32_t)) return false;
+    result.pixels.resize(pixelCount);
+    for (size_t i = 0; i < pixelCount; i++) reader.read(result.pixels[i]);
+    return true;
+}
+
+bool takeMessage(std::vector<uint8_t> &received, std::vector<uint8_t> &message) {
+    if (received.size() < messageHeaderSize) return false;
+    size_t messageSize = messageHeaderSize + loadValue<uint32_t>(received.data() + sizeof(uint32_t));
+    if (received.size() < messageSize) return false;
+    message.assign(received.begin(), received.begin() + messageSize);
+    received.erase(received.begin(), received.begin() + messageSize);
+    return true;
+}
+
+#ifndef _WIN32
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    bool readFully(int fd, void *data, size_t size) {
+        uint8_t *bytes = static_cast<uint8_t *>(data);
+        while (size > 0) {
+            ssize_t count = read(fd, bytes, size);
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0) return false;
+            bytes += count;
+            size -= size_t(count);
+        }
+        return true;
+    }
+
+    bool writeFully(int fd, const std::vector<uint8_t> &bytes) {
+        size_t written = 0;
+        while (written < bytes.size()) {
+            ssize_t count = write(fd, bytes.data() + written, bytes.size() - written);
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0) return false;
+            written += size_t(count);
+        }
+        return true;
+    }
+
+    // the worker side reads blocking, it has nothing else to do until the next request arrives
+    bool readMessage(int fd, std::vector<uint8_t> &message) {
+        message.resize(messageHeaderSize);
+        if (!readFully(fd, message.data(), messageHeaderSize)) return false;
+        uint32_t payloadSize = loadValue<uint32_t>(message.data() + sizeof(uint32_t));
+        if (payloadSize > maxMessageSize) return false;
+        message.resize(messageHeaderSize + payloadSize);
+        return readFully(fd, message.data() + messageHeaderSize, payloadSize);
+    }
+
+    struct WorkerProcess {
+        pid_t pid = -1;
+        int requestFd = -1;
+        int resultFd = -1;
+        std::vector<uint8_t> received;
+        int tile = -1;              // the tile it is rendering, -1 when idle
+        Clock::time_point started;
+        int timeouts = 0;
+        bool isAlive = false;
+    };
+
+    std::string defaultWorkerCommand() {
+        char path[4096];
+        ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+        if (length <= 0) return std::string("./RedNoise ") + tileWorkerFlag;
+        return "'" + std::string(path, size_t(length)) + "' " + tileWorkerFlag;
+    }
+
+    bool startWorker(const std::string &command, WorkerProcess &worker) {
+        int toWorker[2], fromWorker[2];
+        if (pipe(toWorker) != 0) return false;
+        if (pipe(fromWorker) != 0) {
+            close(toWorker[0]);
+            close(toWorker[1]);
+            return false;
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            for (int fd : {toWorker[0], toWorker[1], fromWorker[0], fromWorker[1]}) close(fd);
+            return false;
+        }
+        if (pid == 0) {
+            // its own process group, so stopWorker also reaches whatever the shell command started
+            setpgid(0, 0);
+            dup2(toWorker[0], STDIN_FILENO);
+            dup2(fromWorker[1], STDOUT_FILENO);
+            for (int fd : {toWorker[0], toWorker[1], fromWorker[0], fromWorker[1]}) close(fd);
+            execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char *>(nullptr));
+            _exit(127);
+        }
+        close(toWorker[0]);
+        close(fromWorker[1]);
+        // the coordinator's ends must not leak into the workers started later, or a worker would never see its
+        // request pipe close
+        fcntl(toWorker[1], F_SETFD, FD_CLOEXEC);
+        fcntl(fromWorker[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fromWorker[0], F_SETFL, fcntl(fromWorker[0], F_GETFL) | O_NONBLOCK);
+
+        worker.pid = pid;
+        worker.requestFd = toWorker[1];
+        worker.resultFd = fromWorker[0];
+        worker.received.clear();
+        worker.tile = -1;
+        worker.timeouts = 0;
+        worker.isAlive = true;
+        return true;
+    }
+
+    // an idle worker exits by itself once its request pipe closes, a busy one is killed
+    void stopWorker(WorkerProcess &worker) {
+        if (worker.pid < 0) return;
+        close(worker.requestFd);
+        close(worker.resultFd);
+        if (worker.tile >= 0) kill(-worker.pid, SIGKILL);
+        waitpid(worker.pid, nullptr, 0);
+        worker.pid = -1;
+        worker.tile = -1;
+        worker.isAlive = false;
+    }
+
+    // the workers outlive the frame, so each one loads its scene once and keeps it for the frames after, only the
+    // ones that died or were killed are started again, they all exit when the pool closes their pipes at exit
+    struct WorkerPool {
+        std::string command;
+        std::vector<WorkerProcess> workers;
+
+        ~WorkerPool() {
+            for (WorkerProcess &worker : workers) stopWorker(worker);
+        }
+    };
+
+    std::vector<WorkerProcess> &getWorkers(const std::string &command, size_t count) {
+        static WorkerPool pool;
+        if (command != pool.command) {
+            for (WorkerProcess &worker : pool.workers) stopWorker(worker);
+            pool.command = command;
+        }
+        for (size_t i = count; i < pool.workers.size(); i++) stopWorker(pool.workers[i]);
+        pool.workers.resize(count);
+        for (WorkerProcess &worker : pool.workers) {
+            if (worker.isAlive) continue;
+            if (!startWorker(command, worker)) LOG_WARNING(LogCategory::RayTrace, "Could not start a tile worker: " << strerror(errno));
+        }
+        return pool.workers;
+    }
+
+    const std::vector<ModelTriangle> &getWorkerScene(const std::string &objFilename, const std::string &materialFilename) {
+        // a worker usually renders many tiles of the same scene, so the last one loaded is kept
+        static std::string loadedKey;
+        static std::vector<ModelTriangle> triangles;
+        std::string key = objFilename + "|" + materialFilename;
+        if (key != loadedKey) {
+            // the same scale renderRayTracedScene loads the scene with
+            triangles = loadOBJ(objFilename, 0.35, materialFilename);
+            loadedKey = key;
+        }
+        return triangles;
+    }
+
+    // the tiles of one frame differ only in their id and rect
+    bool isSameFrame(const TileRequest &a, const TileRequest &b) {
+        return a.objFilename == b.objFilename && a.materialFilename == b.materialFilename &&
+               a.focalLength == b.focalLength && a.signalForShading == b.signalForShading &&
+               a.shadowMode == b.shadowMode && a.cameraPosition == b.cameraPosition &&
+               a.cameraOrientation == b.cameraOrientation && a.frameWidth == b.frameWidth &&
+               a.frameHeight == b.frameHeight;
+    }
+}
+
+int runTileWorker() {
+    // the log writes to stdout, which from now on only carries results
+    int requestFd = STDIN_FILENO;
+    int resultFd = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+
+    DrawingWindow window(0, 0);
+    RayTracedFrame frame;
+    TileRequest preparedRequest;
+    bool isPrepared = false;
+    std::vector<uint8_t> message;
+    while (readMessage(requestFd, message)) {
+        TileRequest request;
+        if (!decodeTileRequest(message, request)) {
+            LOG_ERROR(LogCategory::RayTrace, "Tile worker received a broken request");
+            return 1;
+        }
+        const PixelRect &rect = request.rect;
+        if (request.frameWidth <= 0 || request.frameHeight <= 0 || rect.x < 0 || rect.y < 0 || rect.width < 0 ||
+            rect.height < 0 || rect.x + rect.width > request.frameWidth || rect.y + rect.height > request.frameHeight) {
+            LOG_ERROR(LogCategory::RayTrace, "Tile " << request.tileId << " is not inside its frame");
+            return 1;
+        }
+        cameraPosition = request.cameraPosition;
+        cameraOrientation = request.cameraOrientation;
+        shadowMode = ShadowMode(request.shadowMode);
+        if (window.width != size_t(request.frameWidth) || window.height != size_t(request.frameHeight)) {
+            window = DrawingWindow(request.frameWidth, request.frameHeight);
+        }
+
+        // the frame is set up again only when a tile of another frame arrives
+        if (!isPrepared || !isSameFrame(request, preparedRequest)) {
+            const std::vector<ModelTriangle> &triangles = getWorkerScene(request.objFilename, request.materialFilename);
+            prepareRayTracedFrame(frame, request.objFilename, triangles, request.focalLength, request.materialFilename,
+                                  request.signalForShading);
+            preparedRequest = request;
+            isPrepared = true;
+        }
+        renderRayTracedTile(window, rect, frame);
+
+        TileResult result;
+        result.tileId = request.tileId;
+        result.rect = rect;
+        result.pixels.reserve(size_t(rect.width) * size_t(rect.height));
+        for (int y = rect.y; y < rect.y + rect.height; y++) {
+            for (int x = rect.x; x < rect.x + rect.width; x++) result.pixels.push_back(window.getPixelColour(x, y));
+        }
+        if (!writeFully(resultFd, encodeTileResult(result))) return 1;
+    }
+    return 0;
+}
+
+void renderDistributedScene(DrawingWindow &window, const std::string &filename, float focalLength,
+                            const std::string &materialFilename, int signalForShading) {
+    const DistributedRenderSettings &settings = distributedRenderSettings;
+    const std::vector<ModelTriangle> &triangles = getModel(filename, 0.35, materialFilename);
+    // aim the camera like renderRayTracedScene, the workers get the finished orientation
+    cameraOrientation = lookAt(calculateModelCenter(triangles));
+
+    std::vector<TileRequest> tiles;
+    int tileSize = std::max(settings.tileSize, 1);
+    for (int y = 0; y < int(window.height); y += tileSize) {
+        for (int x = 0; x < int(window.width); x += tileSize) {
+            TileRequest tile;
+            tile.tileId = uint32_t(tiles.size());
+            tile.objFilename = filename;
+            tile.materialFilename = materialFilename;
+            tile.focalLength = focalLength;
+            tile.signalForShading = signalForShading;
+            tile.shadowMode = int32_t(shadowMode);
+            tile.cameraPosition = cameraPosition;
+            tile.cameraOrientation = cameraOrientation;
+            tile.frameWidth = int32_t(window.width);
+            tile.frameHeight = int32_t(window.height);
+            tile.rect = PixelRect{x, y, std::min(tileSize, int(window.width) - x), std::min(tileSize, int(window.height) - y)};
+            tiles.push_back(tile);
+        }
+    }
+
+    std::vector<bool> isDone(tiles.size(), false), isQueued(tiles.size(), true);
+    size_t doneCount = 0;
+    std::deque<int> pending;
+    for (size_t i = 0; i < tiles.size(); i++) pending.push_back(int(i));
+    auto requeue = [&](int tile) {
+        if (tile < 0 || isDone[tile] || isQueued[tile]) return;
+        pending.push_front(tile);
+        isQueued[tile] = true;
+    };
+    auto nextPendingTile = [&]() {
+        while (!pending.empty()) {
+            int tile = pending.front();
+            pending.pop_front();
+            isQueued[tile] = false;
+            if (!isDone[tile]) return tile;
+        }
+        return -1;
+    };
+
+    // a dead worker has to show up as a failed write instead of killing the coordinator
+    void (*previousSigpipeHandler)(int) = signal(SIGPIPE, SIG_IGN);
+    std::string command = settings.workerCommand.empty() ? defaultWorkerCommand() : settings.workerCommand;
+    std::vector<WorkerProcess> &workers = getWorkers(command, size_t(std::max(settings.workerCount, 0)));
+    auto retire = [&](WorkerProcess &worker, const char *reason) {
+        LOG_WARNING(LogCategory::RayTrace, "Tile worker " << worker.pid << " " << reason << ", its tiles go to the others");
+        requeue(worker.tile);
+        stopWorker(worker);
+    };
+    auto receive = [&](WorkerProcess &worker) {
+        uint8_t buffer[65536];
+        while (true) {
+            ssize_t count = read(worker.resultFd, buffer, sizeof(buffer));
+            if (count > 0) {
+                worker.received.insert(worker.received.end(), buffer, buffer + count);
+                continue;
+            }
+            if (count < 0 && errno == EINTR) continue;
+            if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            retire(worker, "exited");
+            return;
+        }
+        std::vector<uint8_t> message;
+        while (takeMessage(worker.received, message)) {
+            TileResult result;
+            bool isValid = decodeTileResult(message, result) && result.tileId < tiles.size();
+            const PixelRect &rect = isValid ? tiles[result.tileId].rect : result.rect;
+            if (!isValid || result.rect.x != rect.x || result.rect.y != rect.y || result.rect.width != rect.width ||
+                result.rect.height != rect.height) {
+                retire(worker, "sent a broken result");
+                return;
+            }
+            if (!isDone[result.tileId]) {
+                for (int y = 0; y < rect.height; y++) {
+                    for (int x = 0; x < rect.width; x++) {
+                        window.setPixelColour(rect.x + x, rect.y + y, result.pixels[size_t(y) * rect.width + x]);
+                    }
+                }
+                isDone[result.tileId] = true;
+                doneCount++;
+            }
+            if (int(result.tileId) == worker.tile) worker.tile = -1;
+        }
+    };
+
+#if REDNOISE_LOGGING
+    auto frameStart = Clock::now();
+#endif
+    while (doneCount < tiles.size() && !isRenderCancelled()) {
+        // one tile per worker at a time, so a slow worker holds back at most one tile
+        for (WorkerProcess &worker : workers) {
+            if (!worker.isAlive || worker.tile >= 0) continue;
+            int tile = nextPendingTile();
+            if (tile < 0) break;
+            worker.tile = tile;
+            worker.started = Clock::now();
+            worker.timeouts = 0;
+            if (!writeFully(worker.requestFd, encodeTileRequest(tiles[tile]))) retire(worker, "stopped reading");
+        }
+
+        std::vector<pollfd> pollFds;
+        std::vector<WorkerProcess *> busyWorkers;
+        for (WorkerProcess &worker : workers) {
+            if (!worker.isAlive || worker.tile < 0) continue;
+            pollFds.push_back(pollfd{worker.resultFd, POLLIN, 0});
+            busyWorkers.push_back(&worker);
+        }
+        if (busyWorkers.empty()) break;   // no worker left, the rest is rendered below
+        if (poll(pollFds.data(), pollFds.size(), 100) < 0 && errno != EINTR) {
+            LOG_ERROR(LogCategory::RayTrace, "Waiting for the tile workers failed: " << strerror(errno));
+            break;
+        }
+        for (size_t i = 0; i < pollFds.size(); i++) {
+            if (pollFds[i].revents != 0 && busyWorkers[i]->isAlive) receive(*busyWorkers[i]);
+        }
+        showRenderProgress(window);
+
+        // a slow worker keeps its tile, but another worker may render it too, a worker that stays stuck is killed
+        auto now = Clock::now();
+        for (WorkerProcess &worker : workers) {
+            if (!worker.isAlive || worker.tile < 0) continue;
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - worker.started).count();
+            if (elapsed < int64_t(worker.timeouts + 1) * settings.tileTimeoutMs) continue;
+            worker.timeouts++;
+            if (worker.timeouts >= settings.timeoutsBeforeKill) {
+                retire(worker, "is stuck");
+            } else {
+                LOG_WARNING(LogCategory::RayTrace, "Tile " << worker.tile << " is slow on worker " << worker.pid
+                                                   << ", handing it out again");
+                requeue(worker.tile);
+            }
+        }
+    }
+
+    // a worker still busy with a tile (the frame was cancelled, or another worker finished its slow tile) is killed,
+    // its result would arrive in the next frame, the idle ones wait for the next frame with their scene loaded, a
+    // cancelled frame leaves the rest of the window as it was
+    for (WorkerProcess &worker : workers) {
+        if (worker.tile >= 0) stopWorker(worker);
+    }
+    signal(SIGPIPE, previousSigpipeHandler);
+    if (isRenderCancelled()) return;
+
+    size_t localTiles = 0;
+    RayTracedFrame frame;
+    for (size_t i = 0; i < tiles.size(); i++) {
+        if (isDone[i]) continue;
+        if (localTiles == 0) prepareRayTracedFrame(frame, filename, triangles, focalLength, materialFilename, signalForShading);
+        renderRayTracedTile(window, tiles[i].rect, frame);
+        localTiles++;
+    }
+    if (localTiles > 0) LOG_WARNING(LogCategory::RayTrace, "Rendered " << localTiles << " tiles without the workers");
+    LOG_INFO(LogCategory::RayTrace, "Distributed frame of " << tiles.size() << " tiles took "
+                                    << std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - frameStart).count()
+                                    << " ms");
+}
+
+#else
+
+int runTileWorker() {
+    LOG_ERROR(LogCategory::RayTrace, "Tile workers need POSIX pipes and processes");
+    return 1;
+}
+
+void renderDistributedScene(DrawingWindow &window, const std::string &filename, float focalLength,
+                            const std::string &materialFilename, int signalForShading) {
+    LOG_WARNING(LogCategory::RayTrace, "Distributed rendering needs POSIX pipes and processes, rendering locally");
+    renderRayTracedScene(window, filename, focalLength, materialFilename, signalForShading);
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef REDNOISE_DISTRIBUTEDRENDERING_H
+#define REDNOISE_DISTRIBUTEDRENDERING_H
+
+#include <string>
+#include <vector>
+#include <DrawingWindow.h>
+#include "glm/glm.hpp"
+#include "AntiAliasing.h"
+
+struct DistributedRenderSettings {
+    int workerCount = 4;
+    int tileSize = 32;
+    int tileTimeoutMs = 5000;   // a tile taking longer is also given to another worker, the first result wins
+    // a worker still busy after this many timeouts is killed and its tiles go to the others, it is started again for
+    // the next frame, the others keep running from one frame to the next
+    int timeoutsBeforeKill = 4;
+    // shell command that starts one worker, empty starts this executable with tileWorkerFlag,
+    // something like "ssh otherhost 'cd RedNoise/build && ./RedNoise --tile-worker'" puts a worker on another machine
+    std::string workerCommand;
+};
+
+extern DistributedRenderSettings distributedRenderSettings;
+
+// started with this flag the executable is a worker: tile requests on stdin, pixel blocks on stdout
+extern const char tileWorkerFlag[];
+
+// everything a worker needs for one tile, so workers keep no state between tiles and any worker can take any tile
+struct TileRequest {
+    uint32_t tileId = 0;
+    std::string objFilename;
+    std::string materialFilename;
+    float focalLength = 0.0f;
+    int32_t signalForShading = 1;
+    int32_t shadowMode = 0;
+    glm::vec3 cameraPosition{};
+    glm::mat3 cameraOrientation{};
+    int32_t frameWidth = 0, frameHeight = 0;
+    PixelRect rect;
+};
+
+struct TileResult {
+    uint32_t tileId = 0;
+    PixelRect rect;
+    std::vector<uint32_t> pixels;   // rect.width * rect.height, row by row
+};
+
+// messages are a magic number, the payload length and the payload, numbers are sent little endian so the coordinator
+// and the workers need not be the same kind of machine
+std::vector<uint8_t> encodeTileRequest(const TileRequest &request);
+bool decodeTileRequest(const std::vector<uint8_t> &message, TileRequest &request);
+std::vector<uint8_t> encodeTileResult(const TileResult &result);
+bool decodeTileResult(const std::vector<uint8_t> &message, TileResult &result);
+// moves the first complete message out of the bytes received so far, false if it has not all arrived yet
+bool takeMessage(std::vector<uint8_t> &received, std::vector<uint8_t> &message);
+
+// the worker loop, renders the tiles requested on stdin until it closes and writes the results to stdout,
+// log messages are moved to stderr, returns the process exit code
+int runTileWorker();
+
+// ray traces the scene like renderRayTracedScene, but the tiles are rendered by worker processes and composited here
+void renderDistributedScene(DrawingWindow &window, const std::string &filename, float focalLength,
+                            const std::string &materialFilename, int signalForShading);
+
+#endif //REDNOISE_DISTRIBUTEDRENDERING_H
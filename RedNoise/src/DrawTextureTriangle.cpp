@@ -1,11 +1,11 @@
 #include <algorithm>
 #include "DrawTextureTriangle.h"
+#include "Log.h"
 
 // this is the function to draw the triangle
 void drawTextureTriangle (DrawingWindow &window, CanvasTriangle triangle,Colour colour,TextureMap &textureMap) {
-    std :: cout << "drawFilledTriangle is called" << std::endl;
-    // print out the triangle
-    std :: cout << triangle << std::endl;
+    // print out the triangle, only when raster tracing is switched on
+    LOG_TRACE(LogCategory::Raster, "drawTextureTriangle is called " << triangle);
     std::sort(triangle.vertices.begin(), triangle.vertices.end(), [](const CanvasPoint &a, const CanvasPoint &b) {
         return a.y < b.y;
     });
@@ -13,8 +13,10 @@ void drawTextureTriangle (DrawingWindow &window, CanvasTriangle triangle,Colour
     CanvasPoint &middle = triangle.vertices[1];
     CanvasPoint &top = triangle.vertices[2];
     // now bottom.y <= middle.y = extra.y <= top.y
+    // the interpolated lists of this triangle are freed when it is drawn
+    ArenaScope triangleScope;
 
-    std :: vector<CanvasPoint> pointsBottomToTop = interpolateCanvasPoint(bottom, top, int(top.y) - int(bottom.y) + 1);
+    ArenaVector<CanvasPoint> pointsBottomToTop = interpolateCanvasPoint(bottom, top, int(top.y) - int(bottom.y) + 1);
 
     CanvasPoint extraPoint = pointsBottomToTop[int(middle.y) - int(bottom.y)];
 
@@ -48,16 +50,15 @@ void drawTexturePartTriangle (DrawingWindow &window, CanvasTriangle triangle, Co
     }
 
     // Peak is the top or the bottom point
-    std :: vector<CanvasPoint> pointsBetweenMiddleAndPeak;
-    std :: vector<CanvasPoint> pointsBetweenExtraAndPeak;
-
-    pointsBetweenMiddleAndPeak = interpolateCanvasPoint(from1, to1, yEnd - yStart + 1);
-    pointsBetweenExtraAndPeak = interpolateCanvasPoint(from2, to2, yEnd - yStart + 1);
+    ArenaScope edgeScope;
+    ArenaVector<CanvasPoint> pointsBetweenMiddleAndPeak = interpolateCanvasPoint(from1, to1, yEnd - yStart + 1);
+    ArenaVector<CanvasPoint> pointsBetweenExtraAndPeak = interpolateCanvasPoint(from2, to2, yEnd - yStart + 1);
 
 
     //Always Draw the horizontal line from the bottomY to the middle
     // also from the Horizontal line from the points between middle and peak to the points between extra and peak
     for (int i = yStart; i < yEnd; i++) {
+        ArenaScope scanlineScope;
         int y = i;
         if (pointsBetweenMiddleAndPeak[i - yStart].x > pointsBetweenExtraAndPeak[i - yStart].x) {
             std :: swap(pointsBetweenMiddleAndPeak[i - yStart], pointsBetweenExtraAndPeak[i - yStart]);
@@ -70,7 +71,7 @@ void drawTexturePartTriangle (DrawingWindow &window, CanvasTriangle triangle, Co
 //        int x_end = pointsBetweenExtraAndPeak[i - yStart].x+1;
 
         // Interpolate the depth and texture coordinates of each point horizontally
-        std :: vector<CanvasPoint> XlineCanvasPoint = interpolateCanvasPoint(pointsBetweenMiddleAndPeak[i - yStart],
+        ArenaVector<CanvasPoint> XlineCanvasPoint = interpolateCanvasPoint(pointsBetweenMiddleAndPeak[i - yStart],
                                                                              pointsBetweenExtraAndPeak[i - yStart],
                                                                              x_end - x_start + 1);
 
@@ -123,9 +124,10 @@ void drawTextureTriangle(DrawingWindow &window, CanvasTriangle triangle,TextureM
         std::swap(middle, top);
     }
 
-    std::vector<float> xValuesBottomToTop = interpolateSingleFloats(bottom.x, top.x, top.y - bottom.y + 1);
-    std::vector<float> xValuesBottomToMiddle = interpolateSingleFloats(bottom.x, middle.x, middle.y - bottom.y + 1);
-    std::vector<float> xValuesMiddleToTop = interpolateSingleFloats(middle.x, top.x, top.y - middle.y + 1);
+    ArenaScope triangleScope;
+    ArenaVector<float> xValuesBottomToTop = interpolateSingleFloats(bottom.x, top.x, top.y - bottom.y + 1);
+    ArenaVector<float> xValuesBottomToMiddle = interpolateSingleFloats(bottom.x, middle.x, middle.y - bottom.y + 1);
+    ArenaVector<float> xValuesMiddleToTop = interpolateSingleFloats(middle.x, top.x, top.y - middle.y + 1);
 
     std::vector<TexturePoint> texCoordsBottomToTop = interpolateTexturePoints(bottom.texturePoint, top.texturePoint, top.y - bottom.y + 1);
     std::vector<TexturePoint> texCoordsBottomToMiddle = interpolateTexturePoints(bottom.texturePoint, middle.texturePoint, middle.y - bottom.y + 1);
@@ -0,0 +1,160 @@
+#include "DynamicResolution.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <memory>
+#include "Globals.h"
+#include "Log.h"
+#include "Parallel.h"
+#include "RenderJob.h"
+
+DynamicResolutionSettings dynamicResolutionSettings;
+
+namespace {
+    // 320x240 divided into 80 steps is 4x3 pixels a step, every scale keeps the window's shape exactly
+    const int scaleSteps = 80;
+    std::atomic<int> currentScaleStep{scaleSteps};
+    // the milliseconds a frame takes at full resolution, estimated from the previews so far, 0 before the first
+    float fullFrameMilliseconds = 0.0f;
+
+    int toScaleStep(float scale) {
+        return int(std::floor(scale * scaleSteps + 0.5f));
+    }
+
+    // a frame at scaleStep took milliseconds to show, rendering time is taken to grow with the number of pixels
+    void updateScale(int scaleStep, float milliseconds, bool isCancelled) {
+        float scale = float(scaleStep) / scaleSteps;
+        float measured = milliseconds / (scale * scale);
+        // a cancelled preview only says the frame takes at least this long
+        if (isCancelled) {
+            if (milliseconds < dynamicResolutionSettings.targetFrameMilliseconds) return;
+            measured = std::max(measured, fullFrameMilliseconds);
+        }
+        // half of every new measurement, so one slow frame does not halve the resolution
+        fullFrameMilliseconds = fullFrameMilliseconds > 0.0f ? 0.5f * (fullFrameMilliseconds + measured) : measured;
+        float wanted = std::sqrt(dynamicResolutionSettings.targetFrameMilliseconds / fullFrameMilliseconds);
+        int minStep = std::max(1, toScaleStep(dynamicResolutionSettings.minScale));
+        int maxStep = std::max(minStep, std::min(scaleSteps, toScaleStep(dynamicResolutionSettings.maxScale)));
+        int wantedStep = std::min(std::max(toScaleStep(wanted), minStep), maxStep);
+        // a step either way is noise, it would only make the preview flicker between two sizes
+        if (std::abs(wantedStep - scaleStep) > 1 || wantedStep == minStep || wantedStep == maxStep) {
+            currentScaleStep = wantedStep;
+        }
+    }
+
+    // one window per size for the previews and the full frames drawn out of sight, only the render job thread draws
+    // into them
+    DrawingWindow &getOffscreenWindow(size_t width, size_t height) {
+        static std::map<std::pair<size_t, size_t>, std::unique_ptr<DrawingWindow>> cache;
+        std::unique_ptr<DrawingWindow> &preview = cache[std::make_pair(width, height)];
+        if (!preview) preview.reset(new DrawingWindow(int(width), int(height)));
+        return *preview;
+    }
+
+    glm::vec3 unpackColour(uint32_t colour) {
+        return glm::vec3(float((colour >> 16) & 0xFF), float((colour >> 8) & 0xFF), float(colour & 0xFF));
+    }
+
+    uint32_t packColour(const glm::vec3 &colour) {
+        glm::vec3 clamped = glm::clamp(colour + 0.5f, 0.0f, 255.0f);
+        return (255u << 24) + (uint32_t(clamped.r) << 16) + (uint32_t(clamped.g) << 8) + uint32_t(clamped.b);
+    }
+}
+
+float currentResolutionScale() {
+    return float(currentScaleStep.load()) / scaleSteps;
+}
+
+void upscaleImage(DrawingWindow &target, DrawingWindow &source, UpscaleFilter filter, float edgeSigma) {
+    int sourceWidth = int(source.width), sourceHeight = int(source.height);
+    int targetWidth = int(target.width);
+    const uint32_t *sourcePixels = source.getPixelBuffer();
+    uint32_t *targetPixels = target.getPixelBuffer();
+    float xRatio = float(sourceWidth) / float(target.width);
+    float yRatio = float(sourceHeight) / float(target.height);
+    float edgeScale = 1.0f / (edgeSigma * edgeSigma);
+    parallelFor(target.height, [&](size_t begin, size_t end) {
+        for (int y = int(begin); y < int(end); y++) {
+            // the source position of the target pixel centre, between the centres of the source pixels around it
+            float sourceY = (float(y) + 0.5f) * yRatio - 0.5f;
+            int y0 = std::min(std::max(int(std::floor(sourceY)), 0), sourceHeight - 1);
+            int y1 = std::min(y0 + 1, sourceHeight - 1);
+            float fy = glm::clamp(sourceY - float(y0), 0.0f, 1.0f);
+            for (int x = 0; x < targetWidth; x++) {
+                float sourceX = (float(x) + 0.5f) * xRatio - 0.5f;
+                int x0 = std::min(std::max(int(std::floor(sourceX)), 0), sourceWidth - 1);
+                int x1 = std::min(x0 + 1, sourceWidth - 1);
+                float fx = glm::clamp(sourceX - float(x0), 0.0f, 1.0f);
+                int tapX[4] = {x0, x1, x0, x1};
+                int tapY[4] = {y0, y0, y1, y1};
+                float tapWeight[4] = {(1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy};
+                glm::vec3 tapColour[4];
+                for (int i = 0; i < 4; i++) tapColour[i] = unpackColour(sourcePixels[tapY[i] * sourceWidth + tapX[i]]);
+                if (filter == UpscaleFilter::EdgeAware) {
+                    // the tap nearest the pixel centre decides which side of an edge the pixel is on
+                    int nearest = (fx < 0.5f ? 0 : 1) + (fy < 0.5f ? 0 : 2);
+                    for (int i = 0; i < 4; i++) {
+                        glm::vec3 difference = tapColour[i] - tapColour[nearest];
+                        tapWeight[i] *= std::exp(-glm::dot(difference, difference) * edgeScale);
+                    }
+                }
+                glm::vec3 sum(0.0f);
+                float weightSum = 0.0f;
+                for (int i = 0; i < 4; i++) {
+                    sum += tapWeight[i] * tapColour[i];
+                    weightSum += tapWeight[i];
+                }
+                targetPixels[size_t(y) * targetWidth + x] = packColour(sum / weightSum);
+            }
+        }
+    });
+}
+
+void renderAtDynamicResolution(DrawingWindow &window, const std::function<void(DrawingWindow &)> &render) {
+    int scaleStep = currentScaleStep;
+    // what the scale is set by is the wait for the frame, rendering, upscaling and handing it to the window
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&start]() {
+        return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    if (!dynamicResolutionSettings.enabled || scaleStep >= scaleSteps) {
+        render(window);
+        if (dynamicResolutionSettings.enabled) {
+            showRenderFrame(window);
+            updateScale(scaleStep, elapsed(), isRenderCancelled());
+        }
+        return;
+    }
+
+    // the renderers that orbit the camera move it every call, the full resolution frame starts where the preview did
+    glm::vec3 startPosition = cameraPosition;
+    glm::mat3 startOrientation = cameraOrientation;
+
+    DrawingWindow &preview = getOffscreenWindow(window.width * scaleStep / scaleSteps, window.height * scaleStep / scaleSteps);
+    render(preview);
+    if (isRenderCancelled()) {
+        updateScale(scaleStep, elapsed(), true);
+        return;
+    }
+    upscaleImage(window, preview, dynamicResolutionSettings.filter, dynamicResolutionSettings.edgeSigma);
+    showRenderFrame(window);
+    float milliseconds = elapsed();
+    updateScale(scaleStep, milliseconds, false);
+    LOG_DEBUG(LogCategory::App, "Preview at " << preview.width << "x" << preview.height << " shown after " << milliseconds
+                                              << " ms, next at " << currentResolutionScale() * 100.0f << "%");
+
+    // while a camera key is held every step cancels the job before this runs out, so the full frame is only rendered
+    // once the camera is idle, and out of sight, the preview stays up until the whole frame replaces it
+    if (!dynamicResolutionSettings.refineAtFullResolution ||
+        !waitUnlessCancelled(dynamicResolutionSettings.refineDelayMilliseconds)) {
+        return;
+    }
+    cameraPosition = startPosition;
+    cameraOrientation = startOrientation;
+    DrawingWindow &full = getOffscreenWindow(window.width, window.height);
+    render(full);
+    if (isRenderCancelled()) return;
+    std::copy(full.getPixelBuffer(), full.getPixelBuffer() + window.width * window.height, window.getPixelBuffer());
+}
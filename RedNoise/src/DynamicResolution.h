@@ -0,0 +1,37 @@
+#ifndef REDNOISE_DYNAMICRESOLUTION_H
+#define REDNOISE_DYNAMICRESOLUTION_H
+
+#include <functional>
+#include <DrawingWindow.h>
+
+enum class UpscaleFilter { Bilinear, EdgeAware };
+
+struct DynamicResolutionSettings {
+    bool enabled = true;
+    float targetFrameMilliseconds = 50.0f;   // from a camera move to its preview showing
+    float minScale = 0.25f;                  // of the window width and height, the preview never gets smaller
+    float maxScale = 1.0f;
+    UpscaleFilter filter = UpscaleFilter::EdgeAware;
+    float edgeSigma = 24.0f;                 // colour distance (0-255 per channel) where an edge starts to cut a tap off
+    bool refineAtFullResolution = true;      // the full image replaces the preview once the camera stays put
+    int refineDelayMilliseconds = 300;       // how long it has to stay put, longer than the key repeat
+};
+
+extern DynamicResolutionSettings dynamicResolutionSettings;
+
+// the fraction of the window width and height the previews render at, a multiple of 1/80 so 320x240 stays whole
+float currentResolutionScale();
+
+// stretches source over the whole of target, edge aware is bilinear with the taps that differ in colour from the
+// nearest source pixel weighted down, so silhouettes stay sharp instead of smearing over a few pixels
+void upscaleImage(DrawingWindow &target, DrawingWindow &source, UpscaleFilter filter, float edgeSigma);
+
+// render draws a frame into the window it is given, from the camera of the calling thread
+// the frame is first rendered at currentResolutionScale into a smaller window, upscaled into window and shown, the time
+// until it showed sets the scale of the next frame so previews stay near targetFrameMilliseconds, then, when no key
+// cancelled the job within refineDelayMilliseconds, it is rendered again at full resolution from the same camera out
+// of sight and replaces the preview once it is whole
+// works for every renderer that sizes its image by the window it draws into, ray traced or rasterised
+void renderAtDynamicResolution(DrawingWindow &window, const std::function<void(DrawingWindow &)> &render);
+
+#endif //REDNOISE_DYNAMICRESOLUTION_H
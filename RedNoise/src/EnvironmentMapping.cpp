@@ -1,4 +1,7 @@
 #include "EnvironmentMapping.h"
+#include "Log.h"
+#include "CameraRays.h"
+#include "RenderJob.h"
 
 
 // according to the reflection vector, sample the colour from the environment map
@@ -77,16 +80,19 @@ void renderRayTracedSceneForEnv(DrawingWindow &window, const std::string& filena
     // Load the triangles from the OBJ file.
     std::vector<ModelTriangle> triangles = loadOBJ(filename, 0.5,materialFilename);
 
-    std::cout << "Loaded " << triangles.size() << " triangles for ray tracing" << std::endl;
+    LOG_INFO(LogCategory::RayTrace, "Loaded " << triangles.size() << " triangles for ray tracing");
 
     glm::vec3 ModelCenter = calculateModelCenter(triangles);
     cameraOrientation = lookAt(ModelCenter);
 
     // Loop over each pixel on the image plane
+    const CameraRayTable &rays = getCameraRayTable(window.width, window.height, focalLength, cameraOrientation);
     for (int y = 0; y < int(window.height); y++) {
+        if (isRenderCancelled()) return;
+        showRenderProgress(window);
         for (int x = 0; x < int(window.width); x++) {
             // Compute the ray direction for this pixel
-            glm::vec3 rayDirection = computeRayDirection(window.width, window.height, x, y, focalLength,cameraOrientation);
+            glm::vec3 rayDirection = rays.direction(float(x), float(y));
 
             // Find the closest intersection of this ray with the scene
             RayTriangleIntersection intersection = getClosestIntersection(cameraPosition, rayDirection, triangles);
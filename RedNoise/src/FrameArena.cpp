@@ -0,0 +1,46 @@
+#include "FrameArena.h"
+#include <algorithm>
+
+void FrameArena::addBlock(size_t minimumSize) {
+    size_t size = std::max(minimumSize, blockSizes.empty() ? firstBlockSize : 2 * blockSizes.back());
+    blocks.emplace_back(new char[size]);
+    blockSizes.push_back(size);
+    blockAllocations++;
+}
+
+void *FrameArena::allocate(size_t bytes, size_t alignment) {
+    if (blocks.empty()) addBlock(bytes + alignment);
+    while (true) {
+        uintptr_t start = reinterpret_cast<uintptr_t>(blocks[current].get()) + offset;
+        size_t padding = (alignment - start % alignment) % alignment;
+        if (offset + padding + bytes <= blockSizes[current]) {
+            offset += padding + bytes;
+            peak = std::max(peak, usedBefore + offset);
+            return reinterpret_cast<void *>(start + padding);
+        }
+        // the rest of this block is left unused, the next one that is big enough takes the allocation
+        usedBefore += blockSizes[current];
+        current++;
+        offset = 0;
+        if (current == blocks.size()) addBlock(bytes + alignment);
+    }
+}
+
+void FrameArena::rewind(const Mark &mark) {
+    current = mark.block;
+    offset = mark.offset;
+    usedBefore = 0;
+    for (size_t i = 0; i < current; i++) usedBefore += blockSizes[i];
+    if (current == 0 && offset == 0 && blocks.size() > 1) {
+        size_t total = 0;
+        for (size_t size : blockSizes) total += size;
+        blocks.clear();
+        blockSizes.clear();
+        addBlock(total);
+    }
+}
+
+FrameArena &frameArena() {
+    thread_local FrameArena arena;
+    return arena;
+}
@@ -0,0 +1,84 @@
+#ifndef REDNOISE_FRAMEARENA_H
+#define REDNOISE_FRAMEARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// a bump allocator, allocating moves a pointer and everything allocated after a mark is freed at once by rewinding to
+// it, the memory stays with the arena so a thread that does the same work every frame stops asking the heap for more
+// after the first one
+class FrameArena {
+public:
+    struct Mark {
+        size_t block = 0;
+        size_t offset = 0;
+    };
+
+    void *allocate(size_t bytes, size_t alignment);
+    Mark mark() const { return Mark{current, offset}; }
+    // frees everything allocated since the mark, rewinding to the very start also joins the blocks into one the size
+    // of them all, so the next frame fits in a single block
+    void rewind(const Mark &mark);
+
+    // blocks taken from the heap so far and the most bytes in use at once
+    uint64_t heapAllocations() const { return blockAllocations; }
+    size_t peakBytes() const { return peak; }
+
+private:
+    static const size_t firstBlockSize = size_t(64) << 10;
+
+    void addBlock(size_t minimumSize);
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<size_t> blockSizes;
+    size_t current = 0;     // the block being allocated from
+    size_t offset = 0;      // into that block
+    size_t usedBefore = 0;  // the bytes of the blocks before it, for the peak
+    size_t peak = 0;
+    uint64_t blockAllocations = 0;
+};
+
+// the arena of the calling thread, the render job thread keeps it from one frame to the next
+FrameArena &frameArena();
+
+// everything allocated from the arena while it is alive is freed when it ends, nothing from the arena may be used
+// after that
+class ArenaScope {
+public:
+    explicit ArenaScope(FrameArena &arena = frameArena()) : arena(arena), start(arena.mark()) {}
+    ~ArenaScope() { arena.rewind(start); }
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+
+private:
+    FrameArena &arena;
+    FrameArena::Mark start;
+};
+
+// a standard allocator over the thread's arena, deallocate does nothing, the memory comes back with the ArenaScope
+template <typename T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    FrameArena *arena;
+
+    ArenaAllocator() : arena(&frameArena()) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t count) { return static_cast<T *>(arena->allocate(count * sizeof(T), alignof(T))); }
+    void deallocate(T *, size_t) {}
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena == b.arena; }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena != b.arena; }
+
+// for the short lived lists of the rasteriser, only valid inside the ArenaScope they were made in
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif //REDNOISE_FRAMEARENA_H
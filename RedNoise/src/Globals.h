@@ -5,8 +5,10 @@
 #include <vector>
 #include <map>
 extern std::vector<std::vector<float>> zBuffer;
-extern glm::vec3 cameraPosition;
-extern glm::mat3 cameraOrientation;
+// every thread has its own camera, so the frames of an animation can render side by side, the threads parallelFor
+// starts do not see the caller's camera and get it passed in
+extern thread_local glm::vec3 cameraPosition;
+extern thread_local glm::mat3 cameraOrientation;
 extern float cameraSpeed;
 extern float cameraRotationSpeed;
 extern int shininess;
@@ -17,7 +19,6 @@ struct Vec3Comparator {
     }
 };
 extern std::map<glm::vec3, glm::vec3, Vec3Comparator> vertexNormals;
-extern std::map<glm::vec3, float,Vec3Comparator> vertexBrightnessGlobal;
 
 
 #endif //GLOBALS_H
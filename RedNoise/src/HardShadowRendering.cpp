@@ -1,4 +1,5 @@
 #include "HardShadowRendering.h"
+#include "Log.h"
 
 // calculate diffuse lighting
 float calculateLighting(const glm::vec3 &point, const glm::vec3 &normal, const glm::vec3 &lightSource) {
@@ -16,30 +17,6 @@ float calculateLighting(const glm::vec3 &point, const glm::vec3 &normal, const g
     return glm::clamp(combinedBrightness, 0.0f, 1.0f);
 }
 
-glm::vec3 calculateBarycentricCoordinates(const glm::vec3 &P, const std::array<glm::vec3, 3> &triangleVertices) {
-    glm::vec3 A = triangleVertices[0];
-    glm::vec3 B = triangleVertices[1];
-    glm::vec3 C = triangleVertices[2];
-
-    glm::vec3 AB = B - A;
-    glm::vec3 AC = C - A;
-    glm::vec3 BC = C - B;
-    glm::vec3 AP = P - A;
-    glm::vec3 BP = P - B;
-
-    // according to the formula: area = 1/2 * |AB x AC x sin(theta)|
-    float areaABC = glm::length(glm::cross(AB, AC));
-    float areaPBC = glm::length(glm::cross(BP, BC));
-    float areaPCA = glm::length(glm::cross(AP, AC));
-    float areaPAB = glm::length(glm::cross(AP, AB));
-
-    float u = areaPBC / areaABC;
-    float v = areaPCA / areaABC;
-    float w = areaPAB / areaABC;
-
-    return glm::vec3(u, v, w);
-}
-
 RayTriangleIntersection getClosestIntersection(const glm::vec3 &cameraPosition,
                                                const glm::vec3 &rayDirection, const std::vector<ModelTriangle> &triangles) {
     RayTriangleIntersection closestIntersection;
@@ -49,21 +26,14 @@ RayTriangleIntersection getClosestIntersection(const glm::vec3 &cameraPosition,
     // go through all the triangles and find the closest intersection
     for (size_t i = 0; i < triangles.size(); i++) {
         const ModelTriangle &triangle = triangles[i];
-
-        glm::vec3 e0 = triangle.vertices[1] - triangle.vertices[0];
-        glm::vec3 e1 = triangle.vertices[2] - triangle.vertices[0];
-        glm::vec3 SPVector = cameraPosition - triangle.vertices[0];
-        glm::mat3 DEMatrix(-rayDirection, e0, e1);
-        glm::vec3 possibleSolution = glm::inverse(DEMatrix) * SPVector;
-
-        float t = possibleSolution.x, u = possibleSolution.y, v = possibleSolution.z;
+        float t, u, v;
 
         // check if the intersection is in front of the camera, and if it is the closest intersection so far
-        if (t > 0 && u >= 0 && u <= 1 && v >= 0 && v <= 1 && u + v <= 1) {
+        if (intersectRayTriangle(cameraPosition, rayDirection, triangle.vertices, t, u, v)) {
             if (t < closestDistance) {
                 closestDistance = t;
                 glm::vec3 intersectionPoint = cameraPosition + t * rayDirection;
-                closestIntersection = RayTriangleIntersection(intersectionPoint, t, triangle, i);
+                closestIntersection = RayTriangleIntersection(intersectionPoint, t, triangle, i, u, v);
             }
         }
     }
@@ -72,10 +42,39 @@ RayTriangleIntersection getClosestIntersection(const glm::vec3 &cameraPosition,
     return closestIntersection;
 }
 
+// the same loop over the position stream only, the shading data is read once for the triangle that was hit
+RayTriangleIntersection getClosestIntersection(const glm::vec3 &cameraPosition,
+                                               const glm::vec3 &rayDirection, const SceneTriangles &triangles) {
+    float closestDistance = std::numeric_limits<float>::infinity();
+    size_t closestIndex = 0;
+    float closestU = 0.0f, closestV = 0.0f;
+    for (size_t i = 0; i < triangles.size(); i++) {
+        float t, u, v;
+        if (intersectRayTriangle(cameraPosition, rayDirection, triangles.positions[i].vertices, t, u, v) &&
+            t < closestDistance) {
+            closestDistance = t;
+            closestIndex = i;
+            closestU = u;
+            closestV = v;
+        }
+    }
+
+    RayTriangleIntersection closestIntersection;
+    closestIntersection.distanceFromCamera = std::numeric_limits<float>::infinity();
+    if (closestDistance == std::numeric_limits<float>::infinity()) return closestIntersection;
+    return RayTriangleIntersection(cameraPosition + closestDistance * rayDirection, closestDistance,
+                                   triangles[closestIndex].toModelTriangle(), closestIndex, closestU, closestV);
+}
+
 glm::vec3 computeRayDirection(int screenWidth, int screenHeight, int x, int y, float focalLength, glm::mat3 cameraOrientation) {
+    return computeRayDirection(screenWidth, screenHeight, float(x), float(y), focalLength, cameraOrientation);
+}
+
+// x and y can be anywhere inside the pixel, whole numbers are the pixel centres the single sample modes use
+glm::vec3 computeRayDirection(int screenWidth, int screenHeight, float x, float y, float focalLength, glm::mat3 cameraOrientation) {
     // the camera initially at (0, 0, 4), and the image plane is at z = 2
 
-    float scale = 150.0f; // Adjust this factor to zoom in or out
+    float scale = imagePlaneScale(screenWidth); // Adjust this factor to zoom in or out
 
     float canvasX = (x - screenWidth / 2) / scale;
     float canvasY = -(screenHeight / 2 - y) / scale;
@@ -101,73 +100,95 @@ float calculateSpecularLighting(const glm::vec3 &point,const glm::vec3 &cameraPo
     return spec;
 }
 
-float FlatShading(RayTriangleIntersection intersection, RayTriangleIntersection shadowIntersection,
-                  const glm::vec3 &sourceLight, float ambientLight) {
-    float brightness = calculateLighting(intersection.intersectionPoint,
-                                         intersection.intersectedTriangle.normal, sourceLight);
-    float specularIntensity = calculateSpecularLighting(intersection.intersectionPoint, cameraPosition,
-                                                        sourceLight, intersection.intersectedTriangle.normal, shininess);
-
-    if (shadowIntersection.distanceFromCamera < glm::length(sourceLight - intersection.intersectionPoint)&&
-    shadowIntersection.triangleIndex != intersection.triangleIndex) {
-        // if the intersection is in shadow, only use the ambient light
-        brightness = ambientLight;
-    } else {
-        // if the intersection is not in shadow, combine the brightness with the ambient light
-        brightness = glm::max(brightness + ambientLight, ambientLight);
+// the light is blocked if the shadow ray hits another triangle before it reaches the light
+bool isInShadow(const RayTriangleIntersection &intersection, const RayTriangleIntersection &shadowIntersection,
+                const glm::vec3 &point, const glm::vec3 &sourceLight) {
+    return shadowIntersection.distanceFromCamera < glm::length(sourceLight - point) &&
+           shadowIntersection.triangleIndex != intersection.triangleIndex;
+}
+
+// how much of the point light reaches the intersection, 1 is fully lit and 0 is fully in shadow
+// shadow rays only give 0 or 1, the filtered shadow map lookup can give anything in between
+float calculateLightVisibility(const RayTriangleIntersection &intersection, const SceneTriangles &triangles,
+                               const glm::vec3 &sourceLight) {
+    if (shadowMode == ShadowMode::CubeShadowMap && activeShadowMap != nullptr && activeShadowMap->lightPosition == sourceLight) {
+        return sampleCubeShadowMap(*activeShadowMap, intersection.intersectionPoint,
+                                   intersection.intersectedTriangle.normal, shadowMapSettings);
     }
+    return traceLightVisibility(intersection, triangles, sourceLight);
+}
 
-    // combine the brightness with the specular intensity
-    float combinedBrightness = glm::clamp(brightness + specularIntensity, 0.0f, 1.0f);
-    return combinedBrightness;
+// the shadow ray part of calculateLightVisibility, always 0 or 1
+float traceLightVisibility(const RayTriangleIntersection &intersection, const SceneTriangles &triangles,
+                           const glm::vec3 &sourceLight) {
+    glm::vec3 shadowRay = glm::normalize(sourceLight - intersection.intersectionPoint);
+    RayTriangleIntersection shadowIntersection = getClosestIntersection(intersection.intersectionPoint + shadowRay * 0.001f,
+                                                                        shadowRay, triangles);
+    return isInShadow(intersection, shadowIntersection, intersection.intersectionPoint, sourceLight) ? 0.0f : 1.0f;
 }
 
-float GouraudShading(RayTriangleIntersection intersection, RayTriangleIntersection shadowIntersection,
-                     const glm::vec3 &sourceLight, float ambientLight){
-    // calculate the brightness for each vertex
-    for (int i = 0; i < 3; i++) {
-        glm::vec3 vertex = intersection.intersectedTriangle.vertices[i];
-        // if we already calculated the brightness for this vertex, skip it
-        if (vertexBrightnessGlobal.find(vertex) != vertexBrightnessGlobal.end()){
-            continue;
-        }
+// the visibility of every selected light
+std::array<float, maxSelectedLights> calculateLightVisibility(const RayTriangleIntersection &intersection,
+                                                             const SceneTriangles &triangles,
+                                                             const LightSelection &lights) {
+    std::array<float, maxSelectedLights> visibility{};
+    for (int i = 0; i < lights.count; i++) {
+        visibility[i] = calculateLightVisibility(intersection, triangles, lights.positions[i]);
+    }
+    return visibility;
+}
 
-        glm::vec3 normal = vertexNormals[vertex];
-        // calculate the diffuse lighting and specular lighting
-        float brightness = calculateLighting(vertex, normal, sourceLight);
-        float specularIntensity = calculateSpecularLighting(vertex, cameraPosition, sourceLight, normal, shininess);
+float FlatShading(RayTriangleIntersection intersection, const LightSelection &lights,
+                  const std::array<float, maxSelectedLights> &lightVisibility, float ambientLight) {
+    float brightness = ambientLight;
+    for (int i = 0; i < lights.count; i++) {
+        float diffuse = calculateLighting(intersection.intersectionPoint,
+                                          intersection.intersectedTriangle.normal, lights.positions[i]);
+        float specularIntensity = calculateSpecularLighting(intersection.intersectionPoint, cameraPosition,
+                                                            lights.positions[i], intersection.intersectedTriangle.normal, shininess);
+        // if the intersection is in shadow, only the specular highlight of this light is left
+        // if the intersection is not in shadow, combine the diffuse light with the ambient light
+        brightness += lights.weights[i] * lightVisibility[i] * diffuse;
+        brightness += lights.weights[i] * specularIntensity;
+    }
+    return glm::clamp(brightness, 0.0f, 1.0f);
+}
 
-        if (shadowIntersection.distanceFromCamera < glm::length(sourceLight - vertex)&& shadowIntersection.triangleIndex != intersection.triangleIndex) {
-            brightness = ambientLight;
-        } else {
-            // if the intersection is not in shadow, combine the brightness with the ambient light
-            brightness = glm::max(brightness + ambientLight, ambientLight);
-        }
+float FlatShading(RayTriangleIntersection intersection, float lightVisibility,
+                  const glm::vec3 &sourceLight, float ambientLight) {
+    std::array<float, maxSelectedLights> visibility{};
+    visibility[0] = lightVisibility;
+    return FlatShading(intersection, makeSingleLightSelection(sourceLight), visibility, ambientLight);
+}
 
-        // combine the brightness with the specular intensity
-        float combinedBrightness = glm::clamp(brightness + specularIntensity, 0.0f, 1.0f);
+float FlatShading(RayTriangleIntersection intersection, RayTriangleIntersection shadowIntersection,
+                  const glm::vec3 &sourceLight, float ambientLight) {
+    bool inShadow = isInShadow(intersection, shadowIntersection, intersection.intersectionPoint, sourceLight);
+    return FlatShading(intersection, inShadow ? 0.0f : 1.0f, sourceLight, ambientLight);
+}
 
-        vertexBrightnessGlobal[vertex] = combinedBrightness;
-    }
-    // get the barycentric coordinates of the intersection point
-    glm::vec3 barycentricCoords = calculateBarycentricCoordinates(intersection.intersectionPoint, intersection.intersectedTriangle.vertices);
+// the vertices were lit by the bake, so gouraud shading is only the interpolation between them
+float GouraudShading(RayTriangleIntersection intersection, const VertexLighting &vertexLighting){
+    const std::array<uint32_t, 3> &vertexIndices = intersection.intersectedTriangle.vertexIndices;
+    // the intersector already solved for the barycentric coordinates of the intersection point
+    glm::vec3 barycentricCoords = intersection.barycentricWeights();
 
-    // interpolate the normal
+    // interpolate the brightness
     float ResultVertexBrightness =
-            barycentricCoords.x * vertexBrightnessGlobal[intersection.intersectedTriangle.vertices[0]] +
-            barycentricCoords.y * vertexBrightnessGlobal[intersection.intersectedTriangle.vertices[1]] +
-            barycentricCoords.z * vertexBrightnessGlobal[intersection.intersectedTriangle.vertices[2]];
+            barycentricCoords.x * vertexLighting.brightness[vertexIndices[0]] +
+            barycentricCoords.y * vertexLighting.brightness[vertexIndices[1]] +
+            barycentricCoords.z * vertexLighting.brightness[vertexIndices[2]];
     return ResultVertexBrightness;
 }
 
-float phongShading(RayTriangleIntersection intersection, RayTriangleIntersection shadowIntersection,
-                   const glm::vec3 &sourceLight, float ambientLight) {
+float phongShading(RayTriangleIntersection intersection, const LightSelection &lights,
+                   const std::array<float, maxSelectedLights> &lightVisibility, float ambientLight) {
     // I have already cached the vertex normals in the loadOBJ function
     glm::vec3 normal0  = vertexNormals[intersection.intersectedTriangle.vertices[0]];
     glm::vec3 normal1  = vertexNormals[intersection.intersectedTriangle.vertices[1]];
     glm::vec3 normal2  = vertexNormals[intersection.intersectedTriangle.vertices[2]];
-    // get the barycentric coordinates of the intersection point
-    glm::vec3 barycentricCoords = calculateBarycentricCoordinates(intersection.intersectionPoint, intersection.intersectedTriangle.vertices);
+    // the intersector already solved for the barycentric coordinates of the intersection point
+    glm::vec3 barycentricCoords = intersection.barycentricWeights();
 
     // interpolate the normal
     glm::vec3 interpolatedNormal =
@@ -177,43 +198,71 @@ float phongShading(RayTriangleIntersection intersection, RayTriangleIntersection
 
     interpolatedNormal = glm::normalize(interpolatedNormal);
 
-    // phong shading, calculate the diffuse lighting and specular lighting by passing in the interpolated normal
-    float brightness = calculateLighting(intersection.intersectionPoint, interpolatedNormal, sourceLight);
-    float specularIntensity = calculateSpecularLighting(intersection.intersectionPoint, cameraPosition, sourceLight,
-                                                        interpolatedNormal, shininess);
-
-    if (shadowIntersection.distanceFromCamera < glm::length(sourceLight - intersection.intersectionPoint)&& shadowIntersection.triangleIndex != intersection.triangleIndex) {
-        brightness = ambientLight;
-    } else {
-        // if the intersection is not in shadow, combine the brightness with the ambient light
-        brightness = glm::max(brightness + ambientLight, ambientLight);
+    float brightness = ambientLight;
+    for (int i = 0; i < lights.count; i++) {
+        // phong shading, calculate the diffuse lighting and specular lighting by passing in the interpolated normal
+        float diffuse = calculateLighting(intersection.intersectionPoint, interpolatedNormal, lights.positions[i]);
+        float specularIntensity = calculateSpecularLighting(intersection.intersectionPoint, cameraPosition, lights.positions[i],
+                                                            interpolatedNormal, shininess);
+        // in shadow only the ambient light and the highlight are left
+        brightness += lights.weights[i] * lightVisibility[i] * diffuse;
+        brightness += lights.weights[i] * specularIntensity;
     }
+    return glm::clamp(brightness, 0.0f, 1.0f);
+}
+
+float phongShading(RayTriangleIntersection intersection, float lightVisibility,
+                   const glm::vec3 &sourceLight, float ambientLight) {
+    std::array<float, maxSelectedLights> visibility{};
+    visibility[0] = lightVisibility;
+    return phongShading(intersection, makeSingleLightSelection(sourceLight), visibility, ambientLight);
+}
+
+float phongShading(RayTriangleIntersection intersection, RayTriangleIntersection shadowIntersection,
+                   const glm::vec3 &sourceLight, float ambientLight) {
+    bool inShadow = isInShadow(intersection, shadowIntersection, intersection.intersectionPoint, sourceLight);
+    return phongShading(intersection, inShadow ? 0.0f : 1.0f, sourceLight, ambientLight);
+}
 
-    // combine the brightness with the specular intensity
-    float combinedBrightness = glm::clamp(brightness + specularIntensity, 0.0f, 1.0f);
-    return combinedBrightness;
+// the flat shading of a point the reflected and refracted rays hit, with the shadows of the selected lights
+float shadeSecondaryHit(const RayTriangleIntersection &intersection, const SceneTriangles &triangles,
+                        const SceneLights &lights, float ambientLight) {
+    LightSelection selectedLights;
+    selectLights(lights, intersection.intersectionPoint, intersection.intersectedTriangle.normal, selectedLights);
+    std::array<float, maxSelectedLights> lightVisibility = calculateLightVisibility(intersection, triangles, selectedLights);
+    return FlatShading(intersection, selectedLights, lightVisibility, ambientLight);
+}
+
+Colour mixReflection(const Colour &reflected, const Material &mirror, float brightness) {
+    float surface = (1.0f - mirror.reflectivity) * brightness;
+    return Colour(int(mirror.reflectivity * reflected.red + surface * mirror.colour.red),
+                  int(mirror.reflectivity * reflected.green + surface * mirror.colour.green),
+                  int(mirror.reflectivity * reflected.blue + surface * mirror.colour.blue));
 }
 
 // This function is to return the color of the reflected ray
-Colour traceReflectiveRay(const glm::vec3 &rayOrigin, const glm::vec3 &rayDirection, const std::vector<ModelTriangle> &triangles,
-                          int depth, const glm::vec3 &sourceLight, float ambientLight) {
+Colour traceReflectiveRay(const glm::vec3 &rayOrigin, const glm::vec3 &rayDirection, const SceneTriangles &triangles,
+                          int depth, const SceneLights &lights, float ambientLight) {
     // if the ray has been reflected more than 3 times, return black
     if (depth >= 3) {
         return Colour(0, 0, 0);
     }
 
     RayTriangleIntersection intersection = getClosestIntersection(rayOrigin, rayDirection, triangles);
-    if (intersection.intersectedTriangle.isMirror) {
+    const Material &material = triangles.material(intersection);
+    if (material.isMirror) {
         // actually this condition is hard to be satisfied, unless I have multiple mirrors
         // if the ray reflected by the mirror hits another mirror, it will recursively call the traceReflectiveRay function
         glm::vec3 reflectDir = glm::reflect(rayDirection, intersection.intersectedTriangle.normal);
         glm::vec3 reflectOrigin = intersection.intersectionPoint + reflectDir * 0.001f;
-        return traceReflectiveRay(reflectOrigin, reflectDir, triangles, depth + 1, sourceLight, ambientLight);
-    } else if(intersection.intersectedTriangle.isGlass){
+        Colour reflectColour = traceReflectiveRay(reflectOrigin, reflectDir, triangles, depth + 1, lights, ambientLight);
+        if (material.reflectivity == 1.0f) return reflectColour;
+        return mixReflection(reflectColour, material, shadeSecondaryHit(intersection, triangles, lights, ambientLight));
+    } else if(material.isGlass){
         // this situation is very complex
         // if the reflection ray hits the glass, then it will be refracted
         // it will call the traceRefractiveRay function
-        float indexOfRefraction = 1.6;
+        float indexOfRefraction = material.indexOfRefraction;
         glm::vec3 normal{};
         if (glm::dot(rayDirection, intersection.intersectedTriangle.normal)<0) {
             normal = -intersection.intersectedTriangle.normal;
@@ -223,7 +272,7 @@ Colour traceReflectiveRay(const glm::vec3 &rayOrigin, const glm::vec3 &rayDirect
         glm::vec3 refractDir = calculate_refracted_ray(rayDirection, normal, indexOfRefraction);
         glm::vec3 refractOrigin = intersection.intersectionPoint + normal * 0.001f; // avoid self-intersection
 
-        Colour refractColour = traceRefractiveRay(refractOrigin, refractDir, triangles, 1,sourceLight,ambientLight);
+        Colour refractColour = traceRefractiveRay(refractOrigin, refractDir, triangles, 1, lights, ambientLight);
         return refractColour;
     }else{
         // this is the most common situation
@@ -232,17 +281,10 @@ Colour traceReflectiveRay(const glm::vec3 &rayOrigin, const glm::vec3 &rayDirect
             return Colour(0, 0, 0);
         }
 
-        glm::vec3 shadowRay = glm::normalize(sourceLight - intersection.intersectionPoint);
-        RayTriangleIntersection shadowIntersection = getClosestIntersection(intersection.intersectionPoint + shadowRay * 0.001f,
-                                                                            shadowRay, triangles);
+        // there are three different shading methods, no difference for cornell box, default is flat shading
+        float combinedBrightness = shadeSecondaryHit(intersection, triangles, lights, ambientLight);
 
-        // there are three different shading methods, you can choose any shading method
-        // no difference for cornell box, default is flat shading
-//                float combinedBrightness = phongShading(intersection,shadowIntersection, sourceLight, ambientLight);
-//                float combinedBrightness = GouraudShading(intersection,shadowIntersection, sourceLight, ambientLight);
-        float combinedBrightness = FlatShading(intersection,shadowIntersection, sourceLight, ambientLight);
-
-        Colour colour = intersection.intersectedTriangle.colour;
+        Colour colour = material.colour;
         colour.red *= combinedBrightness;
         colour.green *= combinedBrightness;
         colour.blue *= combinedBrightness;
@@ -272,8 +314,8 @@ glm::vec3 calculate_refracted_ray(const glm::vec3 &incident, const glm::vec3 &no
 
 // This function is to return the color of the refracted ray
 Colour traceRefractiveRay(const glm::vec3& refractOrigin,
-                          const glm::vec3& refractDir, const std::vector<ModelTriangle>& triangles,
-                          int depth, const glm::vec3 &sourceLight, float ambientLight) {
+                          const glm::vec3& refractDir, const SceneTriangles& triangles,
+                          int depth, const SceneLights &lights, float ambientLight) {
     // if the ray has been refracted more than 240 times, return black
     if (depth > 240) {
         return Colour(0, 0, 0);
@@ -291,13 +333,14 @@ Colour traceRefractiveRay(const glm::vec3& refractOrigin,
     glm::vec3 NextRefractOrigin = closestIntersection.intersectionPoint + closestIntersection.intersectedTriangle.normal * 0.001f;
     RayTriangleIntersection NextClosestIntersection = getClosestIntersection(NextRefractOrigin,
                                                                              refractDir, triangles);
-    bool isInside = NextClosestIntersection.intersectedTriangle.isGlass;
+    bool isInside = triangles.material(NextClosestIntersection).isGlass;
+    const Material &material = triangles.material(closestIntersection);
     // if the current intersection is the glass and the next intersection is not in the glass
     // then the ray is leaving the glass
-    if (closestIntersection.intersectedTriangle.isGlass && !isInside) {
+    if (material.isGlass && !isInside) {
         // because the ray is leaving the glass, we need to calculate the new refractive index
         // which is the inverse of the current refractive index
-        float newIndexOfRefraction = 1/1.3;
+        float newIndexOfRefraction = 1 / material.indexOfRefraction;
         glm::vec3 normal{};
         // here, we must ensure that the cos(theta) between the normal and the refract ray is positive
         if (glm::dot(refractDir, closestIntersection.intersectedTriangle.normal)<0) {
@@ -319,23 +362,20 @@ Colour traceRefractiveRay(const glm::vec3& refractOrigin,
         }
         // if this final intersection is a mirror, then we need to call the traceReflectiveRay function
         // this is very tricky here.
-        if (FinalClosestIntersection.intersectedTriangle.isMirror){
+        const Material &finalMaterial = triangles.material(FinalClosestIntersection);
+        if (finalMaterial.isMirror){
             glm::vec3 reflectDir = glm::reflect(newRefractDir, FinalClosestIntersection.intersectedTriangle.normal);
             glm::vec3 reflectOrigin = FinalClosestIntersection.intersectionPoint + reflectDir * 0.001f;
-            Colour reflectColour = traceReflectiveRay(reflectOrigin, reflectDir, triangles, 1,sourceLight,ambientLight);
-            return reflectColour;
+            Colour reflectColour = traceReflectiveRay(reflectOrigin, reflectDir, triangles, 1, lights, ambientLight);
+            if (finalMaterial.reflectivity == 1.0f) return reflectColour;
+            return mixReflection(reflectColour, finalMaterial,
+                                 shadeSecondaryHit(FinalClosestIntersection, triangles, lights, ambientLight));
         }
         // if the code reaches here, it means that the final intersection is just a normal surface
-        glm::vec3 shadowRay = glm::normalize(sourceLight - FinalClosestIntersection.intersectionPoint);
-        RayTriangleIntersection shadowIntersection = getClosestIntersection(FinalClosestIntersection.intersectionPoint + shadowRay * 0.001f,
-                                                                            shadowRay, triangles);
-        // there are three different shading methods, you can choose any shading method
-        // no difference for cornell box, default is flat shading
-//                float combinedBrightness = phongShading(intersection,shadowIntersection, sourceLight, ambientLight);
-//                float combinedBrightness = GouraudShading(intersection,shadowIntersection, sourceLight, ambientLight);
-        float combinedBrightness = FlatShading(FinalClosestIntersection,shadowIntersection, sourceLight, ambientLight);
-
-        Colour colour = FinalClosestIntersection.intersectedTriangle.colour;
+        // there are three different shading methods, no difference for cornell box, default is flat shading
+        float combinedBrightness = shadeSecondaryHit(FinalClosestIntersection, triangles, lights, ambientLight);
+
+        Colour colour = finalMaterial.colour;
         colour.red *= combinedBrightness;
         colour.green *= combinedBrightness;
         colour.blue *= combinedBrightness;
@@ -346,15 +386,42 @@ Colour traceRefractiveRay(const glm::vec3& refractOrigin,
         glm::vec3 newRefractOrigin = closestIntersection.intersectionPoint + closestIntersection.intersectedTriangle.normal * 0.001f;
 
         // so we need to recursively call the traceRefractiveRay function
-        return traceRefractiveRay(newRefractOrigin, refractDir, triangles, depth + 1,sourceLight,ambientLight);
+        return traceRefractiveRay(newRefractOrigin, refractDir, triangles, depth + 1, lights, ambientLight);
     }
 }
 
 
+// point activeShadowMap at the scene's cube shadow map when shadow map mode is on, it is only built once per scene and light
+// a map per light would not fit in memory for scenes with many lights, so those keep using shadow rays
+void selectShadowMap(const std::string& filename, const std::vector<ModelTriangle> &triangles, const SceneLights &lights) {
+    activeShadowMap = nullptr;
+    if (shadowMode != ShadowMode::CubeShadowMap) return;
+    if (lights.size() == 1) {
+        activeShadowMap = &getCubeShadowMap(filename, triangles, lights.position(0));
+    } else {
+        LOG_WARNING(LogCategory::RayTrace, filename << " has " << lights.size()
+                                                    << " lights, the cube shadow map only supports one, using shadow rays");
+    }
+}
+
+// gouraud shading only interpolates the baked vertex lighting, it is baked again when the camera, lights or settings change
+void selectVertexLighting(const std::string& filename, const std::string& materialFilename,
+                          const std::vector<ModelTriangle> &triangles, const SceneLights &lights, float ambientLight,
+                          const int signalForShading) {
+    // the bake this thread shades with, another thread getting a new one does not free it
+    static thread_local std::shared_ptr<const VertexLighting> selected;
+    if (signalForShading == 2) {
+        selected = getVertexLighting(filename, materialFilename, triangles, lights, ambientLight);
+    } else {
+        selected = nullptr;
+    }
+    activeVertexLighting = selected.get();
+}
+
 void renderRayTracedScene(DrawingWindow &window, const std::string& filename, float focalLength,const std::string& materialFilename,
                           const int signalForShading) {
-    // Load the triangles from the OBJ file.
-    std::vector<ModelTriangle> triangles = loadOBJ(filename, 0.35,materialFilename);
+    // the triangles from the OBJ file, parsed once per file, not on every redraw
+    const std::vector<ModelTriangle> &triangles = getModel(filename, 0.35, materialFilename);
 
     glm::vec3 ModelCenter = calculateModelCenter(triangles);
 //    float degree = 1.0f;
@@ -364,104 +431,25 @@ void renderRayTracedScene(DrawingWindow &window, const std::string& filename, fl
     // Rotate the camera to look at the model center
     cameraOrientation = lookAt(ModelCenter);
 
-    std::cout << "Loaded " << triangles.size() << " triangles for ray tracing" << std::endl;
+    LOG_INFO(LogCategory::RayTrace, "Loaded " << triangles.size() << " triangles for ray tracing");
+    RayTracedFrame frame;
+    prepareRayTracedFrame(frame, filename, triangles, focalLength, materialFilename, signalForShading);
+    renderRayTracedTile(window, wholeWindow(window), frame);
+}
 
-// if the file is the sphere, we should put the light source in front of the sphere
-    glm::vec3 sourceLight;
-    if (filename=="../sphere.obj"){
-        sourceLight = glm::vec3(0.4, 0.4, 1.5);
-    }else{
-        // this is the default light source position for the cornell box
-        sourceLight = glm::vec3(0, 0.89, 0.1);
-    }
-    float ambientLight = 0.3f;  // ambient light intensity
-
-    // Loop over each pixel on the image plane
-    for (int y = 0; y < int(window.height); y++) {
-        for (int x = 0; x < int(window.width); x++) {
-            // Compute the ray direction for this pixel
-            glm::vec3 rayDirection = computeRayDirection(window.width, window.height, x, y, focalLength,cameraOrientation);
-
-            // Find the closest intersection of this ray with the scene
-            RayTriangleIntersection intersection = getClosestIntersection(cameraPosition, rayDirection, triangles);
-
-            // If an intersection was found, color the pixel accordingly
-            if (intersection.distanceFromCamera != std::numeric_limits<float>::infinity()) {
-                // if the intersection is a mirror, then we need to calculate the reflected ray
-                if (intersection.intersectedTriangle.isMirror){
-                    glm::vec3 reflectDir = glm::reflect(rayDirection, intersection.intersectedTriangle.normal);
-                    glm::vec3 reflectOrigin = intersection.intersectionPoint + reflectDir * 0.001f;
-                    // this is the recursive call
-                    Colour reflectColour = traceReflectiveRay(reflectOrigin, reflectDir, triangles, 1,sourceLight,ambientLight);
-                    uint32_t rgbColour = (255 << 24) |
-                                         (int(reflectColour.red) << 16) |
-                                         (int(reflectColour.green) << 8) |
-                                         int(reflectColour.blue);
-                    window.setPixelColour(x, y, rgbColour);
-
-                }else if(intersection.intersectedTriangle.isGlass){
-                    // if the intersection is a glass, then we need to calculate the refracted ray
-                    float indexOfRefraction = 1.3; // the refractive index from air to glass
-                    glm::vec3 normal{};
-                    // here is very tricky, we must ensure that the cos(theta) between the normal and the refract ray is positive
-                    if (glm::dot(rayDirection, intersection.intersectedTriangle.normal)<0) {
-                        normal = -intersection.intersectedTriangle.normal;
-                    }else{
-                        normal = intersection.intersectedTriangle.normal;
-                    }
-                    glm::vec3 refractDir = calculate_refracted_ray(rayDirection, normal, indexOfRefraction);
-                    glm::vec3 refractOrigin = intersection.intersectionPoint + normal * 0.001f;
-
-                    Colour refractColour = traceRefractiveRay(refractOrigin, refractDir, triangles, 1,sourceLight,ambientLight);
-                    uint32_t rgbColour = (255 << 24) |
-                                         (int(refractColour.red) << 16) |
-                                         (int(refractColour.green) << 8) |
-                                         int(refractColour.blue);
-                    window.setPixelColour(x, y, rgbColour);
-                }else{
-                    // if the intersection is not a mirror or a glass
-                    // it means the intersection is just a normal surface
-
-                    // here is very crucial, this condition is to say that if we look from outside the wall,
-                    // then draw the color directly with the ambientLight, otherwise there will be some shadows
-                    if (glm::dot(rayDirection, intersection.intersectedTriangle.normal)>0) {
-                        Colour colour = intersection.intersectedTriangle.colour;
-                        float brightness = ambientLight;
-                        uint32_t rgbColour = (255 << 24) |
-                                             (int(brightness*colour.red) << 16) |
-                                             (int(brightness*colour.green) << 8) |
-                                             int(brightness*colour.blue);
-                        window.setPixelColour(x, y, rgbColour);
-                    }else{
-                        glm::vec3 shadowRay = glm::normalize(sourceLight - intersection.intersectionPoint);
-                        RayTriangleIntersection shadowIntersection = getClosestIntersection(intersection.intersectionPoint + shadowRay * 0.001f,
-                                                                                            shadowRay, triangles);
-
-                        //there are three different shading methods, you can choose any shading method
-                        float combinedBrightness;
-                        if(signalForShading==1){
-                            combinedBrightness = FlatShading(intersection,shadowIntersection, sourceLight, ambientLight);
-                        }else if(signalForShading==2) {
-                            combinedBrightness = GouraudShading(intersection, shadowIntersection, sourceLight,ambientLight);
-                        }else if(signalForShading==3){
-                            combinedBrightness = phongShading(intersection, shadowIntersection, sourceLight,ambientLight);
-                        }else{
-                            std::cout << "Please enter the correct signal for shading" << std::endl;
-                            exit(1);
-                        }
-                        Colour colour = intersection.intersectedTriangle.colour;
-                        uint32_t rgbColour = (255 << 24) |
-                                             (int(combinedBrightness * colour.red) << 16) |
-                                             (int(combinedBrightness * colour.green) << 8) |
-                                             int(combinedBrightness * colour.blue);
-                        window.setPixelColour(x, y, rgbColour);
-
-                    }
-                }
-            } else {
-                // No intersection found, set the pixel to the background color,
-                window.setPixelColour(x, y, 0);
-            }
-        }
-    }
+void prepareRayTracedFrame(RayTracedFrame &frame, const std::string& filename, const std::vector<ModelTriangle> &triangles,
+                           float focalLength, const std::string& materialFilename, const int signalForShading) {
+    frame.lights = &getSceneLights(filename);
+    frame.focalLength = focalLength;
+    selectShadowMap(filename, triangles, *frame.lights);
+    selectVertexLighting(filename, materialFilename, triangles, *frame.lights, frame.ambientLight, signalForShading);
+
+    // the rays walk the split positions
+    frame.triangles = splitTriangles(triangles, getMaterials(materialFilename));
+    // the shading model, the shadow technique and the materials are picked once here instead of for every pixel
+    frame.kernels = selectRenderKernels(signalForShading, frame.triangles);
+}
+
+void renderRayTracedTile(DrawingWindow &window, const PixelRect &region, const RayTracedFrame &frame) {
+    frame.kernels.renderFrame(window, region, frame.triangles, *frame.lights, frame.ambientLight, frame.focalLength);
 }
@@ -12,29 +12,117 @@
 #include "Rasterising.h"
 #include "Globals.h"
 #include "RayTriangleIntersection.h"
+#include "ShadowMap.h"
+#include "SceneLights.h"
+#include "VertexLighting.h"
+#include "RenderKernels.h"
+#include "BVH.h"
+#include "SceneTriangles.h"
+#include "CameraRays.h"
 
 void renderRayTracedScene(DrawingWindow &window, const std::string& filename, float focalLength,const std::string& materialFilename,const int signalForShading);
+// what a ray traced frame sets up before any pixel is traced: the lights, the shadow map, the gouraud bake, the split
+// triangles and the kernels, a frame cut into tiles prepares this once and renders every tile with it
+struct RayTracedFrame {
+    const SceneLights *lights = nullptr;
+    float ambientLight = 0.3f;  // ambient light intensity
+    float focalLength = 0.0f;
+    SceneTriangles triangles;
+    RenderKernels kernels{};
+};
+// with the triangles already loaded and the camera already aimed, activeShadowMap and activeVertexLighting are set
+// for the calling thread, so the tiles have to be rendered on it
+void prepareRayTracedFrame(RayTracedFrame &frame, const std::string& filename, const std::vector<ModelTriangle> &triangles,
+                           float focalLength, const std::string& materialFilename, const int signalForShading);
+// only the pixels inside region, renderRayTracedScene is this over the whole window
+void renderRayTracedTile(DrawingWindow &window, const PixelRect &region, const RayTracedFrame &frame);
 
 glm::vec3 computeRayDirection(int screenWidth, int screenHeight, int x, int y, float focalLength, glm::mat3 cameraOrientation);
+glm::vec3 computeRayDirection(int screenWidth, int screenHeight, float x, float y, float focalLength, glm::mat3 cameraOrientation);
 float calculateSpecularLighting(const glm::vec3 &point,const glm::vec3 &cameraPosition,
                                 const glm::vec3 &lightSource, const glm::vec3 &normal, int shininess);
 RayTriangleIntersection getClosestIntersection(const glm::vec3 &cameraPosition,
                                                const glm::vec3 &rayDirection, const std::vector<ModelTriangle> &triangles);
-glm::vec3 calculateBarycentricCoordinates(const glm::vec3 &P, const std::array<glm::vec3, 3> &triangleVertices);
+RayTriangleIntersection getClosestIntersection(const glm::vec3 &cameraPosition,
+                                               const glm::vec3 &rayDirection, const SceneTriangles &triangles);
 float calculateLighting(const glm::vec3 &point, const glm::vec3 &normal, const glm::vec3 &lightSource);
+bool isInShadow(const RayTriangleIntersection &intersection, const RayTriangleIntersection &shadowIntersection,
+                const glm::vec3 &point, const glm::vec3 &sourceLight);
+float calculateLightVisibility(const RayTriangleIntersection &intersection, const SceneTriangles &triangles,
+                               const glm::vec3 &sourceLight);
+float traceLightVisibility(const RayTriangleIntersection &intersection, const SceneTriangles &triangles,
+                           const glm::vec3 &sourceLight);
+std::array<float, maxSelectedLights> calculateLightVisibility(const RayTriangleIntersection &intersection,
+                                                             const SceneTriangles &triangles,
+                                                             const LightSelection &lights);
+void selectShadowMap(const std::string& filename, const std::vector<ModelTriangle> &triangles, const SceneLights &lights);
+void selectVertexLighting(const std::string& filename, const std::string& materialFilename,
+                          const std::vector<ModelTriangle> &triangles, const SceneLights &lights, float ambientLight,
+                          const int signalForShading);
+float FlatShading(RayTriangleIntersection intersection, const LightSelection &lights,
+                  const std::array<float, maxSelectedLights> &lightVisibility, float ambientLight);
+float FlatShading(RayTriangleIntersection intersection, float lightVisibility,
+                  const glm::vec3 &sourceLight, float ambientLight);
 float FlatShading(RayTriangleIntersection intersection, RayTriangleIntersection shadowIntersection,
                   const glm::vec3 &sourceLight, float ambientLight);
-float GouraudShading(RayTriangleIntersection intersection, RayTriangleIntersection shadowIntersection,
-                     const glm::vec3 &sourceLight, float ambientLight);
+float GouraudShading(RayTriangleIntersection intersection, const VertexLighting &vertexLighting);
 
+float phongShading(RayTriangleIntersection intersection, const LightSelection &lights,
+                   const std::array<float, maxSelectedLights> &lightVisibility, float ambientLight);
+float phongShading(RayTriangleIntersection intersection, float lightVisibility,
+                   const glm::vec3 &sourceLight, float ambientLight);
 float phongShading(RayTriangleIntersection intersection, RayTriangleIntersection shadowIntersection,
                    const glm::vec3 &sourceLight, float ambientLight);
 
+Colour traceReflectiveRay(const glm::vec3 &rayOrigin, const glm::vec3 &rayDirection, const SceneTriangles &triangles,
+                          int depth, const SceneLights &lights, float ambientLight);
 Colour traceRefractiveRay(const glm::vec3& refractOrigin,
-                          const glm::vec3& refractDir, const std::vector<ModelTriangle>& triangles,
-                          int depth,const glm::vec3 &sourceLight, float ambientLight);
+                          const glm::vec3& refractDir, const SceneTriangles& triangles,
+                          int depth, const SceneLights &lights, float ambientLight);
 
 glm::vec3 calculate_refracted_ray(const glm::vec3 &incident, const glm::vec3 &normal, float ior);
+float shadeSecondaryHit(const RayTriangleIntersection &intersection, const SceneTriangles &triangles,
+                        const SceneLights &lights, float ambientLight);
+// a mirror with a reflectivity below 1 shows some of its own colour, lit by brightness, under the reflection
+Colour mixReflection(const Colour &reflected, const Material &mirror, float brightness);
 
+// flat shading with shadow rays for scenes that are not one SceneTriangles, like the out of core clusters or instanced
+// meshes, intersect(origin, direction) finds the closest hit like getClosestIntersection, mirrors and glass are shaded
+// as plain surfaces
+template <typename Intersect>
+void renderFlatShadedRegion(DrawingWindow &window, const PixelRect &region, const std::vector<Material> &materials,
+                            const SceneLights &lights, float ambientLight, float focalLength, Intersect intersect) {
+    auto packColour = [](const Colour &colour, float brightness) {
+        return (255 << 24) | (int(brightness * colour.red) << 16) | (int(brightness * colour.green) << 8) |
+               int(brightness * colour.blue);
+    };
+    const CameraRayTable &rays = getCameraRayTable(window.width, window.height, focalLength, cameraOrientation);
+    renderAdaptiveAntiAliased(window, region, [&](float x, float y, uint32_t) {
+        glm::vec3 rayDirection = rays.direction(x, y);
+        RayTriangleIntersection intersection = intersect(cameraPosition, rayDirection);
+        PixelSample sample;
+        if (intersection.distanceFromCamera == std::numeric_limits<float>::infinity()) return sample;
+        sample.triangleId = long(intersection.triangleIndex);
+        sample.depth = intersection.distanceFromCamera;
+        const Colour &colour = materials[intersection.intersectedTriangle.materialId].colour;
+        // seen from behind, only the ambient light like in the other ray traced modes
+        if (glm::dot(rayDirection, intersection.intersectedTriangle.normal) > 0) {
+            sample.colour = packColour(colour, ambientLight);
+            return sample;
+        }
+        LightSelection selectedLights;
+        selectLights(lights, intersection.intersectionPoint, intersection.intersectedTriangle.normal, selectedLights);
+        std::array<float, maxSelectedLights> visibility{};
+        for (int i = 0; i < selectedLights.count; i++) {
+            glm::vec3 shadowRay = glm::normalize(selectedLights.positions[i] - intersection.intersectionPoint);
+            RayTriangleIntersection shadowIntersection = intersect(intersection.intersectionPoint + shadowRay * 0.001f,
+                                                                   shadowRay);
+            visibility[i] = isInShadow(intersection, shadowIntersection, intersection.intersectionPoint,
+                                       selectedLights.positions[i]) ? 0.0f : 1.0f;
+        }
+        sample.colour = packColour(colour, FlatShading(intersection, selectedLights, visibility, ambientLight));
+        return sample;
+    });
+}
 
 #endif //REDNOISE_HARDSHADOWRENDERING_H
@@ -0,0 +1,145 @@
+#include "HybridRendering.h"
+#include "Log.h"
+#include "CameraRays.h"
+#include "RenderJob.h"
+#include <algorithm>
+
+// hybrid rendering: the primary visibility is rasterised instead of ray traced,
+// only the shadow, reflection and refraction rays are traced from the surfaces found by the rasteriser
+
+// anything closer than this to the camera cannot be projected onto the image plane
+const float nearPlane = 0.001f;
+// how far outside an edge a pixel centre can be and still count as covered
+const float edgeTolerance = 1e-5f;
+
+// a triangle that touches or goes behind the camera cannot be rasterised, these are ray traced instead
+bool crossesNearPlane(const std::array<CanvasPoint, 3> &projectedPoints) {
+    for (const CanvasPoint &point : projectedPoints) {
+        if (point.depth <= nearPlane) return true;
+    }
+    return false;
+}
+
+VisibilityBuffer rasteriseVisibilityBuffer(const std::vector<ModelTriangle> &triangles, size_t width, size_t height,
+                                           float focalLength) {
+    VisibilityBuffer buffer;
+    buffer.width = width;
+    buffer.height = height;
+    buffer.triangleIds.assign(width * height, -1);
+    buffer.barycentrics.assign(width * height, glm::vec2(0.0f));
+    buffer.depths.assign(width * height, std::numeric_limits<float>::infinity());
+
+    for (size_t i = 0; i < triangles.size(); i++) {
+        std::array<CanvasPoint, 3> p;
+        for (int k = 0; k < 3; k++) {
+            p[k] = getCanvasIntersectionPoint(cameraPosition, triangles[i].vertices[k], focalLength, int(width), int(height));
+        }
+        if (crossesNearPlane(p)) continue;
+
+        // twice the signed area of the projected triangle, zero means we are looking at it edge on
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+        if (std::abs(area) < 1e-12f) continue;
+
+        // the ray tracer samples each pixel at its integer coordinate, so the rasteriser does the same
+        int minX = std::max(0, int(std::ceil(std::min({p[0].x, p[1].x, p[2].x}))));
+        int maxX = std::min(int(width) - 1, int(std::floor(std::max({p[0].x, p[1].x, p[2].x}))));
+        int minY = std::max(0, int(std::ceil(std::min({p[0].y, p[1].y, p[2].y}))));
+        int maxY = std::min(int(height) - 1, int(std::floor(std::max({p[0].y, p[1].y, p[2].y}))));
+
+        for (int y = minY; y <= maxY; y++) {
+            for (int x = minX; x <= maxX; x++) {
+                // edge functions give the screen space weight of each vertex
+                float w0 = ((p[1].x - x) * (p[2].y - y) - (p[1].y - y) * (p[2].x - x)) / area;
+                float w1 = ((p[2].x - x) * (p[0].y - y) - (p[2].y - y) * (p[0].x - x)) / area;
+                float w2 = 1.0f - w0 - w1;
+                if (w0 < -edgeTolerance || w1 < -edgeTolerance || w2 < -edgeTolerance) continue;
+
+                // 1/z is linear in screen space, this gives the perspective correct depth and barycentrics
+                float inverseDepth = w0 / p[0].depth + w1 / p[1].depth + w2 / p[2].depth;
+                float depth = 1.0f / inverseDepth;
+                size_t index = y * width + x;
+                if (depth >= buffer.depths[index]) continue;
+
+                buffer.depths[index] = depth;
+                buffer.triangleIds[index] = int(i);
+                buffer.barycentrics[index] = glm::vec2(w1 / p[1].depth * depth, w2 / p[2].depth * depth);
+            }
+        }
+    }
+    return buffer;
+}
+
+void renderHybridScene(DrawingWindow &window, const std::string& filename, float focalLength,
+                       const std::string& materialFilename, const int signalForShading) {
+    // the triangles from the OBJ file, parsed once per file, not on every redraw
+    const std::vector<ModelTriangle> &triangles = getModel(filename, 0.35, materialFilename);
+
+    glm::vec3 ModelCenter = calculateModelCenter(triangles);
+    // Rotate the camera to look at the model center
+    cameraOrientation = lookAt(ModelCenter);
+
+    LOG_INFO(LogCategory::RayTrace, "Loaded " << triangles.size() << " triangles for hybrid rendering");
+
+    const SceneLights &lights = getSceneLights(filename);
+    float ambientLight = 0.3f;  // ambient light intensity
+    selectShadowMap(filename, triangles, lights);
+    selectVertexLighting(filename, materialFilename, triangles, lights, ambientLight, signalForShading);
+    // the secondary rays walk the split positions
+    SceneTriangles sceneTriangles = splitTriangles(triangles, getMaterials(materialFilename));
+    RenderKernels kernels = selectRenderKernels(signalForShading, sceneTriangles);
+
+    VisibilityBuffer buffer = rasteriseVisibilityBuffer(triangles, window.width, window.height, focalLength);
+
+    // the few triangles the rasteriser had to skip are tested with the camera ray, this is normally empty
+    std::vector<ModelTriangle> nearTriangles;
+    std::vector<size_t> nearTriangleIndices;
+    for (size_t i = 0; i < triangles.size(); i++) {
+        std::array<CanvasPoint, 3> p;
+        for (int k = 0; k < 3; k++) {
+            p[k] = getCanvasIntersectionPoint(cameraPosition, triangles[i].vertices[k], focalLength,
+                                              int(window.width), int(window.height));
+        }
+        if (crossesNearPlane(p)) {
+            nearTriangles.push_back(triangles[i]);
+            nearTriangleIndices.push_back(i);
+        }
+    }
+
+    const CameraRayTable &rays = getCameraRayTable(window.width, window.height, focalLength, cameraOrientation);
+    for (int y = 0; y < int(window.height); y++) {
+        if (isRenderCancelled()) return;
+        showRenderProgress(window);
+        for (int x = 0; x < int(window.width); x++) {
+            glm::vec3 rayDirection = rays.direction(float(x), float(y));
+            size_t index = y * window.width + x;
+
+            // rebuild the hit record from the visibility buffer instead of tracing the camera ray
+            RayTriangleIntersection intersection;
+            intersection.distanceFromCamera = std::numeric_limits<float>::infinity();
+            int triangleId = buffer.triangleIds[index];
+            if (triangleId >= 0) {
+                const ModelTriangle &triangle = triangles[triangleId];
+                glm::vec2 uv = buffer.barycentrics[index];
+                glm::vec3 point = triangle.vertices[0] +
+                                  uv.x * (triangle.vertices[1] - triangle.vertices[0]) +
+                                  uv.y * (triangle.vertices[2] - triangle.vertices[0]);
+                intersection = RayTriangleIntersection(point, glm::length(point - cameraPosition), triangle, triangleId,
+                                                       uv.x, uv.y);
+            }
+            if (!nearTriangles.empty()) {
+                RayTriangleIntersection nearIntersection = getClosestIntersection(cameraPosition, rayDirection, nearTriangles);
+                if (nearIntersection.distanceFromCamera < intersection.distanceFromCamera) {
+                    nearIntersection.triangleIndex = nearTriangleIndices[nearIntersection.triangleIndex];
+                    intersection = nearIntersection;
+                }
+            }
+
+            if (intersection.distanceFromCamera != std::numeric_limits<float>::infinity()) {
+                window.setPixelColour(x, y, kernels.shadePrimary(rayDirection, intersection, sceneTriangles, lights, ambientLight));
+            } else {
+                // No intersection found, set the pixel to the background color,
+                window.setPixelColour(x, y, 0);
+            }
+        }
+    }
+}
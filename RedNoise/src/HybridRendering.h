@@ -0,0 +1,26 @@
+#ifndef REDNOISE_HYBRIDRENDERING_H
+#define REDNOISE_HYBRIDRENDERING_H
+
+#include <DrawingWindow.h>
+#include "glm/glm.hpp"
+#include "LoadFile.h"
+#include "Rasterising.h"
+#include "Globals.h"
+#include "RayTriangleIntersection.h"
+#include "HardShadowRendering.h"
+
+// what the rasteriser found at every pixel: the closest triangle, where on it, and how far away
+struct VisibilityBuffer {
+    size_t width = 0;
+    size_t height = 0;
+    std::vector<int> triangleIds;            // -1 means no triangle covers the pixel
+    std::vector<glm::vec2> barycentrics;     // weights of vertex 1 and vertex 2, vertex 0 gets 1 - u - v
+    std::vector<float> depths;               // camera space depth of the closest surface
+};
+
+VisibilityBuffer rasteriseVisibilityBuffer(const std::vector<ModelTriangle> &triangles, size_t width, size_t height,
+                                           float focalLength);
+void renderHybridScene(DrawingWindow &window, const std::string& filename, float focalLength,
+                       const std::string& materialFilename, const int signalForShading);
+
+#endif //REDNOISE_HYBRIDRENDERING_H
@@ -0,0 +1,274 @@
+#include "InstancedScene.h"
+#include "HardShadowRendering.h"
+#include "AntiAliasing.h"
+#include "Log.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <map>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace {
+    std::string directoryOf(const std::string &filename) {
+        size_t slash = filename.find_last_of("/\\");
+        return slash == std::string::npos ? "" : filename.substr(0, slash + 1);
+    }
+
+    // the world box around the eight corners of the mesh box
+    void updateInstanceBounds(MeshInstance &instance, const Mesh &mesh) {
+        const BVHNode &root = mesh.bvh.tree().nodes[0];
+        instance.boundsMin = glm::vec3(std::numeric_limits<float>::infinity());
+        instance.boundsMax = glm::vec3(-std::numeric_limits<float>::infinity());
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 point((corner & 1) ? root.boundsMax.x : root.boundsMin.x,
+                            (corner & 2) ? root.boundsMax.y : root.boundsMin.y,
+                            (corner & 4) ? root.boundsMax.z : root.boundsMin.z);
+            glm::vec3 worldPoint = glm::vec3(instance.objectToWorld * glm::vec4(point, 1.0f));
+            instance.boundsMin = glm::min(instance.boundsMin, worldPoint);
+            instance.boundsMax = glm::max(instance.boundsMax, worldPoint);
+        }
+    }
+
+    void instanceBounds(const InstancedScene &scene, std::vector<glm::vec3> &boundsMin,
+                        std::vector<glm::vec3> &boundsMax) {
+        boundsMin.clear();
+        boundsMax.clear();
+        for (const MeshInstance &instance : scene.instances) {
+            boundsMin.push_back(instance.boundsMin);
+            boundsMax.push_back(instance.boundsMax);
+        }
+    }
+
+    void setTransform(MeshInstance &instance, const glm::mat4 &objectToWorld) {
+        instance.objectToWorld = objectToWorld;
+        instance.worldToObject = glm::inverse(objectToWorld);
+        instance.normalToWorld = glm::transpose(glm::inverse(glm::mat3(objectToWorld)));
+    }
+
+    // the mesh triangles with their material ids moved past the tables of the meshes before it
+    bool addMesh(InstancedScene &scene, const std::string &name, const std::string &objFilename,
+                 const std::string &materialFilename) {
+        std::vector<ModelTriangle> triangles = loadOBJ(objFilename, 1.0f, materialFilename);
+        if (triangles.empty()) return false;
+        const std::vector<Material> &materials = getMaterials(materialFilename);
+        if (scene.materials.size() + materials.size() > std::numeric_limits<uint16_t>::max()) {
+            LOG_ERROR(LogCategory::Loader, "Too many materials in the scene for 16 bit material ids");
+            return false;
+        }
+        uint16_t firstMaterial = uint16_t(scene.materials.size());
+        scene.materials.insert(scene.materials.end(), materials.begin(), materials.end());
+        for (ModelTriangle &triangle : triangles) triangle.materialId = uint16_t(triangle.materialId + firstMaterial);
+
+        Mesh mesh;
+        mesh.name = name;
+        mesh.triangles = splitTriangles(triangles, scene.materials);
+        std::vector<glm::vec3> boundsMin, boundsMax;
+        computeTriangleBounds(mesh.triangles.positions, boundsMin, boundsMax);
+        mesh.bvh = DynamicBVH(boundsMin, boundsMax, 4);
+        scene.meshes.push_back(std::move(mesh));
+        return true;
+    }
+
+    bool isInstanceOperation(const std::string &token) {
+        return token == "scale" || token == "rotate" || token == "translate";
+    }
+
+    bool parseInstance(InstancedScene &scene, const std::vector<std::string> &tokens, MeshInstance &instance) {
+        auto mesh = std::find_if(scene.meshes.begin(), scene.meshes.end(),
+                                 [&](const Mesh &candidate) { return candidate.name == tokens[1]; });
+        if (mesh == scene.meshes.end()) {
+            LOG_ERROR(LogCategory::Loader, "Instance of the unknown mesh " << tokens[1]);
+            return false;
+        }
+        instance.mesh = uint32_t(mesh - scene.meshes.begin());
+        // every operation is put in front of the ones before it, so they apply in the order they are written
+        glm::mat4 transform(1.0f);
+        size_t i = 2;
+        while (i < tokens.size()) {
+            const std::string &operation = tokens[i];
+            size_t remaining = tokens.size() - i - 1;
+            // scale takes one uniform factor or three, told apart by what follows the first one
+            if (operation == "scale" && remaining >= 3 && !isInstanceOperation(tokens[i + 2])) {
+                glm::vec3 scale(stof(tokens[i + 1]), stof(tokens[i + 2]), stof(tokens[i + 3]));
+                transform = glm::scale(glm::mat4(1.0f), scale) * transform;
+                i += 4;
+            } else if (operation == "scale" && remaining >= 1) {
+                transform = glm::scale(glm::mat4(1.0f), glm::vec3(stof(tokens[i + 1]))) * transform;
+                i += 2;
+            } else if (operation == "rotate" && remaining >= 3) {
+                glm::vec3 angles = glm::radians(glm::vec3(stof(tokens[i + 1]), stof(tokens[i + 2]), stof(tokens[i + 3])));
+                glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), angles.z, glm::vec3(0, 0, 1)) *
+                                     glm::rotate(glm::mat4(1.0f), angles.y, glm::vec3(0, 1, 0)) *
+                                     glm::rotate(glm::mat4(1.0f), angles.x, glm::vec3(1, 0, 0));
+                transform = rotation * transform;
+                i += 4;
+            } else if (operation == "translate" && remaining >= 3) {
+                glm::vec3 offset(stof(tokens[i + 1]), stof(tokens[i + 2]), stof(tokens[i + 3]));
+                transform = glm::translate(glm::mat4(1.0f), offset) * transform;
+                i += 4;
+            } else {
+                LOG_ERROR(LogCategory::Loader, "Unknown instance operation " << operation);
+                return false;
+            }
+        }
+        setTransform(instance, transform);
+        updateInstanceBounds(instance, *mesh);
+        return true;
+    }
+}
+
+bool loadInstancedScene(const std::string &sceneFilename, InstancedScene &scene) {
+    std::ifstream file(sceneFilename);
+    if (!file.is_open()) {
+        LOG_ERROR(LogCategory::Loader, "Failed to open the scene file " << sceneFilename);
+        return false;
+    }
+    std::string directory = directoryOf(sceneFilename);
+    std::vector<std::vector<std::string>> instanceLines;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        auto tokens = split(line, ' ');
+        tokens.erase(std::remove(tokens.begin(), tokens.end(), ""), tokens.end());
+        if (tokens.empty() || tokens[0][0] == '#') continue;
+        if (tokens[0] == "mesh" && tokens.size() >= 4) {
+            if (!addMesh(scene, tokens[1], directory + tokens[2], directory + tokens[3])) {
+                LOG_ERROR(LogCategory::Loader, "Failed to load the mesh " << tokens[1] << " of " << sceneFilename);
+                return false;
+            }
+        } else if (tokens[0] == "instance" && tokens.size() >= 2) {
+            // read once all meshes are known, so a mesh may be declared after its first instance
+            instanceLines.push_back(tokens);
+        } else {
+            LOG_WARNING(LogCategory::Loader, "Ignoring the scene line " << line);
+        }
+    }
+    // the materials table has stopped growing, every mesh points at its final version
+    for (Mesh &mesh : scene.meshes) mesh.triangles.materials = &scene.materials;
+
+    uint32_t triangleCount = 0;
+    for (const auto &tokens : instanceLines) {
+        MeshInstance instance;
+        if (!parseInstance(scene, tokens, instance)) return false;
+        instance.firstTriangle = triangleCount;
+        triangleCount += uint32_t(scene.meshes[instance.mesh].triangles.size());
+        scene.instances.push_back(instance);
+    }
+    if (scene.instances.empty()) {
+        LOG_ERROR(LogCategory::Loader, "No instances in " << sceneFilename);
+        return false;
+    }
+
+    std::vector<glm::vec3> boundsMin, boundsMax;
+    instanceBounds(scene, boundsMin, boundsMax);
+    scene.instanceBVH = DynamicBVH(boundsMin, boundsMax, 1);
+    const BVHNode &root = scene.instanceBVH.tree().nodes[0];
+    scene.center = (root.boundsMin + root.boundsMax) * 0.5f;
+
+    size_t uniqueTriangles = 0;
+    for (const Mesh &mesh : scene.meshes) uniqueTriangles += mesh.triangles.size();
+    LOG_INFO(LogCategory::Loader, sceneFilename << ": " << scene.meshes.size() << " meshes with " << uniqueTriangles
+                                  << " triangles, " << scene.instances.size() << " instances with "
+                                  << triangleCount << " triangles");
+    return true;
+}
+
+InstancedScene &getInstancedScene(const std::string &sceneFilename) {
+    static std::map<std::string, InstancedScene> cache;
+    auto found = cache.find(sceneFilename);
+    if (found != cache.end()) return found->second;
+    // loaded in place, the meshes keep a pointer to the materials table of the scene
+    InstancedScene &scene = cache[sceneFilename];
+    if (!loadInstancedScene(sceneFilename, scene)) exit(1);
+    return scene;
+}
+
+void setInstanceTransform(InstancedScene &scene, uint32_t instanceIndex, const glm::mat4 &objectToWorld) {
+    MeshInstance &instance = scene.instances[instanceIndex];
+    setTransform(instance, objectToWorld);
+    updateInstanceBounds(instance, scene.meshes[instance.mesh]);
+    scene.areInstancesMoved = true;
+}
+
+void setMeshVertices(InstancedScene &scene, uint32_t meshIndex, const std::vector<TrianglePositions> &positions) {
+    Mesh &mesh = scene.meshes[meshIndex];
+    mesh.triangles.positions = positions;
+    for (size_t i = 0; i < positions.size(); i++) {
+        const std::array<glm::vec3, 3> &vertices = positions[i].vertices;
+        mesh.triangles.shading[i].normal = glm::normalize(glm::cross(vertices[1] - vertices[0], vertices[2] - vertices[0]));
+    }
+    mesh.isMoved = true;
+}
+
+void updateInstancedScene(InstancedScene &scene) {
+    std::vector<glm::vec3> boundsMin, boundsMax;
+    for (uint32_t meshIndex = 0; meshIndex < scene.meshes.size(); meshIndex++) {
+        Mesh &mesh = scene.meshes[meshIndex];
+        // also while nothing moves, so a rebuild that finished is swapped in
+        if (!mesh.isMoved && !mesh.bvh.isRebuilding()) continue;
+        computeTriangleBounds(mesh.triangles.positions, boundsMin, boundsMax);
+        mesh.bvh.update(boundsMin, boundsMax);
+        if (mesh.isMoved) {
+            for (MeshInstance &instance : scene.instances) {
+                if (instance.mesh == meshIndex) updateInstanceBounds(instance, mesh);
+            }
+            scene.areInstancesMoved = true;
+        }
+        mesh.isMoved = false;
+    }
+    if (scene.areInstancesMoved || scene.instanceBVH.isRebuilding()) {
+        instanceBounds(scene, boundsMin, boundsMax);
+        scene.instanceBVH.update(boundsMin, boundsMax);
+        scene.areInstancesMoved = false;
+    }
+}
+
+RayTriangleIntersection intersectInstancedScene(const InstancedScene &scene, const glm::vec3 &origin,
+                                                const glm::vec3 &direction) {
+    float closest = std::numeric_limits<float>::infinity();
+    const MeshInstance *closestInstance = nullptr;
+    ClosestTriangleHit hit;
+    traverseBVH(scene.instanceBVH.tree(), origin, direction, closest, [&](uint32_t instanceIndex, float &closestDistance) {
+        const MeshInstance &instance = scene.instances[instanceIndex];
+        const Mesh &mesh = scene.meshes[instance.mesh];
+        // the direction is not normalised again, so t along it is the same distance as along the world ray
+        glm::vec3 objectOrigin = glm::vec3(instance.worldToObject * glm::vec4(origin, 1.0f));
+        glm::vec3 objectDirection = glm::mat3(instance.worldToObject) * direction;
+        traverseBVH(mesh.bvh.tree(), objectOrigin, objectDirection, closestDistance, [&](uint32_t index, float &meshClosest) {
+            if (hit.test(objectOrigin, objectDirection, mesh.triangles.positions[index].vertices,
+                         instance.firstTriangle + index, meshClosest)) {
+                closestInstance = &instance;
+            }
+        });
+    });
+
+    RayTriangleIntersection closestIntersection;
+    closestIntersection.distanceFromCamera = std::numeric_limits<float>::infinity();
+    if (!closestInstance) return closestIntersection;
+    // only the triangle that was hit is moved into the world
+    uint32_t closestIndex = hit.sceneIndex - closestInstance->firstTriangle;
+    ModelTriangle triangle = scene.meshes[closestInstance->mesh].triangles[closestIndex].toModelTriangle();
+    for (glm::vec3 &vertex : triangle.vertices) vertex = glm::vec3(closestInstance->objectToWorld * glm::vec4(vertex, 1.0f));
+    triangle.normal = glm::normalize(closestInstance->normalToWorld * triangle.normal);
+    return RayTriangleIntersection(origin + closest * direction, closest, triangle, hit.sceneIndex, hit.u, hit.v);
+}
+
+void renderInstancedScene(DrawingWindow &window, const std::string &sceneFilename, float focalLength) {
+    InstancedScene &scene = getInstancedScene(sceneFilename);
+    updateInstancedScene(scene);
+    cameraOrientation = lookAt(scene.center);
+    const SceneLights &lights = getSceneLights(sceneFilename);
+    float ambientLight = 0.3f;  // ambient light intensity
+
+#if REDNOISE_LOGGING
+    auto start = std::chrono::steady_clock::now();
+#endif
+    renderFlatShadedRegion(window, wholeWindow(window), scene.materials, lights, ambientLight, focalLength,
+                           [&](const glm::vec3 &origin, const glm::vec3 &direction) {
+        return intersectInstancedScene(scene, origin, direction);
+    });
+    LOG_INFO(LogCategory::RayTrace, "Instanced frame of " << scene.instances.size() << " instances took "
+                                    << std::chrono::duration_cast<std::chrono::milliseconds>(
+                                            std::chrono::steady_clock::now() - start).count() << " ms, top level BVH at "
+                                    << scene.instanceBVH.costGrowth() << " times its built cost");
+}
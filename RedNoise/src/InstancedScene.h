@@ -0,0 +1,70 @@
+#ifndef REDNOISE_INSTANCEDSCENE_H
+#define REDNOISE_INSTANCEDSCENE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <DrawingWindow.h>
+#include "glm/glm.hpp"
+#include "BVH.h"
+#include "LoadFile.h"
+#include "SceneTriangles.h"
+
+// the triangles of one OBJ in its own space with a BVH over them, stored once however often it is placed
+struct Mesh {
+    std::string name;
+    SceneTriangles triangles;
+    DynamicBVH bvh;
+    bool isMoved = false;   // its vertices changed since the last updateInstancedScene
+};
+
+// a mesh placed in the world, only the transforms and the world bounds are stored per copy
+struct MeshInstance {
+    uint32_t mesh = 0;
+    glm::mat4 objectToWorld{1.0f};
+    glm::mat4 worldToObject{1.0f};
+    glm::mat3 normalToWorld{1.0f};
+    glm::vec3 boundsMin{};
+    glm::vec3 boundsMax{};
+    uint32_t firstTriangle = 0;   // scene wide index of its first triangle, the intersections report those indices
+};
+
+struct InstancedScene {
+    std::vector<Material> materials;   // the tables of all meshes one after another, the mesh material ids are remapped
+    std::vector<Mesh> meshes;
+    std::vector<MeshInstance> instances;
+    DynamicBVH instanceBVH;            // over the instance world bounds, one instance per leaf
+    glm::vec3 center{};                // of the instances where they were loaded, the camera looks at it
+    bool areInstancesMoved = false;    // an instance moved since the last updateInstancedScene
+};
+
+// reads a .scene file, paths are relative to the file and lines are
+//   mesh name model.obj materials.mtl
+//   instance name [scale s | scale x y z] [rotate x y z degrees] [translate x y z]
+// the operations of an instance are applied in the order they are written
+bool loadInstancedScene(const std::string &sceneFilename, InstancedScene &scene);
+
+// loaded and built the first time a scene is used
+InstancedScene &getInstancedScene(const std::string &sceneFilename);
+
+// moves an instance, the top level BVH follows at the next updateInstancedScene
+void setInstanceTransform(InstancedScene &scene, uint32_t instanceIndex, const glm::mat4 &objectToWorld);
+
+// new positions in its own space for the triangles of a mesh, in the same order, every instance of it changes shape
+void setMeshVertices(InstancedScene &scene, uint32_t meshIndex, const std::vector<TrianglePositions> &positions);
+
+// refits the BVHs of what moved since the last call and swaps in the ones rebuilt in the background, call it between
+// frames, renderInstancedScene does
+void updateInstancedScene(InstancedScene &scene);
+
+// the closest hit over all instances, the ray is moved into the space of every instance it reaches so the meshes are
+// never copied, the hit is reported with world space vertices and normal and triangleIndex counts the triangles in
+// instance order
+RayTriangleIntersection intersectInstancedScene(const InstancedScene &scene, const glm::vec3 &origin,
+                                                const glm::vec3 &direction);
+
+// flat shaded ray tracing with shadows like renderRayTracedScene, the lights come from the .lights file next to the
+// scene file, mirrors and glass are shaded as plain surfaces
+void renderInstancedScene(DrawingWindow &window, const std::string &sceneFilename, float focalLength);
+
+#endif //REDNOISE_INSTANCEDSCENE_H
@@ -1,11 +1,13 @@
 #include "Interpolate.h"
+#include <algorithm>
 
 // Single Element Numerical Interpolation
 // return a list of floats that are interpolated between the two floats
-std::vector<float> interpolateSingleFloats(float from,float to, int numberOfValues){
+ArenaVector<float> interpolateSingleFloats(float from,float to, int numberOfValues){
     int gap = numberOfValues - 1;
     float step = (to - from) / gap;
-    std::vector<float> result;
+    ArenaVector<float> result;
+    result.reserve(std::max(numberOfValues, 0));
     for (int i = 0; i < numberOfValues; i++){
         result.push_back(from + (step * i));
     }
@@ -13,8 +15,10 @@ std::vector<float> interpolateSingleFloats(float from,float to, int numberOfValu
 }
 
 // very important, this function is used to interpolate the canvas point
-std::vector<CanvasPoint> interpolateCanvasPoint(CanvasPoint from, CanvasPoint to, int numberOfValues){
-    std :: vector<CanvasPoint> result;
+ArenaVector<CanvasPoint> interpolateCanvasPoint(CanvasPoint from, CanvasPoint to, int numberOfValues){
+    ArenaVector<CanvasPoint> result;
+    // one block from the arena instead of one per doubling
+    result.reserve(std::max(numberOfValues, 1));
     if (numberOfValues <= 1) {
         result.push_back(from);
         return result;
@@ -58,8 +62,9 @@ std::vector<glm::vec3> interpolateTripleFloats(glm::vec3 from, glm::vec3 to, int
 void drawTheGreyScale(DrawingWindow &window) {
     window.clearPixels();
     for (size_t y = 0; y < window.height; y++) {
+        ArenaScope row;
         // Interpolate the grey values for this row.
-        std::vector<float> greyValues = interpolateSingleFloats(255.0, 0.0, window.width);
+        ArenaVector<float> greyValues = interpolateSingleFloats(255.0, 0.0, window.width);
         for (size_t x = 0; x < window.width; x++) {
             // Use the interpolated grey value for R, G, and B channels.
             float grey = greyValues[x];
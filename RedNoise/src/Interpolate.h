@@ -6,8 +6,11 @@
 #include "CanvasPoint.h"
 #include "Colour.h"
 #include "CanvasTriangle.h"
+#include "FrameArena.h"
 
-std::vector<float> interpolateSingleFloats(float from,float to, int numberOfValues);
+// the interpolated lists live in the thread's frame arena, the rasteriser asks for a few per scanline and frees them
+// with an ArenaScope, so drawing a frame does not go to the heap for them
+ArenaVector<float> interpolateSingleFloats(float from,float to, int numberOfValues);
 
 std::vector<glm::vec3> interpolateTripleFloats(glm::vec3 from, glm::vec3 to, int numberOfValues);
 
@@ -20,7 +23,7 @@ void drawLineInterpolation(DrawingWindow &window, CanvasPoint from, CanvasPoint
 
 void drawTriangle(DrawingWindow &window, CanvasTriangle triangle, Colour colour);
 
-std::vector<CanvasPoint> interpolateCanvasPoint(CanvasPoint from, CanvasPoint to, int numberOfValues);
+ArenaVector<CanvasPoint> interpolateCanvasPoint(CanvasPoint from, CanvasPoint to, int numberOfValues);
 
 //void drawLine(DrawingWindow &window, CanvasPoint from, CanvasPoint to, Colour colour);
 
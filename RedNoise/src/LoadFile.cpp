@@ -1,5 +1,9 @@
 #include "LoadFile.h"
 #include "Globals.h"
+#include "Log.h"
+#include "MeshImport.h"
+#include <limits>
+#include <sstream>
 
 
 
@@ -9,48 +13,90 @@
 std::map<glm::vec3, std::vector<glm::vec3>, Vec3Comparator> vertexPlaneNormals;
 
 
-// return a hashmap from material name to colour
-// MaterialProperties is a struct that contains colour, isMirror and isGlass
-std::map<std::string, MaterialProperties> loadMaterials(const std::string& filename) {
-    // Map from material name to the material properties.
-    std::map<std::string, MaterialProperties> materials;
+// return the material table, a triangle only stores the index of its material
+std::vector<Material> loadMaterials(const std::string& filename) {
+    // material 0 is the default, black and neither a mirror nor glass
+    // a binary PLY or glTF mesh brings its own materials
+    if (isImportedMesh(filename)) return importMaterials(filename);
+    std::vector<Material> materials(1);
     std::ifstream file(filename);
 
     if (!file.is_open()) {
-        std::cerr << "Failed to open the .mtl file!" << std::endl;
+        LOG_ERROR(LogCategory::Loader, "Failed to open the .mtl file " << filename);
         return materials;
     }
 
     std::string line;
-    std::string currentMaterialName;
-    Colour currentColour;
-    bool isMirror = false;
-    bool isGlass = false;
+    std::vector<std::string> tokens;
     while (std::getline(file, line)) {
-        auto tokens = split(line, ' ');
+        split(line, ' ', tokens);
         if (tokens[0] == "newmtl") {
-            currentMaterialName = tokens[1];
-            // here is very crucial!
-            isMirror = false;  // Reset for each new material
-            isGlass = false;
+            if (materials.size() > std::numeric_limits<uint16_t>::max()) {
+                LOG_ERROR(LogCategory::Loader, "Too many materials in " << filename << ", ignoring " << tokens[1]);
+                break;
+            }
+            // every new material starts from the defaults, so the keys below can come in any order
+            materials.push_back(Material());
+            materials.back().name = tokens[1];
+        } else if (materials.size() == 1) {
+            continue;   // nothing before the first newmtl belongs to a material
         } else if (tokens[0] == "mirror") {
-            isMirror = tokens[1] == "1";  // if mirror is 1, then it is a mirror
-            // in the mtl file we must make sure that the mirror is before Kd
+            materials.back().isMirror = tokens[1] == "1";  // if mirror is 1, then it is a mirror
         }else if(tokens[0] == "glass"){
-            isGlass = tokens[1] == "1";
+            materials.back().isGlass = tokens[1] == "1";
+        }else if(tokens[0] == "Ni"){
+            materials.back().indexOfRefraction = std::stof(tokens[1]);
+        }else if(tokens[0] == "reflectivity"){
+            materials.back().reflectivity = glm::clamp(std::stof(tokens[1]), 0.0f, 1.0f);
         }else if (tokens[0] == "Kd"){
             float r, g, b;
             r = std::stof(tokens[1]);
             g = std::stof(tokens[2]);
             b = std::stof(tokens[3]);
-            currentColour = Colour(currentMaterialName, r * 255, g * 255, b * 255);
-            materials[currentMaterialName] = MaterialProperties{currentColour, isMirror, isGlass};
+            materials.back().colour = Colour(materials.back().name, r * 255, g * 255, b * 255);
         }
     }
     return materials;
 }
 
+namespace {
+    // a map, so the tables stay where they are while others are added
+    std::map<std::string, std::vector<Material>> &materialCache() {
+        static std::map<std::string, std::vector<Material>> cache;
+        return cache;
+    }
+}
+
+const std::vector<Material> &getMaterials(const std::string& filename) {
+    std::map<std::string, std::vector<Material>> &cache = materialCache();
+    auto found = cache.find(filename);
+    if (found == cache.end()) found = cache.emplace(filename, loadMaterials(filename)).first;
+    return found->second;
+}
+
+void storeMaterials(const std::string& filename, std::vector<Material> materials) {
+    materialCache().emplace(filename, std::move(materials));
+}
+
+const std::vector<ModelTriangle> &getModel(const std::string& filename, float scalingFactor, const std::string& materialName) {
+    static std::map<std::string, std::vector<ModelTriangle>> cache;
+    std::ostringstream key;
+    key << std::hexfloat << filename << "|" << scalingFactor << "|" << materialName;
+    auto found = cache.find(key.str());
+    if (found == cache.end()) found = cache.emplace(key.str(), loadOBJ(filename, scalingFactor, materialName)).first;
+    return found->second;
+}
+
+uint16_t findMaterial(const std::vector<Material> &materials, const std::string &name) {
+    for (size_t i = 1; i < materials.size(); i++) {
+        if (materials[i].name == name) return uint16_t(i);
+    }
+    return 0;
+}
+
 std::vector<ModelTriangle> loadOBJ(const std::string& filename, float scalingFactor, const std::string& materialName) {
+    // binary PLY and glTF meshes go to the importers, they come back as the same triangles
+    if (isImportedMesh(filename)) return importMesh(filename, scalingFactor, materialName);
     std::vector<ModelTriangle> triangles;
     std::vector<glm::vec3> vertices;
     std::vector<TexturePoint> texturePoints;
@@ -58,20 +104,22 @@ std::vector<ModelTriangle> loadOBJ(const std::string& filename, float scalingFac
     // Open the file.
     std::ifstream file(filename);
     if (!file.is_open()) {
-        std::cerr << "Failed to open the file!" << std::endl;
+        LOG_ERROR(LogCategory::Loader, "Failed to open the file " << filename);
         return triangles;
     }
-    // Load the materials from the .mtl file.
-    std::map<std::string, MaterialProperties> materialsProperties = loadMaterials(materialName);
-    MaterialProperties currentMaterialProps;
-//    Colour currentColour;
+    // Load the materials from the .mtl file, the triangles keep the index of theirs
+    const std::vector<Material> &materials = getMaterials(materialName);
+    uint16_t currentMaterial = 0;
     std::string line;
+    // reused for every line, so parsing a big model does not allocate per line
+    std::vector<std::string> tokens;
+    std::vector<std::string> vertexTexturePair;
     while (std::getline(file, line)) {
         // Tokenize the line for easier parsing.
-        auto tokens = split(line, ' ');
+        split(line, ' ', tokens);
 
         if (tokens[0] == "usemtl") {
-            currentMaterialProps = materialsProperties[tokens[1]];
+            currentMaterial = findMaterial(materials, tokens[1]);
         } else if (tokens[0] == "v") {
             // Check if line starts with 'v' (vertex).
             // stof converts a string to a float.
@@ -86,12 +134,14 @@ std::vector<ModelTriangle> loadOBJ(const std::string& filename, float scalingFac
         } else if (tokens[0] == "f") {
             std::array<glm::vec3, 3> triangleVertices;          // store the vertices of the triangle
             std::array<TexturePoint, 3> triangleTexturePoints;  // store the texture points of three vertices of the triangle
+            std::array<uint32_t, 3> triangleVertexIndices;      // so the vertex lighting can be looked up per vertex
 
             // construct each triangle
             for (int i = 0; i < 3; i++) {
-                std::vector<std::string> vertexTexturePair = split(tokens[i + 1], '/');
+                split(tokens[i + 1], '/', vertexTexturePair);
                 int vertexIndex = stoi(vertexTexturePair[0]) - 1;  // OBJ index starts from 1
                 triangleVertices[i] = vertices[vertexIndex];
+                triangleVertexIndices[i] = uint32_t(vertexIndex);
 
                 // if this vertex has a texture coordinate
                 if (vertexTexturePair.size() > 1 && !vertexTexturePair[1].empty()) {
@@ -106,11 +156,10 @@ std::vector<ModelTriangle> loadOBJ(const std::string& filename, float scalingFac
             glm::vec3 normal = glm::normalize(glm::cross(edge1, edge2));
 
             // create a triangle and set its properties
-            ModelTriangle triangle(triangleVertices[0], triangleVertices[1], triangleVertices[2], currentMaterialProps.colour);
+            ModelTriangle triangle(triangleVertices[0], triangleVertices[1], triangleVertices[2], currentMaterial);
             triangle.texturePoints = triangleTexturePoints;
+            triangle.vertexIndices = triangleVertexIndices;
             triangle.normal = normal;
-            triangle.isMirror = currentMaterialProps.isMirror;
-            triangle.isGlass = currentMaterialProps.isGlass;
             triangles.push_back(triangle);
         }
     }
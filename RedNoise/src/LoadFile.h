@@ -12,13 +12,30 @@
 #include<iostream>
 #include <Utils.h>
 
-struct MaterialProperties {
+// one entry of a scene's material table, triangles refer to it by its index
+struct Material {
+    std::string name;
     Colour colour;
-    bool isMirror;
-    bool isGlass;
+    bool isMirror = false;
+    bool isGlass = false;
+    float indexOfRefraction = 1.3f;   // Ni, a ray entering the glass bends by this and a ray leaving by its inverse,
+                                      // glass without an Ni line keeps the 1.3 every glass had before the table
+    float reflectivity = 1.0f;        // how much of a mirror is the reflection, the rest is its own shaded colour
 };
 
-std::map<std::string, MaterialProperties> loadMaterials(const std::string& filename);
+// the materials in the order of the .mtl file after material 0, the black default that faces before the first usemtl
+// or with an unknown material get, a .ply, .glb or .gltf mesh gives its own materials, see importMaterials
+std::vector<Material> loadMaterials(const std::string& filename);
+// loadMaterials once per .mtl file, the renderers hold on to the table for the whole frame
+const std::vector<Material> &getMaterials(const std::string& filename);
+// gives getMaterials the table of filename when it was built anyway, importMesh does this so a mesh is not read a
+// second time for its materials, a table getMaterials already has stays as it is
+void storeMaterials(const std::string& filename, std::vector<Material> materials);
+// the index of the material called name, 0 when there is none
+uint16_t findMaterial(const std::vector<Material> &materials, const std::string &name);
 
+// binary PLY and glTF files are read by importMesh instead, so every renderer takes them in place of an OBJ
 std::vector<ModelTriangle> loadOBJ(const std::string& filename, float scalingFactor, const std::string& materialName);
+// loadOBJ once per file, scale and material table, for the renderers that draw the same scene every frame
+const std::vector<ModelTriangle> &getModel(const std::string& filename, float scalingFactor, const std::string& materialName);
 #endif //REDNOISE_LOADFILE_H
@@ -0,0 +1,1364 @@
+#include "MeshImport.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include "Globals.h"
+#include "Log.h"
+#include "Parallel.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string &filename) {
+#ifndef _WIN32
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat status{};
+    if (fstat(fd, &status) == 0 && status.st_size > 0) {
+        void *mapped = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            // the importers go through the buffers front to back, so the kernel can read well ahead of them
+            madvise(mapped, size_t(status.st_size), MADV_SEQUENTIAL);
+            bytes = static_cast<const uint8_t *>(mapped);
+            length = size_t(status.st_size);
+            opened = true;
+            isMapped = true;
+        }
+    }
+    close(fd);
+    if (isMapped) return;
+#endif
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return;
+    copy.resize(size_t(file.tellg()));
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char *>(copy.data()), std::streamsize(copy.size()))) return;
+    bytes = copy.data();
+    length = copy.size();
+    opened = true;
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (isMapped) munmap(const_cast<uint8_t *>(bytes), length);
+#endif
+}
+
+namespace {
+    std::string extensionOf(const std::string &filename) {
+        size_t dot = filename.find_last_of('.');
+        size_t slash = filename.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return "";
+        std::string extension = filename.substr(dot + 1);
+        for (char &c : extension) c = char(std::tolower(static_cast<unsigned char>(c)));
+        return extension;
+    }
+
+    bool isHostLittleEndian() {
+        const uint16_t one = 1;
+        uint8_t first;
+        std::memcpy(&first, &one, 1);
+        return first == 1;
+    }
+
+    // a value of the file, which need not be aligned and may be in the other byte order
+    template <typename T>
+    T readValue(const uint8_t *at, bool isSwapped) {
+        uint8_t raw[sizeof(T)];
+        std::memcpy(raw, at, sizeof(T));
+        if (isSwapped) std::reverse(raw, raw + sizeof(T));
+        T value;
+        std::memcpy(&value, raw, sizeof(T));
+        return value;
+    }
+
+    ModelTriangle makeTriangle(const std::vector<glm::vec3> &positions, const std::vector<TexturePoint> &texturePoints,
+                               const std::array<uint32_t, 3> &corners, uint32_t firstIndex, uint16_t material) {
+        ModelTriangle triangle(positions[corners[0]], positions[corners[1]], positions[corners[2]], material);
+        for (int i = 0; i < 3; i++) {
+            if (!texturePoints.empty()) triangle.texturePoints[i] = texturePoints[corners[i]];
+            triangle.vertexIndices[i] = firstIndex + corners[i];
+        }
+        triangle.normal = glm::normalize(glm::cross(triangle.vertices[1] - triangle.vertices[0],
+                                                    triangle.vertices[2] - triangle.vertices[0]));
+        return triangle;
+    }
+
+    // the corners that are at the same position share the sum of their normals, like loadOBJ's, the list is sorted
+    // and goes in from the back, so every one lands right before the one inserted last instead of being searched for
+    // from the top of the map
+    void storeVertexNormals(std::vector<std::pair<glm::vec3, glm::vec3>> &normals) {
+        if (normals.empty()) return;
+        Vec3Comparator isLess;
+        auto byPosition = [&isLess](const std::pair<glm::vec3, glm::vec3> &a, const std::pair<glm::vec3, glm::vec3> &b) {
+            return isLess(a.first, b.first);
+        };
+        // a run per worker sorted side by side, then merged pairwise
+        size_t runs = workerThreadCount();
+        auto runStart = [&](size_t run) { return normals.begin() + std::min(run, runs) * normals.size() / runs; };
+        parallelFor(runs, [&](size_t begin, size_t end) {
+            for (size_t run = begin; run < end; run++) std::sort(runStart(run), runStart(run + 1), byPosition);
+        });
+        for (size_t width = 1; width < runs; width *= 2) {
+            parallelFor((runs + 2 * width - 1) / (2 * width), [&](size_t begin, size_t end) {
+                for (size_t pair = begin; pair < end; pair++) {
+                    size_t first = 2 * width * pair;
+                    std::inplace_merge(runStart(first), runStart(first + width), runStart(first + 2 * width), byPosition);
+                }
+            });
+        }
+        auto hint = vertexNormals.upper_bound(normals.back().first);
+        for (size_t i = normals.size(); i > 0;) {
+            glm::vec3 sum = normals[--i].second;
+            while (i > 0 && normals[i - 1].first == normals[i].first) sum += normals[--i].second;
+            if (sum == glm::vec3(0.0f)) continue;
+            hint = vertexNormals.emplace_hint(hint, normals[i].first, glm::vec3(0.0f));
+            hint->second = glm::normalize(sum);
+        }
+    }
+
+    // vertexNormals for the corners of the triangles from firstTriangle on, the average of the normals of the faces
+    // around each vertex like loadOBJ, summed per vertex index instead of collected per position first
+    void addVertexNormals(const std::vector<glm::vec3> &positions, const std::vector<ModelTriangle> &triangles,
+                          size_t firstTriangle, uint32_t firstIndex) {
+        std::vector<glm::vec3> sums(positions.size(), glm::vec3(0.0f));
+        for (size_t i = firstTriangle; i < triangles.size(); i++) {
+            const ModelTriangle &triangle = triangles[i];
+            if (!std::isfinite(triangle.normal.x)) continue;   // a degenerate triangle has no normal
+            for (uint32_t index : triangle.vertexIndices) sums[index - firstIndex] += triangle.normal;
+        }
+        std::vector<std::pair<glm::vec3, glm::vec3>> normals;
+        normals.reserve(positions.size());
+        for (size_t i = 0; i < positions.size(); i++) {
+            if (sums[i] != glm::vec3(0.0f)) normals.emplace_back(positions[i], sums[i]);
+        }
+        storeVertexNormals(normals);
+    }
+
+    // corner(i, k) is corner k of triangle i, an index past the vertices (or a face that is not a triangle) counts
+    template <typename Corner>
+    size_t countBadTriangles(size_t count, size_t vertexCount, const Corner &corner) {
+        std::atomic<size_t> bad{0};
+        parallelFor(count, [&](size_t begin, size_t end) {
+            size_t found = 0;
+            for (size_t i = begin; i < end; i++) {
+                if (corner(i, 0) >= vertexCount || corner(i, 1) >= vertexCount || corner(i, 2) >= vertexCount) found++;
+            }
+            bad += found;
+        });
+        return bad;
+    }
+
+    // the triangles of corners countBadTriangles found nothing wrong with, made on every core, materialOf(i, first)
+    // is the material of triangle i whose first corner is first
+    template <typename Corner, typename MaterialOf>
+    void appendTriangles(std::vector<ModelTriangle> &triangles, size_t count, const Corner &corner,
+                         const std::vector<glm::vec3> &positions, const std::vector<TexturePoint> &texturePoints,
+                         const MaterialOf &materialOf, uint32_t firstIndex) {
+        size_t first = triangles.size();
+        triangles.resize(first + count);
+        parallelFor(count, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                std::array<uint32_t, 3> corners = {{corner(i, 0), corner(i, 1), corner(i, 2)}};
+                triangles[first + i] = makeTriangle(positions, texturePoints, corners, firstIndex, materialOf(i, corners[0]));
+            }
+        });
+    }
+
+    // the index of each of the file's own materials in the table of materialName, the same index when that is the file
+    std::vector<uint16_t> resolveMaterials(const std::vector<Material> &own, const std::string &filename,
+                                           const std::string &materialName) {
+        std::vector<uint16_t> ids(own.size(), 0);
+        if (materialName == filename) {
+            for (size_t i = 0; i < own.size(); i++) ids[i] = uint16_t(i);
+            return ids;
+        }
+        const std::vector<Material> &materials = getMaterials(materialName);
+        for (size_t i = 1; i < own.size(); i++) ids[i] = findMaterial(materials, own[i].name);
+        return ids;
+    }
+
+    const size_t maxMaterials = std::numeric_limits<uint16_t>::max();
+
+    // ---- PLY ----
+
+    enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, None };
+
+    PlyType parsePlyType(const std::string &name) {
+        if (name == "char" || name == "int8") return PlyType::Int8;
+        if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+        if (name == "short" || name == "int16") return PlyType::Int16;
+        if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+        if (name == "int" || name == "int32") return PlyType::Int32;
+        if (name == "uint" || name == "uint32") return PlyType::UInt32;
+        if (name == "float" || name == "float32") return PlyType::Float32;
+        if (name == "double" || name == "float64") return PlyType::Float64;
+        return PlyType::None;
+    }
+
+    size_t plyTypeSize(PlyType type) {
+        switch (type) {
+            case PlyType::Int8: case PlyType::UInt8: return 1;
+            case PlyType::Int16: case PlyType::UInt16: return 2;
+            case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+            case PlyType::Float64: return 8;
+            default: return 0;
+        }
+    }
+
+    double readPlyValue(const uint8_t *at, PlyType type, bool isSwapped) {
+        switch (type) {
+            case PlyType::Int8: return readValue<int8_t>(at, isSwapped);
+            case PlyType::UInt8: return readValue<uint8_t>(at, isSwapped);
+            case PlyType::Int16: return readValue<int16_t>(at, isSwapped);
+            case PlyType::UInt16: return readValue<uint16_t>(at, isSwapped);
+            case PlyType::Int32: return readValue<int32_t>(at, isSwapped);
+            case PlyType::UInt32: return readValue<uint32_t>(at, isSwapped);
+            case PlyType::Float32: return readValue<float>(at, isSwapped);
+            case PlyType::Float64: return readValue<double>(at, isSwapped);
+            default: return 0.0;
+        }
+    }
+
+    struct PlyProperty {
+        std::string name;
+        PlyType type = PlyType::None;
+        PlyType countType = PlyType::None;   // only a list has one, type is then the type of its items
+
+        bool isList() const { return countType != PlyType::None; }
+    };
+
+    struct PlyElement {
+        std::string name;
+        size_t count = 0;
+        std::vector<PlyProperty> properties;
+
+        // the position of the first property with one of the names, -1 when there is none
+        int find(std::initializer_list<const char *> names) const {
+            for (const char *name : names) {
+                for (size_t i = 0; i < properties.size(); i++) {
+                    if (properties[i].name == name) return int(i);
+                }
+            }
+            return -1;
+        }
+        // the bytes of one of them, 0 when they hold a list and so differ in size
+        size_t stride() const {
+            size_t size = 0;
+            for (const PlyProperty &property : properties) {
+                if (property.isList()) return 0;
+                size += plyTypeSize(property.type);
+            }
+            return size;
+        }
+    };
+
+    // the elements follow the header in the order it lists them, each one's records back to back
+    struct PlyHeader {
+        std::vector<PlyElement> elements;
+        bool isSwapped = false;
+        size_t bodyOffset = 0;
+    };
+
+    bool readPlyHeader(const MappedFile &file, const std::string &filename, PlyHeader &header) {
+        const char *text = reinterpret_cast<const char *>(file.data());
+        const char *textEnd = text + file.size();
+        static const char endMarker[] = "end_header";
+        const char *headerEnd = std::search(text, textEnd, endMarker, endMarker + sizeof(endMarker) - 1);
+        const char *bodyStart = std::find(headerEnd, textEnd, '\n');
+        if (file.size() < 3 || std::memcmp(text, "ply", 3) != 0 || bodyStart == textEnd) {
+            LOG_ERROR(LogCategory::Loader, filename << " is not a PLY file");
+            return false;
+        }
+        header.bodyOffset = size_t(bodyStart + 1 - text);
+
+        std::istringstream lines(std::string(text, headerEnd));
+        std::string line;
+        std::vector<std::string> tokens;
+        bool hasFormat = false;
+        while (std::getline(lines, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            split(line, ' ', tokens);
+            tokens.erase(std::remove(tokens.begin(), tokens.end(), std::string()), tokens.end());
+            if (tokens.empty()) continue;
+            if (tokens[0] == "format" && tokens.size() > 1) {
+                if (tokens[1] == "binary_little_endian") {
+                    header.isSwapped = !isHostLittleEndian();
+                } else if (tokens[1] == "binary_big_endian") {
+                    header.isSwapped = isHostLittleEndian();
+                } else {
+                    LOG_ERROR(LogCategory::Loader, "Only binary PLY files are imported, " << filename << " is " << tokens[1]);
+                    return false;
+                }
+                hasFormat = true;
+            } else if (tokens[0] == "element") {
+                char *countEnd = nullptr;
+                unsigned long long count = 0;
+                if (tokens.size() > 2 && std::isdigit(static_cast<unsigned char>(tokens[2][0]))) {
+                    count = std::strtoull(tokens[2].c_str(), &countEnd, 10);
+                }
+                if (!countEnd || *countEnd != '\0') {
+                    LOG_ERROR(LogCategory::Loader, "Bad element line in " << filename << ": " << line);
+                    return false;
+                }
+                header.elements.push_back(PlyElement());
+                header.elements.back().name = tokens[1];
+                header.elements.back().count = size_t(count);
+            } else if (tokens[0] == "property" && !header.elements.empty()) {
+                PlyProperty property;
+                if (tokens.size() > 4 && tokens[1] == "list") {
+                    property.countType = parsePlyType(tokens[2]);
+                    property.type = parsePlyType(tokens[3]);
+                    property.name = tokens[4];
+                    if (property.countType == PlyType::None) property.type = PlyType::None;
+                } else if (tokens.size() > 2) {
+                    property.type = parsePlyType(tokens[1]);
+                    property.name = tokens[2];
+                }
+                if (property.type == PlyType::None) {
+                    LOG_ERROR(LogCategory::Loader, "Unknown property in " << filename << ": " << line);
+                    return false;
+                }
+                header.elements.back().properties.push_back(property);
+            }
+        }
+        if (!hasFormat) {
+            LOG_ERROR(LogCategory::Loader, filename << " has no format line");
+            return false;
+        }
+        return true;
+    }
+
+    // past the records of an element, null when they run over the end of the file
+    const uint8_t *skipPlyElement(const PlyElement &element, const uint8_t *at, const uint8_t *end, bool isSwapped) {
+        size_t stride = element.stride();
+        if (stride > 0) {
+            if (element.count > size_t(end - at) / stride) return nullptr;
+            return at + element.count * stride;
+        }
+        for (size_t i = 0; i < element.count; i++) {
+            for (const PlyProperty &property : element.properties) {
+                size_t size = plyTypeSize(property.isList() ? property.countType : property.type);
+                if (size_t(end - at) < size) return nullptr;
+                if (!property.isList()) {
+                    at += size;
+                    continue;
+                }
+                double count = readPlyValue(at, property.countType, isSwapped);
+                at += size;
+                size_t itemSize = plyTypeSize(property.type);
+                if (count < 0.0 || count > double(size_t(end - at) / itemSize)) return nullptr;
+                at += size_t(count) * itemSize;
+            }
+        }
+        return at;
+    }
+
+    // a colour property as 0 to 255, floats go from 0 to 1
+    int readPlyColour(const uint8_t *at, PlyType type, bool isSwapped) {
+        double value = readPlyValue(at, type, isSwapped);
+        if (type == PlyType::Float32 || type == PlyType::Float64) value *= 255.0;
+        else if (type == PlyType::UInt16) value /= 257.0;
+        return int(glm::clamp(value, 0.0, 255.0));
+    }
+
+    // the colours become materials 1 onwards in the order they first come up, the same order every time the file is
+    // read, so the table importMaterials makes matches the ids importMesh gives the faces
+    class PlyColourMaterials {
+    public:
+        explicit PlyColourMaterials(std::vector<Material> &materials) : materials(materials) {}
+
+        uint16_t find(int red, int green, int blue) {
+            uint32_t key = uint32_t(red) << 16 | uint32_t(green) << 8 | uint32_t(blue);
+            auto found = ids.find(key);
+            if (found != ids.end()) return found->second;
+            // 2^24 colours do not fit 16 bit ids, the ones over go to the first
+            if (materials.size() >= maxMaterials) return 1;
+            char name[16];
+            std::snprintf(name, sizeof(name), "ply_%02x%02x%02x", red, green, blue);
+            Material material;
+            material.name = name;
+            material.colour = Colour(name, red, green, blue);
+            materials.push_back(material);
+            ids.emplace(key, uint16_t(materials.size() - 1));
+            return uint16_t(materials.size() - 1);
+        }
+
+    private:
+        std::vector<Material> &materials;
+        std::unordered_map<uint32_t, uint16_t> ids;
+    };
+
+    const uint8_t *readPlyVertices(const PlyElement &element, const uint8_t *at, const uint8_t *end, bool isSwapped,
+                                   float scalingFactor, std::vector<glm::vec3> &positions,
+                                   std::vector<TexturePoint> &texturePoints, std::vector<uint16_t> *vertexMaterials,
+                                   PlyColourMaterials &colours, const std::string &filename) {
+        size_t stride = element.stride();
+        int x = element.find({"x"}), y = element.find({"y"}), z = element.find({"z"});
+        int u = element.find({"u", "s", "texture_u"}), v = element.find({"v", "t", "texture_v"});
+        int red = element.find({"red", "diffuse_red"}), green = element.find({"green", "diffuse_green"});
+        int blue = element.find({"blue", "diffuse_blue"});
+        if (stride == 0 || x < 0 || y < 0 || z < 0) {
+            LOG_ERROR(LogCategory::Loader, "The vertices of " << filename << " need x, y and z and no lists");
+            return nullptr;
+        }
+        if (element.count > size_t(end - at) / stride) return nullptr;
+        std::vector<size_t> offsets(element.properties.size(), 0);
+        for (size_t i = 1; i < offsets.size(); i++) offsets[i] = offsets[i - 1] + plyTypeSize(element.properties[i - 1].type);
+        auto read = [&](const uint8_t *record, int property) {
+            return float(readPlyValue(record + offsets[property], element.properties[property].type, isSwapped));
+        };
+
+        positions.resize(element.count);
+        if (u >= 0 && v >= 0) texturePoints.resize(element.count);
+        bool hasColours = vertexMaterials != nullptr && red >= 0 && green >= 0 && blue >= 0;
+        if (hasColours) vertexMaterials->resize(element.count);
+        parallelFor(element.count, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const uint8_t *record = at + i * stride;
+                positions[i] = glm::vec3(read(record, x), read(record, y), read(record, z)) * scalingFactor;
+                if (!texturePoints.empty()) texturePoints[i] = TexturePoint(read(record, u), read(record, v));
+            }
+        });
+        // in file order, the material ids follow the order the colours first come up in
+        for (size_t i = 0; hasColours && i < element.count; i++) {
+            const uint8_t *record = at + i * stride;
+            (*vertexMaterials)[i] = colours.find(
+                    readPlyColour(record + offsets[red], element.properties[red].type, isSwapped),
+                    readPlyColour(record + offsets[green], element.properties[green].type, isSwapped),
+                    readPlyColour(record + offsets[blue], element.properties[blue].type, isSwapped));
+        }
+        return at + element.count * stride;
+    }
+
+    // walks the faces, each one a fan of triangles around its first corner, triangles is null when only the colours
+    // of the faces are wanted
+    const uint8_t *readPlyFaces(const PlyElement &element, const uint8_t *at, const uint8_t *end, bool isSwapped,
+                                const std::vector<glm::vec3> &positions, const std::vector<TexturePoint> &texturePoints,
+                                const std::vector<uint16_t> &vertexMaterials, bool hasFaceColours,
+                                PlyColourMaterials &colours, std::vector<ModelTriangle> *triangles,
+                                const std::string &filename) {
+        int indices = element.find({"vertex_indices", "vertex_index"});
+        int red = element.find({"red", "diffuse_red"}), green = element.find({"green", "diffuse_green"});
+        int blue = element.find({"blue", "diffuse_blue"});
+        if (indices < 0 || !element.properties[indices].isList()) {
+            LOG_ERROR(LogCategory::Loader, "The faces of " << filename << " have no vertex_indices list");
+            return nullptr;
+        }
+        // the faces of most files are nothing but triangles with 32 bit indices and maybe a colour, then every record
+        // is as long as the next and they are made on every core straight out of the file
+        const PlyProperty &list = element.properties[indices];
+        size_t countSize = plyTypeSize(list.countType);
+        bool isFixedSize = plyTypeSize(list.type) == sizeof(uint32_t) && list.type != PlyType::Float32;
+        std::vector<size_t> offsets(element.properties.size(), 0);
+        size_t stride = 0;
+        for (size_t p = 0; p < element.properties.size(); p++) {
+            offsets[p] = stride;
+            if (int(p) == indices) stride += countSize + 3 * sizeof(uint32_t);
+            else if (element.properties[p].isList()) isFixedSize = false;
+            else stride += plyTypeSize(element.properties[p].type);
+        }
+        if (isFixedSize && element.count <= size_t(end - at) / stride) {
+            // a face that is not a triangle throws the records after it out of step, but is itself found
+            auto corner = [&](size_t face, int k) -> uint32_t {
+                const uint8_t *record = at + face * stride + offsets[indices];
+                if (readPlyValue(record, list.countType, isSwapped) != 3.0) return std::numeric_limits<uint32_t>::max();
+                return readValue<uint32_t>(record + countSize + k * sizeof(uint32_t), isSwapped);
+            };
+            if (countBadTriangles(element.count, positions.size(), corner) == 0) {
+                std::vector<uint16_t> faceMaterials;
+                if (hasFaceColours) {
+                    std::vector<uint32_t> faceColours(element.count);
+                    parallelFor(element.count, [&](size_t begin, size_t end) {
+                        for (size_t face = begin; face < end; face++) {
+                            const uint8_t *record = at + face * stride;
+                            faceColours[face] =
+                                    uint32_t(readPlyColour(record + offsets[red], element.properties[red].type, isSwapped)) << 16 |
+                                    uint32_t(readPlyColour(record + offsets[green], element.properties[green].type, isSwapped)) << 8 |
+                                    uint32_t(readPlyColour(record + offsets[blue], element.properties[blue].type, isSwapped));
+                        }
+                    });
+                    // in file order, the material ids follow the order the colours first come up in, neighbouring
+                    // faces mostly share theirs
+                    faceMaterials.resize(element.count);
+                    uint32_t lastColour = std::numeric_limits<uint32_t>::max();
+                    uint16_t lastMaterial = 0;
+                    for (size_t face = 0; face < element.count; face++) {
+                        if (faceColours[face] != lastColour) {
+                            lastColour = faceColours[face];
+                            lastMaterial = colours.find(int(lastColour >> 16), int(lastColour >> 8 & 0xff),
+                                                        int(lastColour & 0xff));
+                        }
+                        faceMaterials[face] = lastMaterial;
+                    }
+                }
+                if (triangles != nullptr) {
+                    appendTriangles(*triangles, element.count, corner, positions, texturePoints,
+                                    [&](size_t face, uint32_t first) -> uint16_t {
+                        if (!faceMaterials.empty()) return faceMaterials[face];
+                        return vertexMaterials.empty() ? 1 : vertexMaterials[first];
+                    }, 0);
+                }
+                return at + element.count * stride;
+            }
+        }
+
+        if (triangles != nullptr) triangles->reserve(triangles->size() + element.count);
+        std::vector<uint32_t> corners;
+        size_t skippedFaces = 0;
+        for (size_t face = 0; face < element.count; face++) {
+            corners.clear();
+            bool isValid = true;
+            int colour[3] = {0, 0, 0};
+            for (size_t p = 0; p < element.properties.size(); p++) {
+                const PlyProperty &property = element.properties[p];
+                size_t size = plyTypeSize(property.isList() ? property.countType : property.type);
+                if (size_t(end - at) < size) return nullptr;
+                if (!property.isList()) {
+                    if (int(p) == red) colour[0] = readPlyColour(at, property.type, isSwapped);
+                    if (int(p) == green) colour[1] = readPlyColour(at, property.type, isSwapped);
+                    if (int(p) == blue) colour[2] = readPlyColour(at, property.type, isSwapped);
+                    at += size;
+                    continue;
+                }
+                double count = readPlyValue(at, property.countType, isSwapped);
+                at += size;
+                size_t itemSize = plyTypeSize(property.type);
+                if (count < 0.0 || count > double(size_t(end - at) / itemSize)) return nullptr;
+                if (int(p) == indices) {
+                    for (size_t i = 0; i < size_t(count); i++) {
+                        double index = readPlyValue(at + i * itemSize, property.type, isSwapped);
+                        if (index < 0.0 || index >= double(positions.size())) isValid = false;
+                        else corners.push_back(uint32_t(index));
+                    }
+                }
+                at += size_t(count) * itemSize;
+            }
+            if (!isValid || corners.size() < 3) {
+                skippedFaces++;
+                continue;
+            }
+            uint16_t material = 1;
+            if (hasFaceColours) material = colours.find(colour[0], colour[1], colour[2]);
+            else if (!vertexMaterials.empty()) material = vertexMaterials[corners[0]];
+            if (triangles == nullptr) continue;
+            for (size_t i = 1; i + 1 < corners.size(); i++) {
+                triangles->push_back(makeTriangle(positions, texturePoints, {{corners[0], corners[i], corners[i + 1]}},
+                                                  0, material));
+            }
+        }
+        if (skippedFaces > 0) {
+            LOG_ERROR(LogCategory::Loader, "Skipped " << skippedFaces << " faces of " << filename
+                                           << " with fewer than three corners or corners that are not vertices");
+        }
+        return at;
+    }
+
+    // reads the vertices and faces of a binary PLY file, triangles is null when only the materials are wanted
+    bool readPly(const std::string &filename, float scalingFactor, std::vector<Material> &materials,
+                 std::vector<ModelTriangle> *triangles, std::vector<glm::vec3> &positions) {
+        materials.assign(1, Material());
+        MappedFile file(filename);
+        if (!file.isOpen()) {
+            LOG_ERROR(LogCategory::Loader, "Failed to open the file " << filename);
+            return false;
+        }
+        PlyHeader header;
+        if (!readPlyHeader(file, filename, header)) return false;
+
+        const PlyElement *vertexElement = nullptr, *faceElement = nullptr;
+        for (const PlyElement &element : header.elements) {
+            if (element.name == "vertex" && vertexElement == nullptr) vertexElement = &element;
+            if (element.name == "face" && faceElement == nullptr) faceElement = &element;
+        }
+        bool hasFaceColours = faceElement != nullptr && faceElement->find({"red", "diffuse_red"}) >= 0 &&
+                              faceElement->find({"green", "diffuse_green"}) >= 0 &&
+                              faceElement->find({"blue", "diffuse_blue"}) >= 0;
+        bool hasVertexColours = vertexElement != nullptr && vertexElement->find({"red", "diffuse_red"}) >= 0 &&
+                                vertexElement->find({"green", "diffuse_green"}) >= 0 &&
+                                vertexElement->find({"blue", "diffuse_blue"}) >= 0;
+        PlyColourMaterials colours(materials);
+        if (!hasFaceColours && !hasVertexColours) {
+            Material fallback;
+            fallback.name = "ply_default";
+            fallback.colour = Colour(fallback.name, 200, 200, 200);
+            materials.push_back(fallback);
+        }
+
+        std::vector<TexturePoint> texturePoints;
+        std::vector<uint16_t> vertexMaterials;
+        bool hasVertices = false;
+        const uint8_t *at = file.data() + header.bodyOffset;
+        const uint8_t *end = file.data() + file.size();
+        for (const PlyElement &element : header.elements) {
+            if (&element == vertexElement) {
+                at = readPlyVertices(element, at, end, header.isSwapped, scalingFactor, positions, texturePoints,
+                                     hasFaceColours ? nullptr : &vertexMaterials, colours, filename);
+                hasVertices = true;
+                // the vertex colours are all the materials there are
+                if (triangles == nullptr && !hasFaceColours) return at != nullptr;
+            } else if (&element == faceElement) {
+                if (!hasVertices) {
+                    LOG_ERROR(LogCategory::Loader, "The faces of " << filename << " come before its vertices");
+                    return false;
+                }
+                at = readPlyFaces(element, at, end, header.isSwapped, positions, texturePoints, vertexMaterials,
+                                  hasFaceColours, colours, triangles, filename);
+                if (triangles == nullptr) return at != nullptr;
+            } else {
+                at = skipPlyElement(element, at, end, header.isSwapped);
+            }
+            if (at == nullptr) {
+                LOG_ERROR(LogCategory::Loader, filename << " ends inside its " << element.name << " elements");
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<ModelTriangle> importPly(const std::string &filename, float scalingFactor,
+                                         const std::string &materialName) {
+        std::vector<ModelTriangle> triangles;
+        std::vector<Material> own;
+        std::vector<glm::vec3> positions;
+        if (!readPly(filename, scalingFactor, own, &triangles, positions)) return std::vector<ModelTriangle>();
+        std::vector<uint16_t> ids = resolveMaterials(own, filename, materialName);
+        if (materialName != filename) {
+            for (ModelTriangle &triangle : triangles) triangle.materialId = ids[triangle.materialId];
+        }
+        // the renderers ask for the materials of the file next, the colours are not read again for them
+        storeMaterials(filename, std::move(own));
+        addVertexNormals(positions, triangles, 0, 0);
+        return triangles;
+    }
+
+    // ---- glTF ----
+
+    // just enough JSON for the glTF scene description, objects keep their keys in order and are searched one by one,
+    // they are small, the arrays that get long are indexed
+    struct JsonValue {
+        enum class Type { Null, Boolean, Number, String, Array, Object };
+        Type type = Type::Null;
+        bool boolean = false;
+        double number = 0.0;
+        std::string text;
+        std::vector<JsonValue> items;    // the elements of an array, the values of an object
+        std::vector<std::string> keys;   // the keys of an object, one per value
+
+        const JsonValue &operator[](const std::string &key) const {
+            for (size_t i = 0; i < keys.size(); i++) {
+                if (keys[i] == key) return items[i];
+            }
+            return missing();
+        }
+        const JsonValue &operator[](size_t index) const {
+            return type == Type::Array && index < items.size() ? items[index] : missing();
+        }
+        size_t size() const { return type == Type::Array ? items.size() : 0; }
+        double asNumber(double fallback) const { return type == Type::Number ? number : fallback; }
+        size_t asSize() const { return type == Type::Number && number >= 0.0 && number < 1e18 ? size_t(number) : 0; }
+        // an index into another array of the file, -1 when there is none
+        long asIndex() const {
+            return type == Type::Number && number >= 0.0 && number < double(std::numeric_limits<int32_t>::max()) ?
+                   long(number) : -1;
+        }
+
+        static const JsonValue &missing() {
+            static const JsonValue value;
+            return value;
+        }
+    };
+
+    class JsonParser {
+    public:
+        JsonParser(const char *begin, const char *end) : at(begin), end(end) {}
+
+        bool parse(JsonValue &value) {
+            skipSpace();
+            if (!parseValue(value, 0)) return false;
+            skipSpace();
+            return at == end;
+        }
+
+    private:
+        static const int maxDepth = 128;
+
+        void skipSpace() {
+            while (at < end && (*at == ' ' || *at == '\t' || *at == '\n' || *at == '\r')) at++;
+        }
+
+        bool consume(const char *word) {
+            size_t length = std::strlen(word);
+            if (size_t(end - at) < length || std::memcmp(at, word, length) != 0) return false;
+            at += length;
+            return true;
+        }
+
+        bool parseValue(JsonValue &value, int depth) {
+            if (at == end || depth > maxDepth) return false;
+            switch (*at) {
+                case '{': return parseObject(value, depth);
+                case '[': return parseArray(value, depth);
+                case '"':
+                    value.type = JsonValue::Type::String;
+                    return parseString(value.text);
+                case 't':
+                    value.type = JsonValue::Type::Boolean;
+                    value.boolean = true;
+                    return consume("true");
+                case 'f':
+                    value.type = JsonValue::Type::Boolean;
+                    return consume("false");
+                case 'n':
+                    return consume("null");
+                default:
+                    return parseNumber(value);
+            }
+        }
+
+        bool parseObject(JsonValue &value, int depth) {
+            value.type = JsonValue::Type::Object;
+            at++;
+            skipSpace();
+            if (at < end && *at == '}') {
+                at++;
+                return true;
+            }
+            while (true) {
+                skipSpace();
+                if (at == end || *at != '"') return false;
+                value.keys.emplace_back();
+                if (!parseString(value.keys.back())) return false;
+                skipSpace();
+                if (at == end || *at != ':') return false;
+                at++;
+                skipSpace();
+                value.items.emplace_back();
+                if (!parseValue(value.items.back(), depth + 1)) return false;
+                skipSpace();
+                if (at == end) return false;
+                if (*at++ == '}') return true;
+                if (at[-1] != ',') return false;
+            }
+        }
+
+        bool parseArray(JsonValue &value, int depth) {
+            value.type = JsonValue::Type::Array;
+            at++;
+            skipSpace();
+            if (at < end && *at == ']') {
+                at++;
+                return true;
+            }
+            while (true) {
+                skipSpace();
+                value.items.emplace_back();
+                if (!parseValue(value.items.back(), depth + 1)) return false;
+                skipSpace();
+                if (at == end) return false;
+                if (*at++ == ']') return true;
+                if (at[-1] != ',') return false;
+            }
+        }
+
+        bool parseString(std::string &text) {
+            at++;
+            while (at < end && *at != '"') {
+                if (*at != '\\') {
+                    text += *at++;
+                    continue;
+                }
+                if (++at == end) return false;
+                char escaped = *at++;
+                if (escaped == 'b') text += '\b';
+                else if (escaped == 'f') text += '\f';
+                else if (escaped == 'n') text += '\n';
+                else if (escaped == 'r') text += '\r';
+                else if (escaped == 't') text += '\t';
+                else if (escaped == 'u') {
+                    if (end - at < 4) return false;
+                    unsigned code = unsigned(std::strtoul(std::string(at, 4).c_str(), nullptr, 16));
+                    at += 4;
+                    // as UTF-8, the halves of a surrogate pair each on their own, names are all they could be in
+                    if (code < 0x80) {
+                        text += char(code);
+                    } else if (code < 0x800) {
+                        text += char(0xC0 | (code >> 6));
+                        text += char(0x80 | (code & 0x3F));
+                    } else {
+                        text += char(0xE0 | (code >> 12));
+                        text += char(0x80 | ((code >> 6) & 0x3F));
+                        text += char(0x80 | (code & 0x3F));
+                    }
+                } else {
+                    text += escaped;   // \" \\ and \/
+                }
+            }
+            if (at == end) return false;
+            at++;
+            return true;
+        }
+
+        bool parseNumber(JsonValue &value) {
+            const char *start = at;
+            while (at < end && (std::isdigit(static_cast<unsigned char>(*at)) || *at == '-' || *at == '+' ||
+                                *at == '.' || *at == 'e' || *at == 'E')) {
+                at++;
+            }
+            if (at == start) return false;
+            value.type = JsonValue::Type::Number;
+            value.number = std::strtod(std::string(start, at).c_str(), nullptr);
+            return true;
+        }
+
+        const char *at;
+        const char *end;
+    };
+
+    std::vector<uint8_t> decodeBase64(const std::string &text, size_t start) {
+        std::vector<uint8_t> bytes;
+        bytes.reserve((text.size() - start) / 4 * 3);
+        uint32_t bits = 0;
+        int bitCount = 0;
+        for (size_t i = start; i < text.size(); i++) {
+            char c = text[i];
+            uint32_t value;
+            if (c >= 'A' && c <= 'Z') value = uint32_t(c - 'A');
+            else if (c >= 'a' && c <= 'z') value = uint32_t(c - 'a' + 26);
+            else if (c >= '0' && c <= '9') value = uint32_t(c - '0' + 52);
+            else if (c == '+') value = 62;
+            else if (c == '/') value = 63;
+            else continue;   // the = padding
+            bits = bits << 6 | value;
+            bitCount += 6;
+            if (bitCount >= 8) {
+                bitCount -= 8;
+                bytes.push_back(uint8_t(bits >> bitCount));
+            }
+        }
+        return bytes;
+    }
+
+    struct GltfBuffer {
+        const uint8_t *data = nullptr;
+        size_t size = 0;
+    };
+
+    // the scene description and the buffers it points into, the .glb itself and the .bin files stay mapped while the
+    // triangles are read out of them
+    struct GltfFile {
+        std::unique_ptr<MappedFile> file;
+        std::vector<std::unique_ptr<MappedFile>> bufferFiles;
+        std::vector<std::vector<uint8_t>> decodedBuffers;   // the ones given inline as base64
+        std::vector<GltfBuffer> buffers;
+        JsonValue json;
+    };
+
+    // glTF is little endian whatever the machine
+    const bool isGltfSwapped = !isHostLittleEndian();
+    const uint32_t glbMagic = 0x46546C67;       // "glTF"
+    const uint32_t glbJsonChunk = 0x4E4F534A;   // "JSON"
+    const uint32_t glbBinaryChunk = 0x004E4942; // "BIN\0"
+
+    bool openGltf(const std::string &filename, GltfFile &gltf) {
+        gltf.file.reset(new MappedFile(filename));
+        if (!gltf.file->isOpen()) {
+            LOG_ERROR(LogCategory::Loader, "Failed to open the file " << filename);
+            return false;
+        }
+        const uint8_t *bytes = gltf.file->data();
+        size_t size = gltf.file->size();
+        const char *json = reinterpret_cast<const char *>(bytes);
+        const char *jsonEnd = json + size;
+        GltfBuffer binaryChunk;
+        if (size >= 12 && readValue<uint32_t>(bytes, isGltfSwapped) == glbMagic) {
+            // a 12 byte header, then chunks of a length, a type and the data, the JSON first
+            bool hasJson = false;
+            size_t offset = 12;
+            while (size - offset >= 8) {
+                size_t chunkLength = readValue<uint32_t>(bytes + offset, isGltfSwapped);
+                uint32_t chunkType = readValue<uint32_t>(bytes + offset + 4, isGltfSwapped);
+                offset += 8;
+                if (chunkLength > size - offset) {
+                    LOG_ERROR(LogCategory::Loader, filename << " ends inside one of its chunks");
+                    return false;
+                }
+                if (chunkType == glbJsonChunk && !hasJson) {
+                    json = reinterpret_cast<const char *>(bytes + offset);
+                    jsonEnd = json + chunkLength;
+                    hasJson = true;
+                } else if (chunkType == glbBinaryChunk && binaryChunk.data == nullptr) {
+                    binaryChunk.data = bytes + offset;
+                    binaryChunk.size = chunkLength;
+                }
+                offset += chunkLength;
+            }
+            if (!hasJson) {
+                LOG_ERROR(LogCategory::Loader, filename << " has no JSON chunk");
+                return false;
+            }
+        }
+        JsonParser parser(json, jsonEnd);
+        if (!parser.parse(gltf.json)) {
+            LOG_ERROR(LogCategory::Loader, "Failed to parse the JSON of " << filename);
+            return false;
+        }
+        const std::string &version = gltf.json["asset"]["version"].text;
+        if (version.empty() || version[0] != '2') {
+            LOG_ERROR(LogCategory::Loader, "Only glTF 2.0 is imported, " << filename << " is version " << version);
+            return false;
+        }
+
+        std::string directory = filename.substr(0, filename.find_last_of("/\\") + 1);
+        const JsonValue &buffers = gltf.json["buffers"];
+        for (size_t i = 0; i < buffers.size(); i++) {
+            const JsonValue &uri = buffers[i]["uri"];
+            GltfBuffer buffer;
+            if (uri.type != JsonValue::Type::String) {
+                buffer = binaryChunk;
+            } else if (uri.text.compare(0, 5, "data:") == 0) {
+                size_t comma = uri.text.find(";base64,");
+                if (comma == std::string::npos) {
+                    LOG_ERROR(LogCategory::Loader, "Buffer " << i << " of " << filename << " is not base64");
+                    return false;
+                }
+                gltf.decodedBuffers.push_back(decodeBase64(uri.text, comma + 8));
+                buffer.data = gltf.decodedBuffers.back().data();
+                buffer.size = gltf.decodedBuffers.back().size();
+            } else {
+                gltf.bufferFiles.emplace_back(new MappedFile(directory + uri.text));
+                if (!gltf.bufferFiles.back()->isOpen()) {
+                    LOG_ERROR(LogCategory::Loader, "Failed to open " << directory + uri.text << ", a buffer of " << filename);
+                    return false;
+                }
+                buffer.data = gltf.bufferFiles.back()->data();
+                buffer.size = gltf.bufferFiles.back()->size();
+            }
+            if (buffer.size < buffers[i]["byteLength"].asSize()) {
+                LOG_ERROR(LogCategory::Loader, "Buffer " << i << " of " << filename << " is shorter than its byteLength");
+                return false;
+            }
+            gltf.buffers.push_back(buffer);
+        }
+        return true;
+    }
+
+    // where the elements of an accessor are, first is null when it has no buffer view and its elements are all zero
+    struct GltfAccessor {
+        const uint8_t *first = nullptr;
+        size_t stride = 0;
+        size_t count = 0;
+        int componentType = 0;
+        size_t components = 0;
+        bool isNormalized = false;
+    };
+
+    size_t componentSize(int componentType) {
+        switch (componentType) {
+            case 5120: case 5121: return 1;   // byte, unsigned byte
+            case 5122: case 5123: return 2;   // short, unsigned short
+            case 5125: case 5126: return 4;   // unsigned int, float
+            default: return 0;
+        }
+    }
+
+    size_t componentCount(const std::string &type) {
+        if (type == "SCALAR") return 1;
+        if (type == "VEC2") return 2;
+        if (type == "VEC3") return 3;
+        if (type == "VEC4") return 4;
+        return 0;
+    }
+
+    bool findAccessor(const GltfFile &gltf, const JsonValue &index, GltfAccessor &accessor, const std::string &filename) {
+        const JsonValue &json = gltf.json["accessors"][size_t(index.asIndex())];
+        if (json.type != JsonValue::Type::Object) {
+            LOG_ERROR(LogCategory::Loader, "A primitive of " << filename << " refers to an accessor that is not there");
+            return false;
+        }
+        if (json["sparse"].type != JsonValue::Type::Null) {
+            LOG_ERROR(LogCategory::Loader, "Sparse accessors are not imported, " << filename << " has one");
+            return false;
+        }
+        accessor.count = json["count"].asSize();
+        accessor.componentType = int(json["componentType"].asNumber(0));
+        accessor.components = componentCount(json["type"].text);
+        accessor.isNormalized = json["normalized"].boolean;
+        size_t elementSize = componentSize(accessor.componentType) * accessor.components;
+        if (elementSize == 0) {
+            LOG_ERROR(LogCategory::Loader, "An accessor of " << filename << " has an unknown type");
+            return false;
+        }
+        long viewIndex = json["bufferView"].asIndex();
+        if (viewIndex < 0) return true;
+        const JsonValue &view = gltf.json["bufferViews"][size_t(viewIndex)];
+        long bufferIndex = view["buffer"].asIndex();
+        if (bufferIndex < 0 || size_t(bufferIndex) >= gltf.buffers.size()) {
+            LOG_ERROR(LogCategory::Loader, "A buffer view of " << filename << " refers to a buffer that is not there");
+            return false;
+        }
+        const GltfBuffer &buffer = gltf.buffers[size_t(bufferIndex)];
+        size_t viewOffset = view["byteOffset"].asSize(), viewLength = view["byteLength"].asSize();
+        size_t offset = json["byteOffset"].asSize();
+        accessor.stride = view["byteStride"].asSize();
+        if (accessor.stride == 0) accessor.stride = elementSize;
+        // the view has to be inside the buffer and every element inside the view
+        bool fits = viewOffset <= buffer.size && viewLength <= buffer.size - viewOffset;
+        if (fits && accessor.count > 0) {
+            fits = offset <= viewLength && elementSize <= viewLength - offset &&
+                   accessor.count - 1 <= (viewLength - offset - elementSize) / accessor.stride;
+        }
+        if (!fits) {
+            LOG_ERROR(LogCategory::Loader, "An accessor of " << filename << " reaches past the end of its buffer");
+            return false;
+        }
+        accessor.first = buffer.data + viewOffset + offset;
+        return true;
+    }
+
+    float readComponent(const uint8_t *at, int componentType, bool isNormalized) {
+        switch (componentType) {
+            case 5120: {
+                float value = readValue<int8_t>(at, isGltfSwapped);
+                return isNormalized ? std::max(value / 127.0f, -1.0f) : value;
+            }
+            case 5121: {
+                float value = readValue<uint8_t>(at, isGltfSwapped);
+                return isNormalized ? value / 255.0f : value;
+            }
+            case 5122: {
+                float value = readValue<int16_t>(at, isGltfSwapped);
+                return isNormalized ? std::max(value / 32767.0f, -1.0f) : value;
+            }
+            case 5123: {
+                float value = readValue<uint16_t>(at, isGltfSwapped);
+                return isNormalized ? value / 65535.0f : value;
+            }
+            case 5125: return float(readValue<uint32_t>(at, isGltfSwapped));
+            case 5126: return readValue<float>(at, isGltfSwapped);
+            default: return 0.0f;
+        }
+    }
+
+    // components floats per element into out, tightly packed floats are one copy out of the mapped file
+    bool readFloats(const GltfAccessor &accessor, size_t components, float *out) {
+        if (accessor.components != components) return false;
+        if (accessor.first == nullptr) {
+            std::fill(out, out + accessor.count * components, 0.0f);
+            return true;
+        }
+        size_t size = componentSize(accessor.componentType);
+        if (accessor.componentType == 5126 && !isGltfSwapped && accessor.stride == components * sizeof(float)) {
+            std::memcpy(out, accessor.first, accessor.count * accessor.stride);
+            return true;
+        }
+        for (size_t i = 0; i < accessor.count; i++) {
+            const uint8_t *element = accessor.first + i * accessor.stride;
+            for (size_t c = 0; c < components; c++) {
+                out[i * components + c] = readComponent(element + c * size, accessor.componentType, accessor.isNormalized);
+            }
+        }
+        return true;
+    }
+
+    bool readIndices(const GltfAccessor &accessor, std::vector<uint32_t> &indices) {
+        if (accessor.components != 1 || (accessor.componentType != 5121 && accessor.componentType != 5123 &&
+                                          accessor.componentType != 5125)) {
+            return false;
+        }
+        indices.resize(accessor.count);
+        if (accessor.first == nullptr) {
+            std::fill(indices.begin(), indices.end(), 0u);
+        } else if (accessor.componentType == 5125 && !isGltfSwapped && accessor.stride == sizeof(uint32_t)) {
+            std::memcpy(indices.data(), accessor.first, accessor.count * sizeof(uint32_t));
+        } else {
+            for (size_t i = 0; i < accessor.count; i++) {
+                indices[i] = uint32_t(readComponent(accessor.first + i * accessor.stride, accessor.componentType, false));
+            }
+        }
+        return true;
+    }
+
+    glm::mat4 nodeTransform(const JsonValue &node) {
+        const JsonValue &matrix = node["matrix"];
+        if (matrix.size() == 16) {
+            // column major, as glm keeps it
+            glm::mat4 transform;
+            for (int column = 0; column < 4; column++) {
+                for (int row = 0; row < 4; row++) transform[column][row] = float(matrix[size_t(column * 4 + row)].asNumber(0));
+            }
+            return transform;
+        }
+        const JsonValue &t = node["translation"], &r = node["rotation"], &s = node["scale"];
+        glm::vec3 translation(float(t[0].asNumber(0)), float(t[1].asNumber(0)), float(t[2].asNumber(0)));
+        glm::quat rotation(float(r[3].asNumber(1)), float(r[0].asNumber(0)), float(r[1].asNumber(0)), float(r[2].asNumber(0)));
+        glm::vec3 scale(float(s[0].asNumber(1)), float(s[1].asNumber(1)), float(s[2].asNumber(1)));
+        return glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+    }
+
+    // the meshes a node and its children place, with where they place them
+    void placeNode(const JsonValue &nodes, size_t index, const glm::mat4 &parent, int depth,
+                   std::vector<std::pair<size_t, glm::mat4>> &placed) {
+        // deeper than any real hierarchy, a file whose nodes are their own ancestors stops here
+        if (depth > 64 || index >= nodes.size()) return;
+        const JsonValue &node = nodes[index];
+        glm::mat4 transform = parent * nodeTransform(node);
+        long mesh = node["mesh"].asIndex();
+        if (mesh >= 0) placed.emplace_back(size_t(mesh), transform);
+        const JsonValue &children = node["children"];
+        for (size_t i = 0; i < children.size(); i++) {
+            long child = children[i].asIndex();
+            if (child >= 0) placeNode(nodes, size_t(child), transform, depth + 1, placed);
+        }
+    }
+
+    // the meshes of the default scene, or every mesh where it is when the file has no scenes
+    std::vector<std::pair<size_t, glm::mat4>> placedMeshes(const JsonValue &json) {
+        std::vector<std::pair<size_t, glm::mat4>> placed;
+        const JsonValue &scenes = json["scenes"];
+        if (scenes.size() == 0) {
+            for (size_t mesh = 0; mesh < json["meshes"].size(); mesh++) placed.emplace_back(mesh, glm::mat4(1.0f));
+            return placed;
+        }
+        long scene = json["scene"].asIndex();
+        const JsonValue &roots = scenes[scene >= 0 ? size_t(scene) : 0]["nodes"];
+        for (size_t i = 0; i < roots.size(); i++) {
+            long root = roots[i].asIndex();
+            if (root >= 0) placeNode(json["nodes"], size_t(root), glm::mat4(1.0f), 0, placed);
+        }
+        return placed;
+    }
+
+    // the materials of the file after material 0, with one more at the end for the primitives that name none
+    std::vector<Material> gltfMaterials(const JsonValue &json, const std::string &filename) {
+        std::vector<Material> materials(1);
+        const JsonValue &sources = json["materials"];
+        for (size_t i = 0; i < sources.size(); i++) {
+            if (materials.size() + 1 >= maxMaterials) {
+                LOG_ERROR(LogCategory::Loader, "Too many materials in " << filename << ", the rest get the default");
+                break;
+            }
+            const JsonValue &source = sources[i];
+            Material material;
+            material.name = source["name"].text.empty() ? "material_" + std::to_string(i) : source["name"].text;
+            const JsonValue &pbr = source["pbrMetallicRoughness"];
+            const JsonValue &base = pbr["baseColorFactor"];
+            float r = glm::clamp(float(base[0].asNumber(1)), 0.0f, 1.0f);
+            float g = glm::clamp(float(base[1].asNumber(1)), 0.0f, 1.0f);
+            float b = glm::clamp(float(base[2].asNumber(1)), 0.0f, 1.0f);
+            material.colour = Colour(material.name, int(r * 255), int(g * 255), int(b * 255));
+            // a rough metal scatters the light too much to be a mirror
+            float metallic = float(pbr["metallicFactor"].asNumber(1)), roughness = float(pbr["roughnessFactor"].asNumber(1));
+            if (metallic >= 0.5f && roughness < 0.5f) {
+                material.isMirror = true;
+                material.reflectivity = glm::clamp(metallic, 0.0f, 1.0f);
+            }
+            const JsonValue &extensions = source["extensions"];
+            if (extensions["KHR_materials_transmission"]["transmissionFactor"].asNumber(0) > 0.5) {
+                material.isGlass = true;
+                material.indexOfRefraction = float(extensions["KHR_materials_ior"]["ior"].asNumber(1.5));
+            }
+            materials.push_back(material);
+        }
+        // white like the default material of glTF
+        Material fallback;
+        fallback.name = "gltf_default";
+        fallback.colour = Colour(fallback.name, 255, 255, 255);
+        materials.push_back(fallback);
+        return materials;
+    }
+
+    std::vector<ModelTriangle> importGltf(const std::string &filename, float scalingFactor,
+                                          const std::string &materialName) {
+        std::vector<ModelTriangle> triangles;
+        GltfFile gltf;
+        if (!openGltf(filename, gltf)) return triangles;
+        std::vector<Material> own = gltfMaterials(gltf.json, filename);
+        std::vector<uint16_t> ids = resolveMaterials(own, filename, materialName);
+        storeMaterials(filename, own);
+        const JsonValue &meshes = gltf.json["meshes"];
+        std::vector<std::pair<size_t, glm::mat4>> placed = placedMeshes(gltf.json);
+
+        // the number of triangles from the accessor counts alone, so the list is allocated once
+        size_t expected = 0;
+        for (const auto &placement : placed) {
+            const JsonValue &primitives = meshes[placement.first]["primitives"];
+            for (size_t p = 0; p < primitives.size(); p++) {
+                const JsonValue &primitive = primitives[p];
+                long accessor = primitive["indices"].asIndex();
+                if (accessor < 0) accessor = primitive["attributes"]["POSITION"].asIndex();
+                expected += gltf.json["accessors"][size_t(accessor)]["count"].asSize() / 3;
+            }
+        }
+        triangles.reserve(expected);
+
+        static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "positions are read straight into glm::vec3");
+        std::vector<glm::vec3> positions, normals;
+        std::vector<float> coordinates;
+        std::vector<TexturePoint> texturePoints;
+        std::vector<uint32_t> indices, corners;
+        // the primitives of a mesh often share one set of vertices, it is read once for all of them and gets its
+        // vertex normals once the last of them is in
+        std::array<long, 4> loadedVertices = {{-1, -1, -1, -1}};   // the placement and the attribute accessors
+        glm::mat3 normalTransform;
+        uint32_t firstIndex = 0;
+        size_t firstTriangle = 0;
+        auto finishVertices = [&]() {
+            if (loadedVertices[0] < 0) return;
+            if (normals.empty()) {
+                addVertexNormals(positions, triangles, firstTriangle, firstIndex);
+            } else {
+                std::vector<std::pair<glm::vec3, glm::vec3>> given;
+                given.reserve(positions.size());
+                for (size_t i = 0; i < positions.size(); i++) {
+                    glm::vec3 normal = normalTransform * normals[i];
+                    if (normal != glm::vec3(0.0f)) given.emplace_back(positions[i], glm::normalize(normal));
+                }
+                storeVertexNormals(given);
+            }
+            firstIndex += uint32_t(positions.size());
+            loadedVertices[0] = -1;
+        };
+
+        size_t skippedPrimitives = 0, skippedTriangles = 0;
+        for (size_t placement = 0; placement < placed.size(); placement++) {
+            const glm::mat4 &transform = placed[placement].second;
+            const JsonValue &primitives = meshes[placed[placement].first]["primitives"];
+            for (size_t p = 0; p < primitives.size(); p++) {
+                const JsonValue &primitive = primitives[p];
+                const JsonValue &attributes = primitive["attributes"];
+                std::array<long, 4> vertices = {{long(placement), attributes["POSITION"].asIndex(),
+                                                 attributes["TEXCOORD_0"].asIndex(), attributes["NORMAL"].asIndex()}};
+                // 4 triangles, 5 a strip and 6 a fan, the points and lines have nothing to ray trace
+                int mode = int(primitive["mode"].asNumber(4));
+                GltfAccessor accessor;
+                if (mode < 4 || mode > 6) {
+                    skippedPrimitives++;
+                    continue;
+                }
+                if (vertices != loadedVertices) {
+                    finishVertices();
+                    positions.clear();
+                    if (!findAccessor(gltf, attributes["POSITION"], accessor, filename)) {
+                        skippedPrimitives++;
+                        continue;
+                    }
+                    positions.resize(accessor.count);
+                    if (positions.empty() || !readFloats(accessor, 3, &positions[0].x)) {
+                        skippedPrimitives++;
+                        continue;
+                    }
+                    parallelFor(positions.size(), [&](size_t begin, size_t end) {
+                        for (size_t i = begin; i < end; i++) {
+                            positions[i] = glm::vec3(transform * glm::vec4(positions[i], 1.0f)) * scalingFactor;
+                        }
+                    });
+
+                    texturePoints.clear();
+                    if (vertices[2] >= 0 && findAccessor(gltf, attributes["TEXCOORD_0"], accessor, filename) &&
+                        accessor.count == positions.size()) {
+                        coordinates.resize(2 * accessor.count);
+                        if (readFloats(accessor, 2, coordinates.data())) {
+                            // glTF puts v = 0 at the top of the image, OBJ at the bottom
+                            texturePoints.resize(accessor.count);
+                            for (size_t i = 0; i < accessor.count; i++) {
+                                texturePoints[i] = TexturePoint(coordinates[2 * i], 1.0f - coordinates[2 * i + 1]);
+                            }
+                        }
+                    }
+                    normals.clear();
+                    if (vertices[3] >= 0 && findAccessor(gltf, attributes["NORMAL"], accessor, filename) &&
+                        accessor.count == positions.size()) {
+                        normals.resize(accessor.count);
+                        if (!readFloats(accessor, 3, &normals[0].x)) normals.clear();
+                    }
+                    normalTransform = glm::transpose(glm::inverse(glm::mat3(transform)));
+                    loadedVertices = vertices;
+                    firstTriangle = triangles.size();
+                }
+
+                if (primitive["indices"].type == JsonValue::Type::Null) {
+                    indices.resize(positions.size());
+                    for (size_t i = 0; i < indices.size(); i++) indices[i] = uint32_t(i);
+                } else if (!findAccessor(gltf, primitive["indices"], accessor, filename) || !readIndices(accessor, indices)) {
+                    skippedPrimitives++;
+                    continue;
+                }
+
+                long material = primitive["material"].asIndex();
+                uint16_t materialId = ids.back();
+                if (material >= 0 && size_t(material) + 1 < own.size() - 1) materialId = ids[size_t(material) + 1];
+                if (mode != 4) {
+                    // a strip or a fan as a list of triangles, every other triangle of a strip is turned around so
+                    // they all wind the same way
+                    size_t count = indices.size() >= 3 ? indices.size() - 2 : 0;
+                    corners.resize(3 * count);
+                    for (size_t i = 0; i < count; i++) {
+                        corners[3 * i] = mode == 5 ? indices[i] : indices[0];
+                        corners[3 * i + 1] = mode == 5 ? indices[i + 1 + i % 2] : indices[i + 1];
+                        corners[3 * i + 2] = mode == 5 ? indices[i + 2 - i % 2] : indices[i + 2];
+                    }
+                    indices.swap(corners);
+                }
+                size_t count = indices.size() / 3;
+                auto corner = [&indices](size_t i, int k) { return indices[3 * i + k]; };
+                size_t bad = countBadTriangles(count, positions.size(), corner);
+                if (bad == 0) {
+                    appendTriangles(triangles, count, corner, positions, texturePoints,
+                                    [materialId](size_t, uint32_t) { return materialId; }, firstIndex);
+                    continue;
+                }
+                skippedTriangles += bad;
+                for (size_t i = 0; i < count; i++) {
+                    if (corner(i, 0) < positions.size() && corner(i, 1) < positions.size() && corner(i, 2) < positions.size()) {
+                        triangles.push_back(makeTriangle(positions, texturePoints, {{corner(i, 0), corner(i, 1), corner(i, 2)}},
+                                                         firstIndex, materialId));
+                    }
+                }
+            }
+        }
+        finishVertices();
+        if (skippedPrimitives > 0 || skippedTriangles > 0) {
+            LOG_ERROR(LogCategory::Loader, "Skipped " << skippedPrimitives << " primitives and " << skippedTriangles
+                                           << " triangles of " << filename << " that could not be read");
+        }
+        return triangles;
+    }
+}
+
+bool isImportedMesh(const std::string &filename) {
+    std::string extension = extensionOf(filename);
+    return extension == "ply" || extension == "glb" || extension == "gltf";
+}
+
+std::vector<ModelTriangle> importMesh(const std::string &filename, float scalingFactor, const std::string &materialName) {
+    if (extensionOf(filename) == "ply") return importPly(filename, scalingFactor, materialName);
+    return importGltf(filename, scalingFactor, materialName);
+}
+
+std::vector<Material> importMaterials(const std::string &filename) {
+    std::vector<Material> materials;
+    if (extensionOf(filename) == "ply") {
+        std::vector<glm::vec3> positions;
+        if (!readPly(filename, 1.0f, materials, nullptr, positions)) materials.resize(1);
+        return materials;
+    }
+    GltfFile gltf;
+    if (!openGltf(filename, gltf)) return std::vector<Material>(1);
+    return gltfMaterials(gltf.json, filename);
+}
@@ -0,0 +1,48 @@
+#ifndef REDNOISE_MESHIMPORT_H
+#define REDNOISE_MESHIMPORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "LoadFile.h"
+
+// a file mapped read only into memory, the importers read the vertex and index buffers straight out of it instead of
+// copying the file first, where there is no mmap the file is read into memory in one go
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &filename);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool isOpen() const { return opened; }
+    const uint8_t *data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const uint8_t *bytes = nullptr;
+    size_t length = 0;
+    bool opened = false;
+    bool isMapped = false;
+    std::vector<uint8_t> copy;   // the file when it could not be mapped
+};
+
+// true for the meshes loadOBJ and loadMaterials leave to the importers, going by the extension
+// .ply, binary little or big endian, faces are lists of vertex indices and fans of more than three corners become
+//   triangles, the face colours (or the vertex colours, a face taking its first corner's) are its materials
+// .glb and .gltf, the triangles, strips and fans of the meshes the default scene places, moved by their node
+//   transforms, baseColorFactor is the Kd of their material, a metallicFactor and roughnessFactor on the mirror side of
+//   a half make it a mirror with the metallicFactor as its reflectivity, KHR_materials_transmission over a half makes
+//   it glass with the Ni from KHR_materials_ior
+bool isImportedMesh(const std::string &filename);
+
+// the triangles of a binary PLY or glTF file, scaled and with vertexNormals filled in like loadOBJ does
+// materialName is the file itself for its own materials, or a .mtl file whose materials are found by name, the PLY ones
+// are called ply_rrggbb after their colour (ply_default without colours) and the glTF ones keep theirs, the file's own
+// table goes to storeMaterials, so getMaterials on the file afterwards does not read it again
+std::vector<ModelTriangle> importMesh(const std::string &filename, float scalingFactor, const std::string &materialName);
+// the material table of a binary PLY or glTF file, material 0 is the black default as for a .mtl file
+std::vector<Material> importMaterials(const std::string &filename);
+
+#endif //REDNOISE_MESHIMPORT_H
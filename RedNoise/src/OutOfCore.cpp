@@ -0,0 +1,421 @@
+#include "OutOfCore.h"
+#include "HardShadowRendering.h"
+#include "AntiAliasing.h"
+#include "Log.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <sys/stat.h>
+
+OutOfCoreSettings outOfCoreSettings;
+
+namespace {
+    // read by the main loop for the window title while the job thread renders
+    std::atomic<float> lastHitRate{-1.0f};
+
+    const uint32_t clusterFileMagic = 0x4C434E52;   // "RNCL"
+    const uint32_t clusterFileVersion = 2;
+
+    // what the build keeps of every face, a fraction of a ModelTriangle
+    struct FaceRecord {
+        uint32_t mortonCode;
+        std::array<uint32_t, 3> vertexIndices;
+        std::array<int32_t, 3> texturePointIndices;   // -1 without a texture coordinate
+        uint16_t materialId;
+    };
+
+    // the triangle as it is stored in a cluster, the normal and the material are restored when it is paged in
+    struct StoredTriangle {
+        std::array<glm::vec3, 3> vertices;
+        std::array<float, 6> texturePoints;
+        std::array<uint32_t, 3> vertexIndices;
+        uint32_t materialId;
+    };
+
+    template <typename T>
+    void writeValue(std::ostream &stream, const T &value) {
+        stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    void writeArray(std::ostream &stream, const std::vector<T> &values) {
+        writeValue(stream, uint32_t(values.size()));
+        stream.write(reinterpret_cast<const char *>(values.data()), std::streamsize(values.size() * sizeof(T)));
+    }
+
+    template <typename T>
+    bool readValue(std::istream &stream, T &value) {
+        return bool(stream.read(reinterpret_cast<char *>(&value), sizeof(T)));
+    }
+
+    template <typename T>
+    bool readArray(std::istream &stream, std::vector<T> &values) {
+        uint32_t size;
+        if (!readValue(stream, size)) return false;
+        values.resize(size);
+        return bool(stream.read(reinterpret_cast<char *>(values.data()), std::streamsize(size * sizeof(T))));
+    }
+
+    // spreads the lowest 10 bits so that two zero bits sit between each of them
+    uint32_t spreadBits(uint32_t value) {
+        value &= 0x3FF;
+        value = (value | (value << 16)) & 0x030000FF;
+        value = (value | (value << 8)) & 0x0300F00F;
+        value = (value | (value << 4)) & 0x030C30C3;
+        value = (value | (value << 2)) & 0x09249249;
+        return value;
+    }
+
+    uint32_t mortonCode(const glm::vec3 &point, const glm::vec3 &boundsMin, const glm::vec3 &boundsSize) {
+        glm::vec3 cell = glm::clamp((point - boundsMin) / glm::max(boundsSize, glm::vec3(1e-20f)), 0.0f, 1.0f) * 1023.0f;
+        return (spreadBits(uint32_t(cell.x)) << 2) | (spreadBits(uint32_t(cell.y)) << 1) | spreadBits(uint32_t(cell.z));
+    }
+
+    int64_t modificationTime(const std::string &filename) {
+        struct stat status;
+        return stat(filename.c_str(), &status) == 0 ? int64_t(status.st_mtime) : -1;
+    }
+
+    // the header fields that decide whether a cluster file can be reused
+    bool readClusterFileHeader(std::istream &stream, uint32_t &trianglesPerCluster, float &scalingFactor,
+                               std::string &materialFilename) {
+        uint32_t magic, version;
+        std::vector<char> name;
+        bool isValid = readValue(stream, magic) && magic == clusterFileMagic && readValue(stream, version) &&
+                       version == clusterFileVersion && readValue(stream, trianglesPerCluster) &&
+                       readValue(stream, scalingFactor) && readArray(stream, name);
+        materialFilename.assign(name.begin(), name.end());
+        return isValid;
+    }
+
+    bool openClusteredScene(ClusteredScene &scene, const std::string &clusterFilename) {
+        std::ifstream stream(clusterFilename, std::ios::binary);
+        uint32_t trianglesPerCluster;
+        float scalingFactor;
+        std::string materialFilename;
+        if (!readClusterFileHeader(stream, trianglesPerCluster, scalingFactor, materialFilename)) return false;
+        uint32_t materialCount;
+        if (!readValue(stream, scene.modelCenter) || !readValue(stream, materialCount)) return false;
+        scene.materials.resize(materialCount);
+        for (Material &material : scene.materials) {
+            std::vector<char> name;
+            int32_t red, green, blue;
+            uint8_t isMirror, isGlass;
+            if (!readArray(stream, name) || !readValue(stream, red) || !readValue(stream, green) ||
+                !readValue(stream, blue) || !readValue(stream, isMirror) || !readValue(stream, isGlass) ||
+                !readValue(stream, material.indexOfRefraction) || !readValue(stream, material.reflectivity)) return false;
+            material.name.assign(name.begin(), name.end());
+            material.colour = Colour(material.name, red, green, blue);
+            material.isMirror = isMirror != 0;
+            material.isGlass = isGlass != 0;
+        }
+        // the cluster table is at the end, its offset is in the last 8 bytes
+        uint64_t tableOffset;
+        stream.seekg(-int(sizeof(tableOffset)), std::ios::end);
+        if (!readValue(stream, tableOffset)) return false;
+        stream.seekg(std::streamoff(tableOffset));
+        if (!readArray(stream, scene.clusters)) return false;
+
+        std::vector<glm::vec3> boundsMin, boundsMax;
+        for (const ClusterInfo &cluster : scene.clusters) {
+            boundsMin.push_back(cluster.boundsMin);
+            boundsMax.push_back(cluster.boundsMax);
+        }
+        scene.clusterBVH = buildBVH(boundsMin, boundsMax, 1);
+        scene.clusterFilename = clusterFilename;
+        scene.cache.reset(new ClusterCache(clusterFilename, scene.clusters, scene.materials, outOfCoreSettings.cacheBytes));
+        return true;
+    }
+}
+
+ClusterCache::ClusterCache(const std::string &clusterFilename, const std::vector<ClusterInfo> &clusters,
+                           const std::vector<Material> &materials, size_t capacityBytes) :
+        file(clusterFilename, std::ios::binary), clusters(clusters), materials(materials), capacityBytes(capacityBytes) {}
+
+std::shared_ptr<const Cluster> ClusterCache::fetch(uint32_t clusterIndex) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = residentClusters.find(clusterIndex);
+    if (found != residentClusters.end()) {
+        counters.hits++;
+        recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, found->second.recentlyUsedPosition);
+        return found->second.cluster;
+    }
+
+    counters.misses++;
+    std::shared_ptr<const Cluster> cluster = readCluster(clusterIndex);
+    recentlyUsed.push_front(clusterIndex);
+    residentClusters[clusterIndex] = Entry{cluster, recentlyUsed.begin()};
+    residentBytes += cluster->memoryBytes;
+    // the cluster just paged in always stays, even when it alone is over the capacity
+    while (residentBytes > capacityBytes && recentlyUsed.size() > 1) {
+        uint32_t evicted = recentlyUsed.back();
+        recentlyUsed.pop_back();
+        residentBytes -= residentClusters[evicted].cluster->memoryBytes;
+        residentClusters.erase(evicted);
+        counters.evictions++;
+    }
+    return cluster;
+}
+
+std::shared_ptr<const Cluster> ClusterCache::readCluster(uint32_t clusterIndex) {
+    const ClusterInfo &info = clusters[clusterIndex];
+    std::shared_ptr<Cluster> cluster = std::make_shared<Cluster>();
+    std::vector<StoredTriangle> stored;
+    file.clear();
+    file.seekg(std::streamoff(info.fileOffset));
+    if (!readArray(file, stored) || !readArray(file, cluster->bvh.nodes) || !readArray(file, cluster->bvh.primitiveOrder)) {
+        LOG_ERROR(LogCategory::Loader, "Cluster " << clusterIndex << " is cut short, the cluster file is damaged");
+        exit(1);
+    }
+    counters.bytesRead += uint64_t(file.tellg()) - info.fileOffset;
+
+    cluster->triangles.materials = &materials;
+    cluster->triangles.positions.reserve(stored.size());
+    cluster->triangles.shading.reserve(stored.size());
+    for (const StoredTriangle &triangle : stored) {
+        ModelTriangle modelTriangle(triangle.vertices[0], triangle.vertices[1], triangle.vertices[2],
+                                    uint16_t(triangle.materialId));
+        for (int i = 0; i < 3; i++) {
+            modelTriangle.texturePoints[i] = TexturePoint(triangle.texturePoints[2 * i], triangle.texturePoints[2 * i + 1]);
+        }
+        modelTriangle.vertexIndices = triangle.vertexIndices;
+        // the same normal loadOBJ calculates
+        modelTriangle.normal = glm::normalize(glm::cross(triangle.vertices[1] - triangle.vertices[0],
+                                                         triangle.vertices[2] - triangle.vertices[0]));
+        cluster->triangles.push_back(modelTriangle);
+    }
+    cluster->memoryBytes = sizeof(Cluster) + cluster->triangles.size() * (sizeof(TrianglePositions) + sizeof(TriangleShading)) +
+                           cluster->bvh.nodes.size() * sizeof(BVHNode) +
+                           cluster->bvh.primitiveOrder.size() * sizeof(uint32_t);
+    return cluster;
+}
+
+ClusterCacheStats ClusterCache::stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+void ClusterCache::resetStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    counters = ClusterCacheStats();
+}
+
+bool buildClusterFile(const std::string &objFilename, float scalingFactor, const std::string &materialFilename,
+                      const std::string &clusterFilename, uint32_t trianglesPerCluster) {
+    std::ifstream objFile(objFilename);
+    if (!objFile.is_open()) {
+        LOG_ERROR(LogCategory::Loader, "Failed to open the file " << objFilename);
+        return false;
+    }
+    // the whole material table goes into the file, the faces keep the same ids as in loadOBJ
+    std::vector<Material> materials = loadMaterials(materialFilename);
+
+    // the positions and texture coordinates stay in memory, the faces only as small records
+    std::vector<glm::vec3> vertices;
+    std::vector<TexturePoint> texturePoints;
+    std::vector<FaceRecord> faces;
+    uint16_t currentMaterial = 0;
+    std::string line;
+    std::vector<std::string> tokens;
+    std::vector<std::string> vertexTexturePair;
+    while (std::getline(objFile, line)) {
+        split(line, ' ', tokens);
+        if (tokens[0] == "usemtl") {
+            currentMaterial = findMaterial(materials, tokens[1]);
+        } else if (tokens[0] == "v") {
+            vertices.push_back(glm::vec3(stof(tokens[1]), stof(tokens[2]), stof(tokens[3])) * scalingFactor);
+        } else if (tokens[0] == "vt") {
+            texturePoints.push_back(TexturePoint{stof(tokens[1]), stof(tokens[2])});
+        } else if (tokens[0] == "f") {
+            FaceRecord face{};
+            for (int i = 0; i < 3; i++) {
+                split(tokens[i + 1], '/', vertexTexturePair);
+                face.vertexIndices[i] = uint32_t(stoi(vertexTexturePair[0]) - 1);  // OBJ index starts from 1
+                bool hasTexturePoint = vertexTexturePair.size() > 1 && !vertexTexturePair[1].empty();
+                face.texturePointIndices[i] = hasTexturePoint ? stoi(vertexTexturePair[1]) - 1 : -1;
+            }
+            face.materialId = currentMaterial;
+            faces.push_back(face);
+        }
+    }
+
+    // order the faces along a Morton curve through their centroids, neighbours on the curve are neighbours in space
+    glm::vec3 boundsMin(std::numeric_limits<float>::max()), boundsMax(std::numeric_limits<float>::lowest());
+    for (const FaceRecord &face : faces) {
+        for (uint32_t index : face.vertexIndices) {
+            boundsMin = glm::min(boundsMin, vertices[index]);
+            boundsMax = glm::max(boundsMax, vertices[index]);
+        }
+    }
+    for (FaceRecord &face : faces) {
+        glm::vec3 centroid = (vertices[face.vertexIndices[0]] + vertices[face.vertexIndices[1]] +
+                              vertices[face.vertexIndices[2]]) / 3.0f;
+        face.mortonCode = mortonCode(centroid, boundsMin, boundsMax - boundsMin);
+    }
+    std::stable_sort(faces.begin(), faces.end(), [](const FaceRecord &a, const FaceRecord &b) {
+        return a.mortonCode < b.mortonCode;
+    });
+
+    std::ofstream file(clusterFilename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        LOG_ERROR(LogCategory::Loader, "Failed to create the cluster file " << clusterFilename);
+        return false;
+    }
+    writeValue(file, clusterFileMagic);
+    writeValue(file, clusterFileVersion);
+    writeValue(file, trianglesPerCluster);
+    writeValue(file, scalingFactor);
+    writeArray(file, std::vector<char>(materialFilename.begin(), materialFilename.end()));
+    // the centre calculateModelCenter would give, so the camera aims the same way as for the whole scene
+    writeValue(file, faces.empty() ? glm::vec3(0.0f) : (boundsMin + boundsMax) * 0.5f);
+    writeValue(file, uint32_t(materials.size()));
+    for (size_t i = 0; i < materials.size(); i++) {
+        writeArray(file, std::vector<char>(materials[i].name.begin(), materials[i].name.end()));
+        writeValue(file, int32_t(materials[i].colour.red));
+        writeValue(file, int32_t(materials[i].colour.green));
+        writeValue(file, int32_t(materials[i].colour.blue));
+        writeValue(file, uint8_t(materials[i].isMirror));
+        writeValue(file, uint8_t(materials[i].isGlass));
+        writeValue(file, materials[i].indexOfRefraction);
+        writeValue(file, materials[i].reflectivity);
+    }
+
+    // one cluster at a time, only its triangles are ever materialised
+    std::vector<ClusterInfo> clusters;
+    trianglesPerCluster = std::max(trianglesPerCluster, 1u);
+    for (size_t first = 0; first < faces.size(); first += trianglesPerCluster) {
+        size_t count = std::min<size_t>(trianglesPerCluster, faces.size() - first);
+        std::vector<StoredTriangle> stored(count);
+        std::vector<TrianglePositions> triangles(count);
+        ClusterInfo info;
+        info.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        info.boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+        for (size_t i = 0; i < count; i++) {
+            const FaceRecord &face = faces[first + i];
+            for (int corner = 0; corner < 3; corner++) {
+                glm::vec3 vertex = vertices[face.vertexIndices[corner]];
+                TexturePoint texturePoint = face.texturePointIndices[corner] >= 0 ?
+                                            texturePoints[face.texturePointIndices[corner]] : TexturePoint();
+                stored[i].vertices[corner] = vertex;
+                stored[i].texturePoints[2 * corner] = texturePoint.x;
+                stored[i].texturePoints[2 * corner + 1] = texturePoint.y;
+                triangles[i].vertices[corner] = vertex;
+                info.boundsMin = glm::min(info.boundsMin, vertex);
+                info.boundsMax = glm::max(info.boundsMax, vertex);
+            }
+            stored[i].vertexIndices = face.vertexIndices;
+            stored[i].materialId = face.materialId;
+        }
+        BVH bvh = buildBVH(triangles);
+        // the cluster bounds get the same slack as the triangle bounds inside
+        info.boundsMin = bvh.nodes[0].boundsMin;
+        info.boundsMax = bvh.nodes[0].boundsMax;
+        info.fileOffset = uint64_t(file.tellp());
+        info.firstTriangle = uint32_t(first);
+        info.triangleCount = uint32_t(count);
+        writeArray(file, stored);
+        writeArray(file, bvh.nodes);
+        writeArray(file, bvh.primitiveOrder);
+        clusters.push_back(info);
+    }
+    uint64_t tableOffset = uint64_t(file.tellp());
+    writeArray(file, clusters);
+    writeValue(file, tableOffset);
+    if (!file) {
+        LOG_ERROR(LogCategory::Loader, "Failed to write the cluster file " << clusterFilename);
+        return false;
+    }
+    LOG_INFO(LogCategory::Loader, "Wrote " << faces.size() << " triangles of " << objFilename << " as "
+                                  << clusters.size() << " clusters to " << clusterFilename);
+    return true;
+}
+
+ClusteredScene &getClusteredScene(const std::string &objFilename, const std::string &materialFilename) {
+    static std::map<std::string, ClusteredScene> cache;
+    std::string clusterFilename = objFilename + ".clusters";
+    float scalingFactor = 0.35f;   // the scale renderRayTracedScene loads the scene with
+    std::string key = clusterFilename + "|" + materialFilename + "|" + std::to_string(outOfCoreSettings.trianglesPerCluster);
+    auto found = cache.find(key);
+    if (found != cache.end()) return found->second;
+
+    uint32_t storedTrianglesPerCluster = 0;
+    float storedScalingFactor = 0.0f;
+    std::string storedMaterialFilename;
+    std::ifstream existing(clusterFilename, std::ios::binary);
+    bool isCurrent = readClusterFileHeader(existing, storedTrianglesPerCluster, storedScalingFactor, storedMaterialFilename) &&
+                     storedTrianglesPerCluster == outOfCoreSettings.trianglesPerCluster &&
+                     storedScalingFactor == scalingFactor && storedMaterialFilename == materialFilename &&
+                     modificationTime(clusterFilename) >= modificationTime(objFilename) &&
+                     modificationTime(clusterFilename) >= modificationTime(materialFilename);
+    existing.close();
+    if (!isCurrent && !buildClusterFile(objFilename, scalingFactor, materialFilename, clusterFilename,
+                                        outOfCoreSettings.trianglesPerCluster)) {
+        exit(1);
+    }
+    ClusteredScene &scene = cache[key];
+    if (!openClusteredScene(scene, clusterFilename)) {
+        LOG_ERROR(LogCategory::Loader, "Failed to read the cluster file " << clusterFilename);
+        exit(1);
+    }
+    return scene;
+}
+
+RayTriangleIntersection intersectClusteredScene(const ClusteredScene &scene, const glm::vec3 &origin,
+                                                const glm::vec3 &direction) {
+    float closest = std::numeric_limits<float>::infinity();
+    std::shared_ptr<const Cluster> closestCluster;
+    uint32_t closestFirstTriangle = 0;
+    ClosestTriangleHit hit;
+    // a cluster is only paged in when the ray reaches its bounds before the closest hit so far
+    traverseBVH(scene.clusterBVH, origin, direction, closest, [&](uint32_t clusterIndex, float &closestDistance) {
+        std::shared_ptr<const Cluster> cluster = scene.cache->fetch(clusterIndex);
+        uint32_t firstTriangle = scene.clusters[clusterIndex].firstTriangle;
+        traverseBVH(cluster->bvh, origin, direction, closestDistance, [&](uint32_t index, float &clusterClosest) {
+            if (hit.test(origin, direction, cluster->triangles.positions[index].vertices, firstTriangle + index,
+                         clusterClosest)) {
+                closestCluster = cluster;
+                closestFirstTriangle = firstTriangle;
+            }
+        });
+    });
+
+    RayTriangleIntersection closestIntersection;
+    closestIntersection.distanceFromCamera = std::numeric_limits<float>::infinity();
+    if (!closestCluster) return closestIntersection;
+    return RayTriangleIntersection(origin + closest * direction, closest,
+                                   closestCluster->triangles[hit.sceneIndex - closestFirstTriangle].toModelTriangle(),
+                                   hit.sceneIndex, hit.u, hit.v);
+}
+
+void renderOutOfCoreScene(DrawingWindow &window, const std::string &filename, float focalLength,
+                          const std::string &materialFilename) {
+    ClusteredScene &scene = getClusteredScene(filename, materialFilename);
+    cameraOrientation = lookAt(scene.modelCenter);
+    const SceneLights &lights = getSceneLights(filename);
+    float ambientLight = 0.3f;  // ambient light intensity
+
+    scene.cache->resetStats();
+#if REDNOISE_LOGGING
+    auto start = std::chrono::steady_clock::now();
+#endif
+    renderFlatShadedRegion(window, wholeWindow(window), scene.materials, lights, ambientLight, focalLength,
+                           [&](const glm::vec3 &origin, const glm::vec3 &direction) {
+        return intersectClusteredScene(scene, origin, direction);
+    });
+
+    ClusterCacheStats stats = scene.cache->stats();
+    lastHitRate = float(stats.hitRate());
+    LOG_INFO(LogCategory::RayTrace, "Out of core frame of " << scene.clusters.size() << " clusters took "
+                                    << std::chrono::duration_cast<std::chrono::milliseconds>(
+                                            std::chrono::steady_clock::now() - start).count() << " ms, cluster cache hit rate "
+                                    << stats.hitRate() * 100.0 << "% (" << stats.hits << " hits, " << stats.misses
+                                    << " misses, " << stats.evictions << " evictions, " << stats.bytesRead / 1024
+                                    << " KB read)");
+}
+
+float lastClusterCacheHitRate() {
+    return lastHitRate;
+}
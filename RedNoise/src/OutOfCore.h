@@ -0,0 +1,109 @@
+#ifndef REDNOISE_OUTOFCORE_H
+#define REDNOISE_OUTOFCORE_H
+
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <DrawingWindow.h>
+#include "glm/glm.hpp"
+#include "BVH.h"
+#include "LoadFile.h"
+
+struct OutOfCoreSettings {
+    uint32_t trianglesPerCluster = 4096;
+    size_t cacheBytes = size_t(256) << 20;   // how much cluster data may be in memory at once
+};
+
+extern OutOfCoreSettings outOfCoreSettings;
+
+// what is always in memory about a cluster, the triangles stay on disk until a ray reaches its bounds
+struct ClusterInfo {
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    uint64_t fileOffset = 0;
+    uint32_t firstTriangle = 0;   // scene wide index of its first triangle, the intersections report those indices
+    uint32_t triangleCount = 0;
+};
+
+// a cluster paged in, its triangles and a BVH over them
+struct Cluster {
+    SceneTriangles triangles;
+    BVH bvh;
+    size_t memoryBytes = 0;
+};
+
+struct ClusterCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t bytesRead = 0;
+
+    double hitRate() const { return hits + misses > 0 ? double(hits) / double(hits + misses) : 0.0; }
+};
+
+// least recently used clusters are dropped once the resident ones take more than capacityBytes, a cluster a ray is
+// still traversing stays alive through its shared_ptr until the ray is done with it
+class ClusterCache {
+public:
+    ClusterCache(const std::string &clusterFilename, const std::vector<ClusterInfo> &clusters,
+                 const std::vector<Material> &materials, size_t capacityBytes);
+    std::shared_ptr<const Cluster> fetch(uint32_t clusterIndex);
+    ClusterCacheStats stats();
+    void resetStats();
+
+private:
+    struct Entry {
+        std::shared_ptr<const Cluster> cluster;
+        std::list<uint32_t>::iterator recentlyUsedPosition;
+    };
+
+    std::shared_ptr<const Cluster> readCluster(uint32_t clusterIndex);
+
+    std::ifstream file;
+    const std::vector<ClusterInfo> &clusters;
+    const std::vector<Material> &materials;
+    size_t capacityBytes;
+    size_t residentBytes = 0;
+    std::list<uint32_t> recentlyUsed;   // most recently used first
+    std::unordered_map<uint32_t, Entry> residentClusters;
+    ClusterCacheStats counters;
+    std::mutex mutex;
+};
+
+struct ClusteredScene {
+    std::string clusterFilename;
+    glm::vec3 modelCenter{};
+    std::vector<Material> materials;   // indexed by the material id stored with every triangle
+    std::vector<ClusterInfo> clusters;
+    BVH clusterBVH;                              // over the cluster bounds, one cluster per leaf
+    std::unique_ptr<ClusterCache> cache;
+};
+
+// sorts the faces along a space filling curve and cuts them into clusters of nearby triangles, each written with its
+// own BVH, only the vertex positions and a small record per face are ever in memory, not the whole triangle list
+bool buildClusterFile(const std::string &objFilename, float scalingFactor, const std::string &materialFilename,
+                      const std::string &clusterFilename, uint32_t trianglesPerCluster);
+
+// the clusters of the OBJ, from the .clusters file next to it, which is rebuilt when it is missing, older than the OBJ
+// or the materials, or was written with other materials or a different cluster size
+ClusteredScene &getClusteredScene(const std::string &objFilename, const std::string &materialFilename);
+
+// the same hit as getClosestIntersection on the whole scene, clusters are paged in as the ray reaches them,
+// triangleIndex counts the triangles in cluster order
+RayTriangleIntersection intersectClusteredScene(const ClusteredScene &scene, const glm::vec3 &origin,
+                                                const glm::vec3 &direction);
+
+// flat shaded ray tracing with shadows like renderRayTracedScene, mirrors and glass are shaded as plain surfaces
+void renderOutOfCoreScene(DrawingWindow &window, const std::string &filename, float focalLength,
+                          const std::string &materialFilename);
+
+// the cluster cache hit rate of the last out of core frame, negative before the first one, the main loop shows it in
+// the window title so it is there in release builds too, where the frame's log line is compiled out
+float lastClusterCacheHitRate();
+
+#endif //REDNOISE_OUTOFCORE_H
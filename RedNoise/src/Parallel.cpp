@@ -0,0 +1,65 @@
+#include "Parallel.h"
+#include <algorithm>
+
+namespace {
+    thread_local bool isPoolThread = false;
+}
+
+unsigned int workerThreadCount() {
+    // hardware_concurrency is allowed to return 0 when it does not know
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void parallelFor(size_t count, const std::function<void(size_t begin, size_t end)> &body) {
+    if (count == 0) return;
+    if (isPoolThread) {
+        body(0, count);
+        return;
+    }
+    size_t chunks = std::min<size_t>(workerThreadCount(), count);
+    size_t chunkSize = (count + chunks - 1) / chunks;
+
+    std::vector<std::thread> threads;
+    for (size_t begin = chunkSize; begin < count; begin += chunkSize) {
+        size_t end = std::min(count, begin + chunkSize);
+        threads.emplace_back([&body, begin, end]() { body(begin, end); });
+    }
+    body(0, std::min(count, chunkSize));
+    for (std::thread &thread : threads) thread.join();
+}
+
+ThreadPool::ThreadPool(unsigned int threadCount) {
+    for (unsigned int i = 0; i < std::max(1u, threadCount); i++) threads.emplace_back([this]() { runTasks(); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isStopping = true;
+    }
+    wakeUp.notify_all();
+    for (std::thread &thread : threads) thread.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    wakeUp.notify_one();
+}
+
+void ThreadPool::runTasks() {
+    isPoolThread = true;
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait(lock, [this]() { return isStopping || !tasks.empty(); });
+            if (tasks.empty()) return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
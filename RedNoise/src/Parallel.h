@@ -0,0 +1,39 @@
+#ifndef REDNOISE_PARALLEL_H
+#define REDNOISE_PARALLEL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// number of threads parallelFor splits its work over, at least 1
+unsigned int workerThreadCount();
+
+// split [0, count) into one contiguous chunk per worker thread and run body(begin, end) on each chunk
+// the calling thread takes the first chunk and returns when every chunk is finished
+// on a ThreadPool thread the whole range runs inline, the pool already keeps every core busy
+void parallelFor(size_t count, const std::function<void(size_t begin, size_t end)> &body);
+
+// threads that stay alive and run the submitted tasks in the order they were submitted, for many small independent
+// jobs (the frames of an animation) where starting threads for every job would cost more than the job
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned int threadCount);
+    // runs every task still queued, then joins
+    ~ThreadPool();
+    void submit(std::function<void()> task);
+
+private:
+    void runTasks();
+
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool isStopping = false;
+};
+
+#endif //REDNOISE_PARALLEL_H
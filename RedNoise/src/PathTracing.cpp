@@ -0,0 +1,264 @@
+#include "PathTracing.h"
+#include "HardShadowRendering.h"
+#include "Denoiser.h"
+#include "Parallel.h"
+#include "Random.h"
+#include "Log.h"
+#include "CameraRays.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <map>
+
+PathTracingSettings pathTracingSettings;
+
+namespace {
+    struct PathTracedScene {
+        SceneTriangles triangles;
+        BVH bvh;
+        glm::vec3 modelCenter{};
+    };
+
+    // the float sums of every path since the last reset, and what they were rendered with
+    struct Accumulation {
+        std::vector<glm::vec3> radianceSum;
+        GuideBuffers guides;                 // what the centre of every pixel shows, for the denoiser
+        size_t width = 0;
+        size_t height = 0;
+        uint32_t samplesPerPixel = 0;
+        uint32_t passIndex = 0;              // seeds the random streams, never reset so no pass repeats another
+        std::string scene;
+        glm::vec3 cameraPosition{};
+        glm::mat3 cameraOrientation{};
+        std::chrono::steady_clock::time_point start;
+        uint32_t nextReport = 1;             // samples per pixel at which the rate is logged next
+    };
+
+    Accumulation accumulation;
+    // written by the pass on the render job thread, read by the main loop
+    std::atomic<float> lastSamplesPerSecond{-1.0f};
+
+    const PathTracedScene &getPathTracedScene(const std::string &filename, const std::string &materialFilename) {
+        static std::map<std::string, PathTracedScene> cache;
+        std::string key = filename + "|" + materialFilename;
+        auto found = cache.find(key);
+        if (found != cache.end()) return found->second;
+        std::vector<ModelTriangle> triangles = loadOBJ(filename, 0.35, materialFilename);
+        PathTracedScene &scene = cache[key];
+        scene.triangles = splitTriangles(triangles, getMaterials(materialFilename));
+        scene.bvh = buildBVH(scene.triangles.positions);
+        scene.modelCenter = calculateModelCenter(triangles);
+        return scene;
+    }
+
+    glm::vec3 toVector(const Colour &colour) {
+        return glm::vec3(colour.red, colour.green, colour.blue) / 255.0f;
+    }
+
+    // a direction around normal with a probability proportional to its cosine with the normal
+    glm::vec3 sampleCosineHemisphere(const glm::vec3 &normal, uint32_t &randomState) {
+        float radius = std::sqrt(nextRandom(randomState));
+        float angle = 2.0f * float(M_PI) * nextRandom(randomState);
+        glm::vec3 tangent = glm::normalize(std::abs(normal.x) > 0.9f ? glm::cross(normal, glm::vec3(0, 1, 0))
+                                                                     : glm::cross(normal, glm::vec3(1, 0, 0)));
+        glm::vec3 bitangent = glm::cross(normal, tangent);
+        float height = std::sqrt(std::max(0.0f, 1.0f - radius * radius));
+        return glm::normalize(radius * std::cos(angle) * tangent + radius * std::sin(angle) * bitangent + height * normal);
+    }
+
+    // schlick's approximation of how much light a dielectric reflects
+    float fresnelReflectance(float cosine, float indexOfRefraction) {
+        float r0 = (1.0f - indexOfRefraction) / (1.0f + indexOfRefraction);
+        r0 *= r0;
+        return r0 + (1.0f - r0) * std::pow(1.0f - cosine, 5.0f);
+    }
+
+    // the light arriving straight from the area light at a diffuse point, already multiplied by its brdf, one random
+    // point on the light per call, the light shines down the side its edges turn clockwise on
+    glm::vec3 sampleDirectLight(const PathTracedScene &scene, const AreaLight &light, float lightIntensity,
+                                const RayTriangleIntersection &intersection, const glm::vec3 &normal,
+                                const glm::vec3 &albedo, uint32_t &randomState) {
+        glm::vec3 lightPoint = light.corner + nextRandom(randomState) * light.edgeU + nextRandom(randomState) * light.edgeV;
+        glm::vec3 lightNormal = glm::normalize(glm::cross(light.edgeU, light.edgeV));
+        glm::vec3 toLight = lightPoint - intersection.intersectionPoint;
+        float distanceSquared = glm::dot(toLight, toLight);
+        glm::vec3 lightDirection = toLight / std::sqrt(distanceSquared);
+        float cosine = glm::dot(normal, lightDirection);
+        float lightCosine = -glm::dot(lightNormal, lightDirection);
+        if (cosine <= 0.0f || lightCosine <= 0.0f) return glm::vec3(0.0f);
+        RayTriangleIntersection shadowIntersection = intersectBVH(
+                scene.bvh, scene.triangles, intersection.intersectionPoint + normal * 0.001f, lightDirection);
+        if (isInShadow(intersection, shadowIntersection, intersection.intersectionPoint, lightPoint)) return glm::vec3(0.0f);
+        // a lambertian emitter of that intensity, the area of its radiance and of the sampling density cancel
+        return albedo * float(1.0 / M_PI) * lightIntensity * cosine * lightCosine / distanceSquared;
+    }
+
+    // follows the ray through the centre of a pixel past mirrors and glass, always refracting, to the first surface
+    // that scatters light, what the denoiser should keep the edges of
+    void writeGuides(const PathTracedScene &scene, GuideBuffers &guides, size_t index, glm::vec3 origin,
+                     glm::vec3 direction) {
+        for (int bounce = 0; bounce < pathTracingSettings.maxBounces; bounce++) {
+            RayTriangleIntersection intersection = intersectBVH(scene.bvh, scene.triangles, origin, direction);
+            if (intersection.distanceFromCamera == std::numeric_limits<float>::infinity()) return;
+            const Material &material = scene.triangles.material(intersection);
+            glm::vec3 normal = intersection.intersectedTriangle.normal;
+            bool isEntering = glm::dot(direction, normal) < 0.0f;
+            glm::vec3 facingNormal = isEntering ? normal : -normal;
+            if (material.isGlass) {
+                float ratio = isEntering ? 1.0f / material.indexOfRefraction : material.indexOfRefraction;
+                glm::vec3 refracted = glm::refract(direction, facingNormal, ratio);
+                if (glm::dot(refracted, refracted) == 0.0f) {
+                    direction = glm::reflect(direction, facingNormal);
+                    origin = intersection.intersectionPoint + facingNormal * 0.001f;
+                } else {
+                    direction = glm::normalize(refracted);
+                    origin = intersection.intersectionPoint - facingNormal * 0.001f;
+                }
+            } else if (material.isMirror && material.reflectivity >= 0.5f) {
+                direction = glm::reflect(direction, facingNormal);
+                origin = intersection.intersectionPoint + facingNormal * 0.001f;
+            } else {
+                guides.write(index, intersection, facingNormal, toVector(material.colour));
+                return;
+            }
+        }
+    }
+
+    glm::vec3 tracePath(const PathTracedScene &scene, const AreaLight &light, float lightIntensity, glm::vec3 origin,
+                        glm::vec3 direction, uint32_t &randomState) {
+        glm::vec3 radiance(0.0f), throughput(1.0f);
+        for (int bounce = 0; bounce < pathTracingSettings.maxBounces; bounce++) {
+            RayTriangleIntersection intersection = intersectBVH(scene.bvh, scene.triangles, origin, direction);
+            if (intersection.distanceFromCamera == std::numeric_limits<float>::infinity()) break;
+            const Material &material = scene.triangles.material(intersection);
+            glm::vec3 normal = intersection.intersectedTriangle.normal;
+            bool isEntering = glm::dot(direction, normal) < 0.0f;
+            glm::vec3 facingNormal = isEntering ? normal : -normal;
+
+            if (material.isGlass) {
+                // reflect or refract with the fresnel probabilities, the weights cancel so the throughput stays
+                float ratio = isEntering ? 1.0f / material.indexOfRefraction : material.indexOfRefraction;
+                float cosine = -glm::dot(direction, facingNormal);
+                glm::vec3 refracted = glm::refract(direction, facingNormal, ratio);
+                bool isTotallyReflected = glm::dot(refracted, refracted) == 0.0f;
+                if (isTotallyReflected || nextRandom(randomState) < fresnelReflectance(cosine, material.indexOfRefraction)) {
+                    direction = glm::reflect(direction, facingNormal);
+                    origin = intersection.intersectionPoint + facingNormal * 0.001f;
+                } else {
+                    direction = glm::normalize(refracted);
+                    origin = intersection.intersectionPoint - facingNormal * 0.001f;
+                }
+                continue;
+            }
+            if (material.isMirror && nextRandom(randomState) < material.reflectivity) {
+                // a mirror with a reflectivity below 1 is a diffuse surface the rest of the time, like mixReflection
+                direction = glm::reflect(direction, facingNormal);
+                origin = intersection.intersectionPoint + facingNormal * 0.001f;
+                continue;
+            }
+
+            glm::vec3 albedo = toVector(material.colour);
+            radiance += throughput * sampleDirectLight(scene, light, lightIntensity, intersection, facingNormal,
+                                                        albedo, randomState);
+            // cosine weighted sampling cancels the cosine and the 1 / pi of the brdf, only the albedo is left
+            throughput *= albedo;
+            if (bounce >= pathTracingSettings.minBounces) {
+                float survival = std::min(0.95f, std::max(throughput.x, std::max(throughput.y, throughput.z)));
+                if (nextRandom(randomState) >= survival) break;
+                throughput /= survival;
+            }
+            direction = sampleCosineHemisphere(facingNormal, randomState);
+            origin = intersection.intersectionPoint + facingNormal * 0.001f;
+        }
+        return radiance;
+    }
+}
+
+void resetPathTracing() {
+    accumulation.samplesPerPixel = 0;
+    accumulation.width = 0;
+    lastSamplesPerSecond = -1.0f;
+}
+
+float lastPathTracingSamplesPerSecond() {
+    return lastSamplesPerSecond;
+}
+
+void renderPathTracedPass(DrawingWindow &window, const std::string &filename, float focalLength,
+                          const std::string &materialFilename) {
+    const PathTracedScene &scene = getPathTracedScene(filename, materialFilename);
+    const SceneLights &lights = getSceneLights(filename);
+    cameraOrientation = lookAt(scene.modelCenter);
+
+    std::string sceneKey = filename + "|" + materialFilename;
+    if (accumulation.width != window.width || accumulation.height != window.height || accumulation.scene != sceneKey ||
+        accumulation.cameraPosition != cameraPosition || accumulation.cameraOrientation != cameraOrientation) {
+        accumulation.width = window.width;
+        accumulation.height = window.height;
+        accumulation.scene = sceneKey;
+        accumulation.cameraPosition = cameraPosition;
+        accumulation.cameraOrientation = cameraOrientation;
+        accumulation.samplesPerPixel = 0;
+    }
+    if (accumulation.samplesPerPixel == 0) {
+        accumulation.radianceSum.assign(window.width * window.height, glm::vec3(0.0f));
+        accumulation.guides.resize(window.width, window.height);
+        accumulation.start = std::chrono::steady_clock::now();
+        accumulation.nextReport = 1;
+    }
+
+    // the worker threads do not see this thread's camera
+    // the point lights are too small to path trace without fireflies around them, their intensities light the area
+    // light of the scene instead, which the soft shadow mode samples as well
+    float lightIntensity = 0.0f;
+    for (float intensity : lights.intensity) lightIntensity += intensity;
+    lightIntensity *= pathTracingSettings.lightScale;
+    glm::vec3 camera = cameraPosition;
+    glm::mat3 orientation = cameraOrientation;
+    uint32_t passIndex = accumulation.passIndex++;
+    int samples = std::max(1, pathTracingSettings.samplesPerPass);
+    float weight = 1.0f / float(accumulation.samplesPerPixel + samples);
+    bool isFirstPass = accumulation.samplesPerPixel == 0;
+    const CameraRayTable &rays = getCameraRayTable(window.width, window.height, focalLength, orientation);
+    parallelFor(window.height, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; y++) {
+            for (size_t x = 0; x < window.width; x++) {
+                size_t index = y * window.width + x;
+                uint32_t randomState = hashSeed(uint32_t(index) ^ hashSeed(passIndex * 0x9e3779b9u + 1));
+                glm::vec3 &sum = accumulation.radianceSum[index];
+                if (isFirstPass) {
+                    writeGuides(scene, accumulation.guides, index, camera, rays.direction(float(x), float(y)));
+                }
+                for (int sample = 0; sample < samples; sample++) {
+                    // a random point inside the pixel, the average over the passes is anti aliased
+                    float jitterX = nextRandom(randomState) - 0.5f, jitterY = nextRandom(randomState) - 0.5f;
+                    glm::vec3 rayDirection = computeRayDirection(window.width, window.height, float(x) + jitterX,
+                                                                 float(y) + jitterY, focalLength, orientation);
+                    sum += tracePath(scene, lights.areaLight, lightIntensity, camera, rayDirection, randomState);
+                }
+            }
+        }
+    });
+
+    // the accumulation itself stays raw, only what is shown is denoised
+    std::vector<glm::vec3> average(accumulation.radianceSum.size());
+    for (size_t i = 0; i < average.size(); i++) average[i] = accumulation.radianceSum[i] * weight;
+    if (pathTracingSettings.denoiser.enabled) denoiseImage(average, accumulation.guides, pathTracingSettings.denoiser);
+    uint32_t *pixels = window.getPixelBuffer();
+    for (size_t i = 0; i < average.size(); i++) {
+        glm::vec3 colour = glm::clamp(average[i] * pathTracingSettings.exposure, 0.0f, 1.0f) * 255.0f;
+        pixels[i] = (255 << 24) | (int(colour.r) << 16) | (int(colour.g) << 8) | int(colour.b);
+    }
+    accumulation.samplesPerPixel += uint32_t(samples);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - accumulation.start).count();
+    double pathsPerSecond = double(accumulation.samplesPerPixel) * double(window.width * window.height) /
+                            std::max(seconds, 1e-6);
+    lastSamplesPerSecond = float(pathsPerSecond);
+    if (accumulation.samplesPerPixel >= accumulation.nextReport) {
+        LOG_INFO(LogCategory::RayTrace, "Path tracing, " << accumulation.samplesPerPixel << " samples per pixel, "
+                                        << pathsPerSecond / 1e6 << " million samples per second");
+        while (accumulation.nextReport <= accumulation.samplesPerPixel) accumulation.nextReport *= 2;
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef REDNOISE_PATHTRACING_H
+#define REDNOISE_PATHTRACING_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <DrawingWindow.h>
+#include "glm/glm.hpp"
+#include "Denoiser.h"
+
+struct PathTracingSettings {
+    int samplesPerPass = 1;      // paths added to every pixel each time renderPathTracedPass is called
+    int minBounces = 3;          // russian roulette may end a path only after this many bounces
+    int maxBounces = 16;
+    float lightScale = 4.0f;     // radiant intensity of the area light per unit of .lights intensity, about as bright
+                                 // as the other modes with their ambient light
+    float exposure = 1.0f;       // the average radiance is scaled by this before it is clamped to the window colours
+    DenoiserSettings denoiser;   // what is shown is filtered, 8 samples per pixel then look like 64 without it
+};
+
+extern PathTracingSettings pathTracingSettings;
+
+// one progressive pass of unbiased path tracing: every pixel gets samplesPerPass more paths, added to a float
+// accumulation buffer, and the window shows the average of everything accumulated so far
+// a path bounces off diffuse surfaces in a cosine weighted direction, follows mirrors and glass (chosen between
+// reflection and refraction by fresnel) exactly, and at every diffuse hit a shadow ray is sent to a random point of
+// the area light, paths are ended at random once they have bounced minBounces times and carry little light,
+// the buffer starts over when the camera, the window size or the scene changed since the last pass
+// with denoiser.enabled the window shows the average after the denoiser, guided by the first surface
+// behind every pixel centre that is not a mirror or glass, the accumulation itself is never filtered
+// rows are shared out over the cores, every pixel draws from its own random stream seeded from the pixel and the
+// pass, so the image does not depend on the number of threads
+void renderPathTracedPass(DrawingWindow &window, const std::string &filename, float focalLength,
+                          const std::string &materialFilename);
+
+// makes the next pass start a new accumulation
+void resetPathTracing();
+
+// the paths traced per second since the accumulation started, as of the last pass, negative before the first pass
+// after a reset, the main loop shows it in the window title so it is there in release builds too
+float lastPathTracingSamplesPerSecond();
+
+#endif //REDNOISE_PATHTRACING_H
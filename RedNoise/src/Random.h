@@ -0,0 +1,34 @@
+#ifndef REDNOISE_RANDOM_H
+#define REDNOISE_RANDOM_H
+
+#include <cstdint>
+#include <cstring>
+#include "glm/glm.hpp"
+
+// scramble a seed so that neighbouring pixels or points do not get similar random sequences
+inline uint32_t hashSeed(uint32_t value) {
+    value ^= value >> 16;
+    value *= 0x7feb352d;
+    value ^= value >> 15;
+    value *= 0x846ca68b;
+    value ^= value >> 16;
+    // xorshift gets stuck on 0
+    return value == 0 ? 1 : value;
+}
+
+// seed from the bits of a position, the same point always gets the same sequence
+inline uint32_t hashPoint(const glm::vec3 &point) {
+    uint32_t bits[3];
+    std::memcpy(bits, &point[0], sizeof(bits));
+    return hashSeed(bits[0] ^ hashSeed(bits[1] ^ hashSeed(bits[2])));
+}
+
+// xorshift, cheap and good enough for picking samples, returns a float in [0, 1)
+inline float nextRandom(uint32_t &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+#endif //REDNOISE_RANDOM_H
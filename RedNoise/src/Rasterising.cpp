@@ -1,15 +1,11 @@
 #include "Rasterising.h"
+#include "Log.h"
+#include "FrameArena.h"
 
-std::vector<std::vector<float>> initialiseDepthBuffer(int width, int height) {
-    std::vector<std::vector<float>> depthBuffer;
-    for (int y = 0; y < height; y++) {
-        std::vector<float> row;
-        for (int x = 0; x < width; x++) {
-            row.push_back(0);
-        }
-        depthBuffer.push_back(row);
-    }
-    return depthBuffer;
+void initialiseDepthBuffer(std::vector<std::vector<float>> &depthBuffer, int width, int height) {
+    // the rows keep their memory from the last frame, only a bigger window allocates
+    depthBuffer.resize(height);
+    for (std::vector<float> &row : depthBuffer) row.assign(width, 0.0f);
 }
 
 //middle in Axis-Aligned Bounding Box (AABB)
@@ -43,7 +39,8 @@ glm::mat3 lookAt(glm::vec3 target) {
 }
 
 void renderPointCloud(DrawingWindow &window, const std::string& filename, float focalLength, TextureMap &textureMap,const std::string& materialFilename) {
-    std::vector<ModelTriangle> triangles = loadOBJ(filename, 0.35,materialFilename);
+    // the model is parsed once per file, not on every redraw
+    const std::vector<ModelTriangle> &triangles = getModel(filename, 0.35, materialFilename);
     glm::vec3 ModelCenter = calculateModelCenter(triangles);
     float degree = 1.0f;
     float orbitRotationSpeed = degree * (M_PI / 180.0f);
@@ -52,12 +49,12 @@ void renderPointCloud(DrawingWindow &window, const std::string& filename, float
 //    rotate, this will rotate the camera and let it look at the center of the model
     cameraOrientation = lookAt(ModelCenter);
 
-    std::cout << "Loaded " << triangles.size() << " triangles" << std::endl;
-
+    const std::vector<Material> &materials = getMaterials(materialFilename);
     for (const auto& triangle : triangles) {
         CanvasPoint projectedPoints[3];
         for (int i = 0; i < 3; i++) {
-            projectedPoints[i] = getCanvasIntersectionPoint(cameraPosition, triangle.vertices[i], focalLength);
+            projectedPoints[i] = getCanvasIntersectionPoint(cameraPosition, triangle.vertices[i], focalLength,
+                                                            int(window.width), int(window.height));
 
             // here is to calculate the texture point coordinate by remapping the range of u and v to [0, width] and [0, height]
             // if the texture point is not 0,0, then we need to expand the texture point coordinate
@@ -71,12 +68,14 @@ void renderPointCloud(DrawingWindow &window, const std::string& filename, float
             }
         }
         drawTextureTriangle(window, CanvasTriangle(projectedPoints[0], projectedPoints[1], projectedPoints[2]),
-                            Colour(triangle.colour.red, triangle.colour.green, triangle.colour.blue), textureMap);
+                            Colour(materials[triangle.materialId].colour.red, materials[triangle.materialId].colour.green,
+                                   materials[triangle.materialId].colour.blue), textureMap);
     }
 }
 
 
-CanvasPoint getCanvasIntersectionPoint(glm::vec3 cameraPosition, glm::vec3 vertexPosition, float focalLength) {
+CanvasPoint getCanvasIntersectionPoint(glm::vec3 cameraPosition, glm::vec3 vertexPosition, float focalLength,
+                                       int screenWidth, int screenHeight) {
 
     CanvasPoint canvasPoint;
     glm::vec3 relativePosition = vertexPosition - cameraPosition;
@@ -85,12 +84,12 @@ CanvasPoint getCanvasIntersectionPoint(glm::vec3 cameraPosition, glm::vec3 verte
 
     // Compute the projection using the formulas
     float canvasX = focalLength * (vertexPositionNew[0] / vertexPositionNew[2]);
-    canvasX *= 150;
+    canvasX *= imagePlaneScale(screenWidth);
     // move the origin to the center of the screen
-    canvasX = canvasX + WIDTH / 2.0f;
+    canvasX = canvasX + screenWidth / 2.0f;
     float canvasY = focalLength * (vertexPositionNew[1] / vertexPositionNew[2]);
-    canvasY *= 150;
-    canvasY = canvasY + HEIGHT / 2.0f;
+    canvasY *= imagePlaneScale(screenWidth);
+    canvasY = canvasY + screenHeight / 2.0f;
     canvasPoint.x = canvasX;
     canvasPoint.y = canvasY;
     canvasPoint.depth = vertexPositionNew[2];
@@ -98,25 +97,23 @@ CanvasPoint getCanvasIntersectionPoint(glm::vec3 cameraPosition, glm::vec3 verte
 }
 
 void DrawWireframe(DrawingWindow &window, const std::string& filename, float focalLength,const std::string& materialFilename) {
-    std::vector<ModelTriangle> triangles = loadOBJ(filename, 0.35,materialFilename);
-    glm::vec3 ModelCenter = calculateModelCenter(triangles);
+    // the edge list only depends on the model, so it is built once per file and reused on every redraw
+    static std::string cachedModel;
+    static WireframeMesh mesh;
+    if (cachedModel != filename + "|" + materialFilename) {
+        std::vector<ModelTriangle> triangles = loadOBJ(filename, 0.35,materialFilename);
+        mesh = buildWireframeMesh(triangles, getMaterials(materialFilename));
+        cachedModel = filename + "|" + materialFilename;
+        LOG_INFO(LogCategory::Raster, "Loaded " << triangles.size() << " triangles, " << mesh.edges.size() << " unique edges");
+    }
     float degree = 1.0f;
     float orbitRotationSpeed = degree * (M_PI / 180.0f);
     //translate, this is just move the camera
-    cameraPosition = orbitCameraAroundY(cameraPosition, orbitRotationSpeed, ModelCenter);
+    cameraPosition = orbitCameraAroundY(cameraPosition, orbitRotationSpeed, mesh.modelCenter);
 //    rotate, this will rotate the camera and let it look at the center of the model
-    cameraOrientation = lookAt(ModelCenter);
+    cameraOrientation = lookAt(mesh.modelCenter);
 
-    std::cout << "Loaded " << triangles.size() << " triangles" << std::endl;
-
-    for (const auto& triangle : triangles) {
-        CanvasPoint projectedPoints[3];
-        for (int i = 0; i < 3; i++) {
-            projectedPoints[i] = getCanvasIntersectionPoint(cameraPosition, triangle.vertices[i], focalLength);
-        }
-        drawTriangle(window, CanvasTriangle(projectedPoints[0], projectedPoints[1], projectedPoints[2]),
-                     Colour(triangle.colour.red, triangle.colour.green, triangle.colour.blue));
-    }
+    drawWireframeMesh(window, mesh, focalLength);
 }
 
 
@@ -125,9 +122,8 @@ void DrawWireframe(DrawingWindow &window, const std::string& filename, float foc
 
 //This function is Deprecated, substitute by drawTextureTriangle
 void drawFilledTriangle (DrawingWindow &window, CanvasTriangle triangle, Colour colour) {
-    std :: cout << "drawFilledTriangle is called" << std::endl;
-    // print out the triangle
-    std :: cout << triangle << std::endl;
+    // print out the triangle, only when raster tracing is switched on
+    LOG_TRACE(LogCategory::Raster, "drawFilledTriangle is called " << triangle);
 
     CanvasPoint bottom = triangle[0];
     CanvasPoint middle = triangle[1];
@@ -138,8 +134,9 @@ void drawFilledTriangle (DrawingWindow &window, CanvasTriangle triangle, Colour
     if (bottom.y > top.y) {std::swap(bottom, top);}
     if (middle.y > top.y) {std::swap(middle, top);}
     // now bottom.y <= middle.y <= top.y
+    ArenaScope triangleScope;
 
-    std :: vector<CanvasPoint> pointsBottomToTop = interpolateCanvasPoint(bottom, top, int(top.y) - int(bottom.y) + 1);
+    ArenaVector<CanvasPoint> pointsBottomToTop = interpolateCanvasPoint(bottom, top, int(top.y) - int(bottom.y) + 1);
 
     CanvasPoint extraPoint = pointsBottomToTop[int(middle.y) - int(bottom.y)];
 
@@ -166,8 +163,9 @@ void drawPartTriangle (DrawingWindow &window, CanvasTriangle triangle, Colour co
     }
 
     // Peak is the top or the bottom point
-    std :: vector<CanvasPoint> pointsBetweenMiddleAndPeak;
-    std :: vector<CanvasPoint> pointsBetweenExtraAndPeak;
+    ArenaScope edgeScope;
+    ArenaVector<CanvasPoint> pointsBetweenMiddleAndPeak;
+    ArenaVector<CanvasPoint> pointsBetweenExtraAndPeak;
 
     if (yStart == int(MiddlePoint.y)){
         // this means we need draw the bottom half triangle
@@ -183,12 +181,13 @@ void drawPartTriangle (DrawingWindow &window, CanvasTriangle triangle, Colour co
     //Always Draw the horizontal line from the bottomY to the middle
     // also from the Horizontal line from the points between middle and peak to the points between extra and peak
     for (int i = yStart; i < yEnd; i++) {
+        ArenaScope scanlineScope;
         int y = i;
         if (pointsBetweenMiddleAndPeak[i - yStart].x > pointsBetweenExtraAndPeak[i - yStart].x) {
             std :: swap(pointsBetweenMiddleAndPeak[i - yStart], pointsBetweenExtraAndPeak[i - yStart]);
         }
 
-        std::vector<float> XlineDepth =interpolateSingleFloats(pointsBetweenMiddleAndPeak[i - yStart].depth,
+        ArenaVector<float> XlineDepth =interpolateSingleFloats(pointsBetweenMiddleAndPeak[i - yStart].depth,
                                                                 pointsBetweenExtraAndPeak[i - yStart].depth,
                                                                 pointsBetweenExtraAndPeak[i - yStart].x -
                                                                 pointsBetweenMiddleAndPeak[i - yStart].x + 1);
@@ -5,8 +5,6 @@
 #ifndef REDNOISE_RASTERISING_H
 #define REDNOISE_RASTERISING_H
 
-#endif //REDNOISE_RASTERISING_H
-
 #include "CanvasTriangle.h"
 #include "DrawingWindow.h"
 #include "ModelTriangle.h"
@@ -17,19 +15,30 @@
 #include "Globals.h"
 #include "DrawTextureTriangle.h"
 #include "RotateCamera.h"
+#include "Wireframe.h"
 
 
 #define WIDTH 320
 #define HEIGHT 240
 
-std::vector<std::vector<float>> initialiseDepthBuffer(int width, int height);
+// pixels per unit on the image plane, 150 across a window WIDTH pixels wide, a smaller window of the same shape sees
+// the same view with fewer pixels
+inline float imagePlaneScale(size_t screenWidth) {
+    return 150.0f * float(screenWidth) / float(WIDTH);
+}
+
+// every depth set to 0, which is further than anything, in place
+void initialiseDepthBuffer(std::vector<std::vector<float>> &depthBuffer, int width, int height);
 glm::vec3 calculateModelCenter(const std::vector<ModelTriangle>& triangles);
 glm::mat3 lookAt(glm::vec3 target);
-CanvasPoint getCanvasIntersectionPoint(glm::vec3 cameraPosition, glm::vec3 vertexPosition, float focalLength);
+CanvasPoint getCanvasIntersectionPoint(glm::vec3 cameraPosition, glm::vec3 vertexPosition, float focalLength,
+                                       int screenWidth = WIDTH, int screenHeight = HEIGHT);
 void renderPointCloud(DrawingWindow &window, const std::string& filename, float focalLength,
                       TextureMap &textureMap,const std::string& materialFilename);
 void DrawWireframe(DrawingWindow &window, const std::string& filename, float focalLength,const std::string& materialFilename);
 
 //these two function is Deprecated, substitute by drawTextureTriangle
 void drawFilledTriangle (DrawingWindow &window, CanvasTriangle triangle, Colour colour);
-void drawPartTriangle (DrawingWindow &window, CanvasTriangle triangle, Colour colour);
\ No newline at end of file
+void drawPartTriangle (DrawingWindow &window, CanvasTriangle triangle, Colour colour);
+
+#endif //REDNOISE_RASTERISING_H
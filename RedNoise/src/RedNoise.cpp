@@ -16,6 +16,16 @@
 #include "EnvironmentMapping.h"
 #include "normalMap.h"
 #include "SoftShadowRendering.h"
+#include "HybridRendering.h"
+#include "DistributedRendering.h"
+#include "AnimationRendering.h"
+#include "OutOfCore.h"
+#include "InstancedScene.h"
+#include "PathTracing.h"
+#include "RenderJob.h"
+#include "DynamicResolution.h"
+#include "Log.h"
+#include <glm/gtc/matrix_transform.hpp>
 #include <iomanip>
 #include <sstream>
 
@@ -23,20 +33,58 @@
 #define HEIGHT 240
 
 int counter = 0;
-bool isDefaultMode = true;
+// the main loop starts this once every queued event is handled, so holding a camera key moves the camera many steps
+// but starts only one render
+RenderJob pendingJob;
+// the render of the last mode key, the camera keys queue it again from the new position
+RenderJob lastModeJob;
+// the out of core mode is the last mode, the title shows its cluster cache hit rate
+bool isOutOfCoreMode = false;
+// the path tracing mode is the last mode, the title shows how many samples per second it traces
+bool isPathTracingMode = false;
+
+// the keys that move the camera or switch the shadows or the denoiser, the last mode renders again after them
+bool isRedrawKey(SDL_Keycode key) {
+    return key == SDLK_i || key == SDLK_k || key == SDLK_j || key == SDLK_l || key == SDLK_w || key == SDLK_s ||
+           key == SDLK_a || key == SDLK_d || key == SDLK_q || key == SDLK_e || key == SDLK_m || key == SDLK_v;
+}
+
+// the render of a mode key, it runs on the render job thread while the window stays responsive
+void queueRenderJob(RenderJob job) {
+    pendingJob = job;
+    lastModeJob = std::move(job);
+}
+
+// a mode render previewed at the resolution that keeps camera moves interactive, see dynamicResolutionSettings
+void queueScaledRenderJob(DrawingWindow &window, std::function<void(DrawingWindow &)> render) {
+    queueRenderJob([&window, render]() { renderAtDynamicResolution(window, render); });
+}
 
 void handleEvent(SDL_Event event, DrawingWindow &window) {
     if (event.type == SDL_KEYDOWN) {
+        SDL_Keycode key = event.key.keysym.sym;
+        // the render still running uses the camera and the settings the keys change, so it stops first, at its next
+        // row or tile, saving the image stops it too, the file gets what the window shows and the render goes on after
+        bool wasRendering = isRenderJobRunning();
+        cancelRenderJob();
+        if (isRedrawKey(key) || (key == SDLK_g && wasRendering)) {
+            pendingJob = lastModeJob;
+        } else if (key != SDLK_g) {
+            pendingJob = nullptr;
+            lastModeJob = nullptr;
+            isOutOfCoreMode = false;
+            isPathTracingMode = false;
+        }
         if (event.key.keysym.sym == SDLK_1) {
-            std::cout << "random triangle" << std::endl;
+            LOG_INFO(LogCategory::App, "random triangle");
             CanvasPoint p1(rand() % (window.width - 1), rand() % (window.height - 1));
             CanvasPoint p2(rand() % (window.width - 1), rand() % (window.height - 1));
             CanvasPoint p3(rand() % (window.width - 1), rand() % (window.height - 1));
             CanvasTriangle randomTriangle(p1, p2, p3);
             drawTriangle(window, randomTriangle, Colour(rand() % 255, rand() % 255, rand() % 255));
         } else if (event.key.keysym.sym == SDLK_2) {
-            std::cout << "draw filled triangle " << std::endl;
-            zBuffer = initialiseDepthBuffer(window.width, window.height);
+            LOG_INFO(LogCategory::App, "draw filled triangle");
+            initialiseDepthBuffer(zBuffer, window.width, window.height);
             CanvasPoint p1(rand() % (window.width - 1), rand() % (window.height - 1), rand() % 100);
             CanvasPoint p2(rand() % (window.width - 1), rand() % (window.height - 1), rand() % 100);
             CanvasPoint p3(rand() % (window.width - 1), rand() % (window.height - 1), rand() % 100);
@@ -48,9 +96,9 @@ void handleEvent(SDL_Event event, DrawingWindow &window) {
             TextureMap textureMap("../texture.ppm");
             drawTextureTriangle(window, randomTriangle, Colour(rand() % 255, rand() % 255, rand() % 255), textureMap);
         } else if (event.key.keysym.sym == SDLK_3) {
-            std::cout << "draw texture triangle" << std::endl;
+            LOG_INFO(LogCategory::App, "draw texture triangle");
             window.clearPixels();
-            zBuffer = initialiseDepthBuffer(window.width, window.height);
+            initialiseDepthBuffer(zBuffer, window.width, window.height);
             CanvasPoint p1(160, 10);
             p1.texturePoint = TexturePoint(195, 5);
             CanvasPoint p2(300, 230);
@@ -61,123 +109,236 @@ void handleEvent(SDL_Event event, DrawingWindow &window) {
             TextureMap textureMap("../texture.ppm");
             drawTextureTriangle(window, triangle,Colour(255, 255, 255), textureMap);
         } else if(event.key.keysym.sym == SDLK_4){
-            std::cout << "Wireframe 3D scene rendering" << std::endl;
-            window.clearPixels();  // Clear the window
-            DrawWireframe(window, "../cornell-box.obj", 2,"../material/cornell-box.mtl");
+            LOG_INFO(LogCategory::App, "Wireframe 3D scene rendering");
+            queueScaledRenderJob(window, [](DrawingWindow &target) {
+                target.clearPixels();  // Clear the window
+                DrawWireframe(target, "../cornell-box.obj", 2,"../material/cornell-box.mtl");
+            });
         } else if(event.key.keysym.sym == SDLK_5) {
-            std::cout << "Rasterising" << std::endl;
-            window.clearPixels();  // Clear the window
-            zBuffer = initialiseDepthBuffer(window.width, window.height);
-            TextureMap textureMap("../texture.ppm");
-            renderPointCloud(window, "../textured-cornell-box.obj", 2, textureMap,"../material/cornell-box.mtl");
+            LOG_INFO(LogCategory::App, "Rasterising");
+            queueScaledRenderJob(window, [](DrawingWindow &target) {
+                target.clearPixels();  // Clear the window
+                initialiseDepthBuffer(zBuffer, target.width, target.height);
+                // loaded once, the frames after the first go to the heap as little as possible
+                static TextureMap textureMap("../texture.ppm");
+                renderPointCloud(target, "../textured-cornell-box.obj", 2, textureMap,"../material/cornell-box.mtl");
+            });
         } else if (event.key.keysym.sym == SDLK_6) {
-            std::cout << "Ray Tracing, only reflection" << std::endl;
+            LOG_INFO(LogCategory::App, "Ray Tracing, only reflection");
             // this code contains reflection and refraction, but we choose not to load refraction material
-            window.clearPixels();
-            renderRayTracedScene(window, "../cornell-box.obj", 2,"../material/onlyReflection.mtl",1);
+            queueScaledRenderJob(window, [](DrawingWindow &target) {
+                target.clearPixels();
+                renderRayTracedScene(target, "../cornell-box.obj", 2,"../material/onlyReflection.mtl",1);
+            });
         } else if(event.key.keysym.sym == SDLK_7) {
-            std::cout << "Ray Tracing, only Refraction" << std::endl;
+            LOG_INFO(LogCategory::App, "Ray Tracing, only Refraction");
             // this code contains reflection and refraction, but we choose not to load reflection material
-            window.clearPixels();
-            renderRayTracedScene(window, "../cornell-box.obj", 2,"../material/onlyRefraction.mtl",1);
+            queueScaledRenderJob(window, [](DrawingWindow &target) {
+                target.clearPixels();
+                renderRayTracedScene(target, "../cornell-box.obj", 2,"../material/onlyRefraction.mtl",1);
+            });
         }else if(event.key.keysym.sym == SDLK_8) {
-            std::cout << "Ray Tracing, combined reflection and refraction!" << std::endl;
+            LOG_INFO(LogCategory::App, "Ray Tracing, combined reflection and refraction!");
             // test reflection and refraction together!!
-            window.clearPixels();
-            renderRayTracedScene(window, "../cornell-box.obj", 2,"../material/cornell-box.mtl",1);
+            queueScaledRenderJob(window, [](DrawingWindow &target) {
+                target.clearPixels();
+                renderRayTracedScene(target, "../cornell-box.obj", 2,"../material/cornell-box.mtl",1);
+            });
         }else if (event.key.keysym.sym == SDLK_9) {
-            std::cout << "Ray Tracing, rendering sphere by using flat shading, gouraud shading or phong shading !" << std::endl;
+            LOG_INFO(LogCategory::App, "Ray Tracing, rendering sphere by using flat shading, gouraud shading or phong shading !");
             cameraPosition = glm::vec3(0, 0.9, 1.9);
-            window.clearPixels();
-            // signalForShading = 1,2,3 represent flat shading, gouraud shading, phong shading
-//            renderRayTracedScene(window, "../sphere.obj", 1,"../material/sphere.mtl",1);
-//            renderRayTracedScene(window, "../sphere.obj", 1,"../material/sphere.mtl",2);
-            renderRayTracedScene(window, "../sphere.obj", 1,"../material/sphere.mtl",3);
+            queueScaledRenderJob(window, [](DrawingWindow &target) {
+                target.clearPixels();
+                // signalForShading = 1,2,3 represent flat shading, gouraud shading, phong shading
+//                renderRayTracedScene(target, "../sphere.obj", 1,"../material/sphere.mtl",1);
+//                renderRayTracedScene(target, "../sphere.obj", 1,"../material/sphere.mtl",2);
+                renderRayTracedScene(target, "../sphere.obj", 1,"../material/sphere.mtl",3);
+            });
         }else if(event.key.keysym.sym == SDLK_z){
-            std::cout << "Soft shadow!" << std::endl;
-            window.clearPixels();
-            renderRayTracedSceneSoftShadow(window, "../cornell-box.obj", 2,
-                                           "../material/cornell-box.mtl",1);
+            LOG_INFO(LogCategory::App, "Soft shadow!");
+            queueScaledRenderJob(window, [](DrawingWindow &target) {
+                target.clearPixels();
+                renderRayTracedSceneSoftShadow(target, "../cornell-box.obj", 2,
+                                               "../material/cornell-box.mtl",1);
+            });
+        }else if(event.key.keysym.sym == SDLK_h){
+            LOG_INFO(LogCategory::App, "Hybrid rendering, rasterised visibility + ray traced reflection and refraction!");
+            // same image as keypress 8, but the camera rays are replaced by a rasterised visibility buffer
+            queueScaledRenderJob(window, [](DrawingWindow &target) {
+                target.clearPixels();
+                renderHybridScene(target, "../cornell-box.obj", 2,"../material/cornell-box.mtl",1);
+            });
+        }else if(event.key.keysym.sym == SDLK_f){
+            LOG_INFO(LogCategory::App, "Final frame, keypress 8 split into tiles over worker processes");
+            // the workers are this program started with --tile-worker, see distributedRenderSettings
+            queueRenderJob([&window]() {
+                window.clearPixels();
+                renderDistributedScene(window, "../cornell-box.obj", 2,"../material/cornell-box.mtl",1);
+            });
+        }else if(event.key.keysym.sym == SDLK_o){
+            LOG_INFO(LogCategory::App, "Orbit animation of keypress 8, saved to ../Frames");
+            // a full turn around the model from where the camera is now, the frames render side by side on every core
+            float degree = 10.0f;
+            CameraPath path = makeOrbitPath(cameraPosition, glm::vec3(0, 0, 0), degree * (M_PI / 180.0f), 36);
+            // the frames go to disk, so this is not queued again when the camera moves
+            pendingJob = [&window, path]() {
+                renderRayTracedAnimation(WIDTH, HEIGHT, "../cornell-box.obj", 2, "../material/cornell-box.mtl", 1, path,
+                                         [&](int frameIndex, DrawingWindow &frame) {
+                    std::ostringstream filenameStream;
+                    filenameStream << "../Frames/orbit" << std::setfill('0') << std::setw(5) << frameIndex;
+                    frame.savePPM(filenameStream.str() + ".ppm");
+                    // the main loop shows the frames as they arrive
+                    std::copy(frame.getPixelBuffer(), frame.getPixelBuffer() + WIDTH * HEIGHT, window.getPixelBuffer());
+                    showRenderProgress(window);
+                });
+            };
+        }else if(event.key.keysym.sym == SDLK_u){
+            LOG_INFO(LogCategory::App, "Out of core ray tracing, the triangles are paged in from disk as clusters");
+            // the first press writes ../cornell-box.obj.clusters, see outOfCoreSettings for the cluster and cache sizes
+            isOutOfCoreMode = true;
+            queueScaledRenderJob(window, [](DrawingWindow &target) {
+                target.clearPixels();
+                renderOutOfCoreScene(target, "../cornell-box.obj", 2,"../material/cornell-box.mtl");
+            });
+        }else if(event.key.keysym.sym == SDLK_n){
+            LOG_INFO(LogCategory::App, "Instanced ray tracing, every mesh is stored once and placed by its instances");
+            queueScaledRenderJob(window, [](DrawingWindow &target) {
+                target.clearPixels();
+                renderInstancedScene(target, "../cornell-box.scene", 2);
+            });
+        }else if(event.key.keysym.sym == SDLK_b){
+            LOG_INFO(LogCategory::App, "Instanced ray tracing, the spheres hop a step further and the BVHs are refit");
+            InstancedScene &scene = getInstancedScene("../cornell-box.scene");
+            static std::vector<glm::mat4> restingTransforms;
+            static float hopTime = 0.0f;
+            if (restingTransforms.empty()) {
+                for (const MeshInstance &instance : scene.instances) restingTransforms.push_back(instance.objectToWorld);
+            }
+            hopTime += 0.3f;
+            // the first instance is the box, every sphere hops with its own phase
+            for (uint32_t i = 1; i < scene.instances.size(); i++) {
+                float height = 0.4f * std::abs(std::sin(hopTime + 0.7f * float(i)));
+                setInstanceTransform(scene, i, glm::translate(glm::mat4(1.0f), glm::vec3(0, height, 0)) * restingTransforms[i]);
+            }
+            queueScaledRenderJob(window, [](DrawingWindow &target) {
+                target.clearPixels();
+                renderInstancedScene(target, "../cornell-box.scene", 2);
+            });
+        }else if(event.key.keysym.sym == SDLK_p){
+            LOG_INFO(LogCategory::App, "Path tracing, the image keeps refining until the camera moves");
+            // one pass after another until the job is cancelled, see pathTracingSettings for the samples per pass and
+            // the light, a pass is short so it is only cancelled between passes
+            resetPathTracing();
+            isPathTracingMode = true;
+            queueRenderJob([&window]() {
+                while (!isRenderCancelled()) {
+                    renderPathTracedPass(window, "../cornell-box.obj", 2, "../material/cornell-box.mtl");
+                    showRenderProgress(window);
+                }
+            });
+        }else if(event.key.keysym.sym == SDLK_m){
+            // switch the ray traced modes between exact shadow rays and the cube shadow map
+            if (shadowMode == ShadowMode::ShadowRays) {
+                shadowMode = ShadowMode::CubeShadowMap;
+                LOG_INFO(LogCategory::App, "Shadows from the cube shadow map");
+            } else {
+                shadowMode = ShadowMode::ShadowRays;
+                LOG_INFO(LogCategory::App, "Shadows from exact shadow rays");
+            }
+        }else if(event.key.keysym.sym == SDLK_v){
+            // switch the denoiser of the path traced and soft shadow modes, the path tracer keeps its samples
+            bool isDenoising = !pathTracingSettings.denoiser.enabled;
+            pathTracingSettings.denoiser.enabled = isDenoising;
+            areaLightSettings.denoiser.enabled = isDenoising;
+            if (isDenoising) {
+                LOG_INFO(LogCategory::App, "Denoiser on");
+            } else {
+                LOG_INFO(LogCategory::App, "Denoiser off");
+            }
         }else if(event.key.keysym.sym == SDLK_x) {
             // environment mapping
-            std::cout << "Environment mapping!" << std::endl;
-            window.clearPixels();
-            TextureMap frontTexture("../skybox/front.ppm");
-            TextureMap backTexture("../skybox/back.ppm");
-            TextureMap leftTexture("../skybox/left.ppm");
-            TextureMap rightTexture("../skybox/right.ppm");
-            TextureMap topTexture("../skybox/top.ppm");
-            TextureMap bottomTexture("../skybox/bottom.ppm");
-            std::array<TextureMap, 6> textures = {
-                    rightTexture, leftTexture, topTexture, bottomTexture, frontTexture, backTexture
-            };
+            LOG_INFO(LogCategory::App, "Environment mapping!");
             cameraPosition = glm::vec3(0, 0, 0.5);
-            // we do not need to set this model to be a mirror
-            // because this function assume the model is a mirror
-            renderRayTracedSceneForEnv(window, "../envsphere.obj", 0.4,textures,"../material/cornell-box.mtl");
+            queueScaledRenderJob(window, [](DrawingWindow &target) {
+                target.clearPixels();
+                TextureMap frontTexture("../skybox/front.ppm");
+                TextureMap backTexture("../skybox/back.ppm");
+                TextureMap leftTexture("../skybox/left.ppm");
+                TextureMap rightTexture("../skybox/right.ppm");
+                TextureMap topTexture("../skybox/top.ppm");
+                TextureMap bottomTexture("../skybox/bottom.ppm");
+                std::array<TextureMap, 6> textures = {
+                        rightTexture, leftTexture, topTexture, bottomTexture, frontTexture, backTexture
+                };
+                // we do not need to set this model to be a mirror
+                // because this function assume the model is a mirror
+                renderRayTracedSceneForEnv(target, "../envsphere.obj", 0.4,textures,"../material/cornell-box.mtl");
+            });
         }else if(event.key.keysym.sym == SDLK_c){
-            std::cout << "Normal mapping!" << std::endl;
-            window.clearPixels();
-            TextureMap textureMap("../NormalMap/tex.ppm");
-            renderRayTracedSceneNormal(window, "../NormalMap/NormalMap.obj", 2,
-                                       textureMap,"../material/cornell-box.mtl");
+            LOG_INFO(LogCategory::App, "Normal mapping!");
+            queueScaledRenderJob(window, [](DrawingWindow &target) {
+                target.clearPixels();
+                TextureMap textureMap("../NormalMap/tex.ppm");
+                renderRayTracedSceneNormal(target, "../NormalMap/NormalMap.obj", 2,
+                                           textureMap,"../material/cornell-box.mtl");
+            });
 
 
             // below this line all key events are for camera control
         }else if (event.key.keysym.sym == SDLK_i) { // Pitch up
-            std::cout << "Pitch up" << std::endl;
+            LOG_INFO(LogCategory::Camera, "Pitch up");
             float degree = 1.0f;
             float orbitRotationSpeed = degree * (M_PI / 180.0f);
             // Orbit camera around X-axis at a defined speed.
             cameraPosition = orbitCameraAroundX(cameraPosition, orbitRotationSpeed, glm::vec3(0, 0, 0));
             cameraOrientation = lookAt(glm::vec3(0, 0, 0));
         } else if (event.key.keysym.sym == SDLK_k) { // Pitch down
-            std::cout << "Pitch down" << std::endl;
+            LOG_INFO(LogCategory::Camera, "Pitch down");
             float degree = 1.0f;
             float orbitRotationSpeed = degree * (M_PI / 180.0f);
             // Orbit camera in the reverse direction around X-axis at a defined speed.
             cameraPosition = orbitCameraAroundXInverse(cameraPosition, orbitRotationSpeed, glm::vec3(0, 0, 0));
             cameraOrientation = lookAt(glm::vec3(0, 0, 0));
         } else if (event.key.keysym.sym == SDLK_j) { // Yaw left
-            std::cout << "Yaw left" << std::endl;
+            LOG_INFO(LogCategory::Camera, "Yaw left");
             float degree = 1.0f;
             float orbitRotationSpeed = degree * (M_PI / 180.0f);
             // Orbit camera around Y-axis at a defined speed.
             cameraPosition = orbitCameraAroundY(cameraPosition, orbitRotationSpeed, glm::vec3(0, 0, 0));
             cameraOrientation = lookAt(glm::vec3(0, 0, 0));
         } else if (event.key.keysym.sym == SDLK_l) { // Yaw right
-            std::cout << "Yaw right" << std::endl;
+            LOG_INFO(LogCategory::Camera, "Yaw right");
             float degree = 1.0f;
             float orbitRotationSpeed = degree * (M_PI / 180.0f);
             // Orbit camera in the reverse direction around Y-axis at a defined speed.
             cameraPosition = orbitCameraAroundYInverse(cameraPosition, orbitRotationSpeed, glm::vec3(0, 0, 0));
             cameraOrientation = lookAt(glm::vec3(0, 0, 0));
         } else if (event.key.keysym.sym == SDLK_w){
-            std::cout << "move camera towards" << std::endl;
+            LOG_INFO(LogCategory::Camera, "move camera towards");
             cameraPosition = cameraPosition + glm::vec3(0, 0, -0.1);
             cameraOrientation = lookAt(glm::vec3(0, 0, 0));
         }else if (event.key.keysym.sym == SDLK_s){
-            std::cout << "move camera backwards" << std::endl;
+            LOG_INFO(LogCategory::Camera, "move camera backwards");
             cameraPosition = cameraPosition + glm::vec3(0, 0, 0.1);
             cameraOrientation = lookAt(glm::vec3(0, 0, 0));
         }else if (event.key.keysym.sym == SDLK_a) {
-            std::cout << "move camera left" << std::endl;
+            LOG_INFO(LogCategory::Camera, "move camera left");
             cameraPosition = cameraPosition + glm::vec3(-0.1, 0, 0);
             cameraOrientation = lookAt(glm::vec3(0, 0, 0));
         }else if (event.key.keysym.sym == SDLK_d) {
-            std::cout << "move camera right" << std::endl;
+            LOG_INFO(LogCategory::Camera, "move camera right");
             cameraPosition = cameraPosition + glm::vec3(0.1, 0, 0);
             cameraOrientation = lookAt(glm::vec3(0, 0, 0));
         }else if (event.key.keysym.sym == SDLK_q) {
-            std::cout << "move camera up" << std::endl;
+            LOG_INFO(LogCategory::Camera, "move camera up");
             cameraPosition = cameraPosition + glm::vec3(0, 0.1, 0);
             cameraOrientation = lookAt(glm::vec3(0, 0, 0));
         }else if (event.key.keysym.sym == SDLK_e) {
-            std::cout << "move camera down" << std::endl;
+            LOG_INFO(LogCategory::Camera, "move camera down");
             cameraPosition = cameraPosition + glm::vec3(0, -0.1, 0);
             cameraOrientation = lookAt(glm::vec3(0, 0, 0));
         }else if (event.key.keysym.sym == SDLK_g) {
-            std::cout << "mouse button down, save image!" << std::endl;
+            LOG_INFO(LogCategory::App, "mouse button down, save image!");
 
             std::ostringstream filenameStream;
             filenameStream << "../Frames/" << std::setfill('0') << std::setw(5) << counter;
@@ -191,20 +352,64 @@ void handleEvent(SDL_Event event, DrawingWindow &window) {
 }
 
 int main(int argc, char *argv[]) {
+	// a tile worker started by renderDistributedScene, it never opens a window
+	if (argc > 1 && std::string(argv[1]) == tileWorkerFlag) return runTileWorker();
 	DrawingWindow window = DrawingWindow(WIDTH, HEIGHT, false);
+	// a render may still be drawing into the window when it closes
+	window.beforeQuit = cancelRenderJob;
+	// the renders draw a few rows between frames, only those tiles are uploaded
+	window.isTrackingDirtyTiles = true;
 	SDL_Event event;
+    // this is default mode, we can change it by pressing key 1-9 and z,x,c to choose other mode
+    LOG_INFO(LogCategory::App, "Ray Tracing, combined reflection and refraction!");
+    queueScaledRenderJob(window, [](DrawingWindow &target) {
+        target.clearPixels();
+        renderRayTracedScene(target, "../cornell-box.obj", 2,"../material/cornell-box.mtl",1);
+    });
+	float shownScale = 0.0f;
+	int shownHitRate = -1;
+	int shownSampleRate = -1;
+	int64_t shownAllocations = -1;
 	while (true) {
+		// the resolution the previews render at goes in the title, it changes with how long the last preview took,
+		// in the out of core mode so does the cluster cache hit rate of the last frame, in the path tracing mode the
+		// samples per second, and in builds that count them the heap allocations of the last render
+		int hitRate = isOutOfCoreMode && lastClusterCacheHitRate() >= 0.0f
+		              ? int(lastClusterCacheHitRate() * 100.0f + 0.5f) : -1;
+		// in tenths of a million, so the title does not change with every pass
+		int sampleRate = isPathTracingMode && lastPathTracingSamplesPerSecond() >= 0.0f
+		                 ? int(lastPathTracingSamplesPerSecond() / 1e5f + 0.5f) : -1;
+		if (currentResolutionScale() != shownScale || hitRate != shownHitRate || sampleRate != shownSampleRate ||
+		    lastRenderJobHeapAllocations() != shownAllocations) {
+			shownScale = currentResolutionScale();
+			shownHitRate = hitRate;
+			shownSampleRate = sampleRate;
+			shownAllocations = lastRenderJobHeapAllocations();
+			std::ostringstream titleStream;
+			titleStream << "COMS30020 - preview at " << int(shownScale * 100.0f + 0.5f) << "%";
+			if (shownHitRate >= 0) titleStream << ", cluster cache hit rate " << shownHitRate << "%";
+			if (shownSampleRate >= 0) {
+				titleStream << ", " << shownSampleRate / 10 << "." << shownSampleRate % 10 << " million samples per second";
+			}
+			if (shownAllocations >= 0) titleStream << ", " << shownAllocations << " heap allocations per frame";
+			window.setTitle(titleStream.str());
+		}
 		// We MUST poll for events - otherwise the window will freeze !
-		if (window.pollForInputEvents(event)) handleEvent(event, window);
-		// Need to render the frame at the end, or nothing actually gets shown on the screen !
-        // this is default mode, we can change it by pressing key 1-9 and z,x,c to choose other mode
-        if (isDefaultMode){
-            std::cout << "Ray Tracing, combined reflection and refraction!" << std::endl;
-            window.clearPixels();
-            renderRayTracedScene(window, "../cornell-box.obj", 2,"../material/cornell-box.mtl",1);
-            isDefaultMode = false;
+		// every queued event is handled before a render starts, the renders run on the job thread meanwhile
+		while (window.pollForInputEvents(event)) handleEvent(event, window);
+        if (pendingJob) {
+            startRenderJob(window, pendingJob);
+            pendingJob = nullptr;
         }
-		window.renderFrame();
+		// Need to render the frame at the end, or nothing actually gets shown on the screen !
+		// while a job runs it swaps the buffers itself and this only shows the last rows it handed over
+		if (isRenderJobRunning()) {
+			window.presentFrame();
+		} else {
+			window.renderFrame();
+		}
+		// about 60 frames a second, the job thread gets the core the rest of the time
+		SDL_Delay(16);
 	}
 	return 0;
 }
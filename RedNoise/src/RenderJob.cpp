@@ -0,0 +1,160 @@
+#include "RenderJob.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "glm/glm.hpp"
+#include "Globals.h"
+#include "AllocationCounter.h"
+#include "FrameArena.h"
+#include "Log.h"
+
+namespace {
+    std::atomic<bool> isCancelled{false};
+    // waitUnlessCancelled sleeps on this, cancelRenderJob wakes it
+    std::mutex cancelMutex;
+    std::condition_variable cancelled;
+    std::atomic<bool> isFinished{true};
+    // the camera is thread_local, so it is handed to the job thread with the job and taken back once it is done,
+    // the mutex around handing over the job and reporting it done is all the synchronisation these need
+    glm::vec3 jobCameraPosition;
+    glm::mat3 jobCameraOrientation;
+    DrawingWindow *jobWindow = nullptr;
+    thread_local bool isJobThread = false;
+    // the finished rows are swapped about as often as the main loop presents them
+    const auto progressInterval = std::chrono::milliseconds(16);
+    std::chrono::steady_clock::time_point lastProgress;
+    std::atomic<int64_t> lastJobHeapAllocations{-1};
+
+    // one thread runs every job, started with the first one, so what it keeps per thread (the camera ray tables, the
+    // frame arena) lasts from one render to the next instead of being built again for every frame
+    class JobThread {
+    public:
+        ~JobThread() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                isStopping = true;
+            }
+            changed.notify_all();
+            if (thread.joinable()) thread.join();
+        }
+
+        void start(RenderJob job) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!thread.joinable()) thread = std::thread([this]() { run(); });
+            queuedJob = std::move(job);
+            isCollected = false;
+            isFinished = false;
+            changed.notify_all();
+        }
+
+        // false when there was no job since the last wait
+        bool wait() {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (isCollected) return false;
+            changed.wait(lock, []() { return isFinished.load(); });
+            isCollected = true;
+            return true;
+        }
+
+    private:
+        void run() {
+            isJobThread = true;
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                changed.wait(lock, [this]() { return isStopping || queuedJob; });
+                if (isStopping) return;
+                RenderJob job = std::move(queuedJob);
+                queuedJob = nullptr;
+                lock.unlock();
+                cameraPosition = jobCameraPosition;
+                cameraOrientation = jobCameraOrientation;
+                lastProgress = std::chrono::steady_clock::now();
+                uint64_t allocationsBefore = heapAllocationCount();
+                job();
+                jobWindow->swapBuffers();
+                // counted on every thread while the job ran, the main loop adds almost nothing
+                if (isCountingHeapAllocations()) {
+                    lastJobHeapAllocations = int64_t(heapAllocationCount() - allocationsBefore);
+                    LOG_INFO(LogCategory::App, "Render job made " << lastJobHeapAllocations.load()
+                                               << " heap allocations, frame arena peak "
+                                               << frameArena().peakBytes() / 1024 << " KB in "
+                                               << frameArena().heapAllocations() << " blocks");
+                }
+                jobCameraPosition = cameraPosition;
+                jobCameraOrientation = cameraOrientation;
+                // the job's captures go before it counts as finished, they may refer to what the caller frees next
+                job = nullptr;
+                lock.lock();
+                isFinished = true;
+                changed.notify_all();
+            }
+        }
+
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable changed;
+        RenderJob queuedJob;
+        bool isCollected = true;   // the camera of the last job was taken back
+        bool isStopping = false;
+    };
+
+    JobThread jobThread;
+}
+
+void startRenderJob(DrawingWindow &window, RenderJob job) {
+    cancelRenderJob();
+    jobCameraPosition = cameraPosition;
+    jobCameraOrientation = cameraOrientation;
+    jobWindow = &window;
+    jobThread.start(std::move(job));
+}
+
+void cancelRenderJob() {
+    {
+        std::lock_guard<std::mutex> lock(cancelMutex);
+        isCancelled = true;
+    }
+    cancelled.notify_all();
+    waitForRenderJob();
+    isCancelled = false;
+}
+
+void waitForRenderJob() {
+    if (!jobThread.wait()) return;
+    cameraPosition = jobCameraPosition;
+    cameraOrientation = jobCameraOrientation;
+}
+
+bool isRenderJobRunning() {
+    return !isFinished;
+}
+
+bool isRenderCancelled() {
+    return isCancelled.load(std::memory_order_relaxed);
+}
+
+void showRenderProgress(DrawingWindow &window) {
+    if (!isJobThread || &window != jobWindow) return;
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastProgress < progressInterval) return;
+    lastProgress = now;
+    window.swapBuffers();
+}
+
+void showRenderFrame(DrawingWindow &window) {
+    if (!isJobThread || &window != jobWindow) return;
+    lastProgress = std::chrono::steady_clock::now();
+    window.swapBuffers();
+}
+
+bool waitUnlessCancelled(int milliseconds) {
+    if (!isJobThread) return true;
+    std::unique_lock<std::mutex> lock(cancelMutex);
+    return !cancelled.wait_for(lock, std::chrono::milliseconds(milliseconds), []() { return isCancelled.load(); });
+}
+
+int64_t lastRenderJobHeapAllocations() {
+    return lastJobHeapAllocations;
+}
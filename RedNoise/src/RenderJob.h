@@ -0,0 +1,44 @@
+#ifndef REDNOISE_RENDERJOB_H
+#define REDNOISE_RENDERJOB_H
+
+#include <cstdint>
+#include <functional>
+#include <DrawingWindow.h>
+
+// a render that runs on its own thread while the main loop keeps polling events and showing the window, the rows it
+// has finished are swapped to the window's presentFrame as it goes
+using RenderJob = std::function<void()>;
+
+// cancels the running job and waits for it, then starts job with the camera of the calling thread, job draws into
+// window and its buffers are swapped once more when it is done
+void startRenderJob(DrawingWindow &window, RenderJob job);
+
+// asks the running job to stop at its next row or tile and waits for it, the window keeps what it drew so far and
+// the camera changes the renderer made (the orbiting modes) come back to the calling thread
+void cancelRenderJob();
+
+// waits for the running job to finish on its own, with the same camera hand back as cancelRenderJob
+void waitForRenderJob();
+
+// once it is false the job no longer touches its window, so the calling thread may swap the buffers itself
+bool isRenderJobRunning();
+
+// the renderers check this between rows and tiles and return early when it is set, it is never set outside a job so
+// renders called directly always finish
+bool isRenderCancelled();
+
+// the renderers call this between rows as well, on the job thread it swaps the buffers of the job's window about once
+// a frame so the finished rows show up, anywhere else it does nothing
+void showRenderProgress(DrawingWindow &window);
+// the same, but swaps right away, for a whole image the user is waiting to see such as a preview
+void showRenderFrame(DrawingWindow &window);
+
+// on the job thread, waits until milliseconds have passed or the job is cancelled, false when it was cancelled,
+// anywhere else it returns true at once, nothing can cancel a render called directly
+bool waitUnlessCancelled(int milliseconds);
+
+// the heap allocations the last finished job made, counted on every thread while it ran, -1 in builds without
+// REDNOISE_COUNT_ALLOCATIONS, the main loop shows it in the title
+int64_t lastRenderJobHeapAllocations();
+
+#endif //REDNOISE_RENDERJOB_H
@@ -0,0 +1,136 @@
+#include "RenderKernels.h"
+#include "HardShadowRendering.h"
+#include "Log.h"
+#include "CameraRays.h"
+#include "AntiAliasing.h"
+
+namespace {
+    uint32_t packColour(const Colour &colour, float brightness) {
+        return (255 << 24) |
+               (int(brightness * colour.red) << 16) |
+               (int(brightness * colour.green) << 8) |
+               int(brightness * colour.blue);
+    }
+
+    // the dispatcher only picks the cube shadow map kernels when activeShadowMap was built for the scene's only light
+    template <ShadowMode shadows>
+    float lightVisibility(const RayTriangleIntersection &intersection, const SceneTriangles &triangles,
+                          const glm::vec3 &lightPosition) {
+        if (shadows == ShadowMode::CubeShadowMap) {
+            return sampleCubeShadowMap(*activeShadowMap, intersection.intersectionPoint,
+                                       intersection.intersectedTriangle.normal, shadowMapSettings);
+        }
+        return traceLightVisibility(intersection, triangles, lightPosition);
+    }
+
+    template <ShadingModel shading, ShadowMode shadows>
+    float shadeSurface(const RayTriangleIntersection &intersection, const SceneTriangles &triangles,
+                       const SceneLights &lights, float ambientLight) {
+        // the shadows are already in the baked vertex lighting
+        if (shading == ShadingModel::Gouraud) return GouraudShading(intersection, *activeVertexLighting);
+
+        // pick the lights that shade this point, in a scene with few lights this is all of them
+        LightSelection selectedLights;
+        selectLights(lights, intersection.intersectionPoint, intersection.intersectedTriangle.normal, selectedLights);
+        std::array<float, maxSelectedLights> visibility{};
+        for (int i = 0; i < selectedLights.count; i++) {
+            visibility[i] = lightVisibility<shadows>(intersection, triangles, selectedLights.positions[i]);
+        }
+        if (shading == ShadingModel::Flat) return FlatShading(intersection, selectedLights, visibility, ambientLight);
+        return phongShading(intersection, selectedLights, visibility, ambientLight);
+    }
+
+    template <ShadingModel shading, ShadowMode shadows, bool hasMirrorsOrGlass>
+    uint32_t shadePrimary(const glm::vec3 &rayDirection, const RayTriangleIntersection &intersection,
+                          const SceneTriangles &triangles, const SceneLights &lights, float ambientLight) {
+        const Material &material = triangles.material(intersection);
+        if (hasMirrorsOrGlass) {
+            // if the intersection is a mirror, then we need to calculate the reflected ray
+            if (material.isMirror) {
+                glm::vec3 reflectDir = glm::reflect(rayDirection, intersection.intersectedTriangle.normal);
+                glm::vec3 reflectOrigin = intersection.intersectionPoint + reflectDir * 0.001f;
+                // this is the recursive call
+                Colour reflectColour = traceReflectiveRay(reflectOrigin, reflectDir, triangles, 1, lights, ambientLight);
+                if (material.reflectivity < 1.0f) {
+                    float brightness = glm::dot(rayDirection, intersection.intersectedTriangle.normal) > 0 ? ambientLight :
+                                       shadeSurface<shading, shadows>(intersection, triangles, lights, ambientLight);
+                    reflectColour = mixReflection(reflectColour, material, brightness);
+                }
+                return packColour(reflectColour, 1.0f);
+            }
+            if (material.isGlass) {
+                // if the intersection is a glass, then we need to calculate the refracted ray
+                float indexOfRefraction = material.indexOfRefraction; // the refractive index from air to glass
+                // here is very tricky, we must ensure that the cos(theta) between the normal and the refract ray is positive
+                glm::vec3 normal = glm::dot(rayDirection, intersection.intersectedTriangle.normal) < 0 ?
+                                   -intersection.intersectedTriangle.normal : intersection.intersectedTriangle.normal;
+                glm::vec3 refractDir = calculate_refracted_ray(rayDirection, normal, indexOfRefraction);
+                glm::vec3 refractOrigin = intersection.intersectionPoint + normal * 0.001f;
+                return packColour(traceRefractiveRay(refractOrigin, refractDir, triangles, 1, lights, ambientLight), 1.0f);
+            }
+        }
+        // here is very crucial, this condition is to say that if we look from outside the wall,
+        // then draw the color directly with the ambientLight, otherwise there will be some shadows
+        if (glm::dot(rayDirection, intersection.intersectedTriangle.normal) > 0) {
+            return packColour(material.colour, ambientLight);
+        }
+        return packColour(material.colour,
+                          shadeSurface<shading, shadows>(intersection, triangles, lights, ambientLight));
+    }
+
+    template <ShadingModel shading, ShadowMode shadows, bool hasMirrorsOrGlass>
+    void renderFrame(DrawingWindow &window, const PixelRect &region, const SceneTriangles &triangles,
+                     const SceneLights &lights, float ambientLight, float focalLength) {
+        const CameraRayTable &rays = getCameraRayTable(window.width, window.height, focalLength, cameraOrientation);
+        renderAdaptiveAntiAliased(window, region, [&](float x, float y, uint32_t) {
+            glm::vec3 rayDirection = rays.direction(x, y);
+            RayTriangleIntersection intersection = getClosestIntersection(cameraPosition, rayDirection, triangles);
+            PixelSample sample;
+            // No intersection found, the pixel keeps the background color
+            if (intersection.distanceFromCamera != std::numeric_limits<float>::infinity()) {
+                sample.colour = shadePrimary<shading, shadows, hasMirrorsOrGlass>(rayDirection, intersection, triangles,
+                                                                                 lights, ambientLight);
+                sample.triangleId = long(intersection.triangleIndex);
+                sample.depth = intersection.distanceFromCamera;
+            }
+            return sample;
+        });
+    }
+
+    template <ShadingModel shading, ShadowMode shadows, bool hasMirrorsOrGlass>
+    RenderKernels makeRenderKernels() {
+        return RenderKernels{shadePrimary<shading, shadows, hasMirrorsOrGlass>, renderFrame<shading, shadows, hasMirrorsOrGlass>};
+    }
+
+    template <ShadingModel shading>
+    RenderKernels selectForShading(ShadowMode shadows, bool hasMirrorsOrGlass) {
+        if (shadows == ShadowMode::CubeShadowMap) {
+            return hasMirrorsOrGlass ? makeRenderKernels<shading, ShadowMode::CubeShadowMap, true>()
+                                     : makeRenderKernels<shading, ShadowMode::CubeShadowMap, false>();
+        }
+        return hasMirrorsOrGlass ? makeRenderKernels<shading, ShadowMode::ShadowRays, true>()
+                                 : makeRenderKernels<shading, ShadowMode::ShadowRays, false>();
+    }
+}
+
+ShadingModel getShadingModel(int signalForShading) {
+    if (signalForShading == 1) return ShadingModel::Flat;
+    if (signalForShading == 2) return ShadingModel::Gouraud;
+    if (signalForShading == 3) return ShadingModel::Phong;
+    LOG_ERROR(LogCategory::RayTrace, "Please enter the correct signal for shading");
+    exit(1);
+}
+
+RenderKernels selectRenderKernels(int signalForShading, const SceneTriangles &triangles) {
+    ShadingModel shading = getShadingModel(signalForShading);
+    ShadowMode shadows = activeShadowMap != nullptr ? ShadowMode::CubeShadowMap : ShadowMode::ShadowRays;
+    bool hasMirrorsOrGlass = false;
+    for (const TriangleShading &triangle : triangles.shading) {
+        const Material &material = triangles.material(triangle.materialId);
+        hasMirrorsOrGlass = hasMirrorsOrGlass || material.isMirror || material.isGlass;
+    }
+
+    if (shading == ShadingModel::Flat) return selectForShading<ShadingModel::Flat>(shadows, hasMirrorsOrGlass);
+    if (shading == ShadingModel::Gouraud) return selectForShading<ShadingModel::Gouraud>(shadows, hasMirrorsOrGlass);
+    return selectForShading<ShadingModel::Phong>(shadows, hasMirrorsOrGlass);
+}
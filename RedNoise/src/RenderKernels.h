@@ -0,0 +1,37 @@
+#ifndef REDNOISE_RENDERKERNELS_H
+#define REDNOISE_RENDERKERNELS_H
+
+#include <vector>
+#include <DrawingWindow.h>
+#include "glm/glm.hpp"
+#include "ModelTriangle.h"
+#include "SceneTriangles.h"
+#include "RayTriangleIntersection.h"
+#include "SceneLights.h"
+#include "AntiAliasing.h"
+
+// signalForShading 1, 2 and 3
+enum class ShadingModel {
+    Flat,
+    Gouraud,
+    Phong
+};
+
+// exits with an error for an unknown signal, like the renderers always did
+ShadingModel getShadingModel(int signalForShading);
+
+// the shading model, the shadow technique and whether the scene has mirrors or glass stay the same for a whole frame,
+// so every combination is its own instantiation with those branches compiled out of the per pixel code
+struct RenderKernels {
+    // colour of the surface a camera ray hit
+    uint32_t (*shadePrimary)(const glm::vec3 &rayDirection, const RayTriangleIntersection &intersection,
+                             const SceneTriangles &triangles, const SceneLights &lights, float ambientLight);
+    // trace and shade the pixels of the window inside region
+    void (*renderFrame)(DrawingWindow &window, const PixelRect &region, const SceneTriangles &triangles,
+                        const SceneLights &lights, float ambientLight, float focalLength);
+};
+
+// call after selectShadowMap and selectVertexLighting, the shadow technique is taken from activeShadowMap
+RenderKernels selectRenderKernels(int signalForShading, const SceneTriangles &triangles);
+
+#endif //REDNOISE_RENDERKERNELS_H
@@ -0,0 +1,184 @@
+#include "SceneLights.h"
+#include "Log.h"
+#include "Random.h"
+#include <Utils.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+LightSelectionSettings lightSelectionSettings;
+
+namespace {
+    void addLight(SceneLights &lights, const glm::vec3 &position, float intensity) {
+        lights.positionX.push_back(position.x);
+        lights.positionY.push_back(position.y);
+        lights.positionZ.push_back(position.z);
+        lights.intensity.push_back(intensity);
+    }
+
+    // "../cornell-box.obj" -> "../cornell-box.lights"
+    std::string lightFilenameFor(const std::string &objFilename) {
+        size_t dot = objFilename.find_last_of('.');
+        size_t slash = objFilename.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return objFilename + ".lights";
+        return objFilename.substr(0, dot) + ".lights";
+    }
+
+    int buildNode(SceneLights &lights, std::vector<int> &order, size_t begin, size_t end) {
+        LightTreeNode node;
+        node.boundsMin = glm::vec3(std::numeric_limits<float>::infinity());
+        node.boundsMax = glm::vec3(-std::numeric_limits<float>::infinity());
+        for (size_t i = begin; i < end; i++) {
+            glm::vec3 position = lights.position(order[i]);
+            node.boundsMin = glm::min(node.boundsMin, position);
+            node.boundsMax = glm::max(node.boundsMax, position);
+            node.intensity += lights.intensity[order[i]];
+        }
+        int nodeIndex = int(lights.tree.size());
+        lights.tree.push_back(node);
+        if (end - begin == 1) {
+            lights.tree[nodeIndex].lightIndex = order[begin];
+            return nodeIndex;
+        }
+
+        glm::vec3 extent = node.boundsMax - node.boundsMin;
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+        const std::vector<float> &coordinates = axis == 0 ? lights.positionX : (axis == 1 ? lights.positionY : lights.positionZ);
+        size_t middle = (begin + end) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                         [&](int a, int b) { return coordinates[a] < coordinates[b]; });
+        // the children are added after the parent, so the reference into the vector is only taken once they exist
+        int left = buildNode(lights, order, begin, middle);
+        int right = buildNode(lights, order, middle, end);
+        lights.tree[nodeIndex].left = left;
+        lights.tree[nodeIndex].right = right;
+        return nodeIndex;
+    }
+
+    // a cheap upper estimate of how much light the node can send to the point
+    // zero when every light in it is behind the surface, otherwise intensity over the squared distance to its bounds
+    float nodeImportance(const LightTreeNode &node, const glm::vec3 &point, const glm::vec3 &normal) {
+        bool inFront = false;
+        for (int corner = 0; corner < 8 && !inFront; corner++) {
+            glm::vec3 position((corner & 1) ? node.boundsMax.x : node.boundsMin.x,
+                               (corner & 2) ? node.boundsMax.y : node.boundsMin.y,
+                               (corner & 4) ? node.boundsMax.z : node.boundsMin.z);
+            inFront = glm::dot(position - point, normal) > 0.0f;
+        }
+        if (!inFront) return 0.0f;
+
+        glm::vec3 closest = glm::clamp(point, node.boundsMin, node.boundsMax);
+        glm::vec3 extent = node.boundsMax - node.boundsMin;
+        // a point inside or next to a big node would otherwise give it an unbounded importance
+        float distanceSquared = std::max(glm::dot(closest - point, closest - point),
+                                         std::max(0.25f * glm::dot(extent, extent), 1e-4f));
+        return node.intensity / distanceSquared;
+    }
+}
+
+SceneLights loadSceneLights(const std::string &objFilename) {
+    SceneLights lights;
+    lights.areaLight = getCornellBoxAreaLight();
+    std::string filename = lightFilenameFor(objFilename);
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        LOG_WARNING(LogCategory::Loader, "No light file " << filename << ", using the default cornell box light");
+        addLight(lights, glm::vec3(0, 0.89, 0.1), 1.0f);
+        buildLightTree(lights);
+        return lights;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        auto tokens = split(line, ' ');
+        if (tokens[0] == "light" && tokens.size() >= 5) {
+            glm::vec3 position(std::stof(tokens[1]), std::stof(tokens[2]), std::stof(tokens[3]));
+            float intensity = std::stof(tokens[4]);
+            if (intensity <= 0.0f) {
+                LOG_WARNING(LogCategory::Loader, "Skipping a light without intensity in " << filename);
+                continue;
+            }
+            addLight(lights, position, intensity);
+        } else if (tokens[0] == "arealight" && tokens.size() >= 10) {
+            for (int i = 0; i < 3; i++) {
+                lights.areaLight.corner[i] = std::stof(tokens[1 + i]);
+                lights.areaLight.edgeU[i] = std::stof(tokens[4 + i]);
+                lights.areaLight.edgeV[i] = std::stof(tokens[7 + i]);
+            }
+        }
+    }
+    if (lights.size() == 0) {
+        LOG_WARNING(LogCategory::Loader, filename << " has no point lights, using the default cornell box light");
+        addLight(lights, glm::vec3(0, 0.89, 0.1), 1.0f);
+    }
+    buildLightTree(lights);
+    LOG_INFO(LogCategory::Loader, "Loaded " << lights.size() << " lights from " << filename);
+    return lights;
+}
+
+void buildLightTree(SceneLights &lights) {
+    lights.tree.clear();
+    if (lights.size() == 0) return;
+    lights.tree.reserve(2 * lights.size() - 1);
+    std::vector<int> order(lights.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = int(i);
+    buildNode(lights, order, 0, order.size());
+}
+
+const SceneLights &getSceneLights(const std::string &objFilename) {
+    static std::map<std::string, SceneLights> cache;
+    auto found = cache.find(objFilename);
+    if (found == cache.end()) {
+        found = cache.emplace(objFilename, loadSceneLights(objFilename)).first;
+    }
+    return found->second;
+}
+
+LightSelection makeSingleLightSelection(const glm::vec3 &position) {
+    LightSelection selection;
+    selection.count = 1;
+    selection.positions[0] = position;
+    selection.weights[0] = 1.0f;
+    return selection;
+}
+
+void selectLights(const SceneLights &lights, const glm::vec3 &point, const glm::vec3 &normal, LightSelection &selection) {
+    selection.count = 0;
+    int lightsPerPoint = glm::clamp(lightSelectionSettings.lightsPerPoint, 1, maxSelectedLights);
+    if (lights.size() <= size_t(lightsPerPoint)) {
+        for (size_t i = 0; i < lights.size(); i++) {
+            selection.positions[selection.count] = lights.position(i);
+            selection.weights[selection.count] = lights.intensity[i];
+            selection.count++;
+        }
+        return;
+    }
+    if (nodeImportance(lights.tree[0], point, normal) <= 0.0f) return;
+
+    uint32_t state = hashPoint(point);
+    for (int pick = 0; pick < lightsPerPoint; pick++) {
+        int nodeIndex = 0;
+        float probability = 1.0f;
+        while (nodeIndex >= 0 && lights.tree[nodeIndex].lightIndex < 0) {
+            const LightTreeNode &node = lights.tree[nodeIndex];
+            float leftImportance = nodeImportance(lights.tree[node.left], point, normal);
+            float rightImportance = nodeImportance(lights.tree[node.right], point, normal);
+            float totalImportance = leftImportance + rightImportance;
+            if (totalImportance <= 0.0f) {
+                // the parent bounds reach in front of the surface but neither child does, this pick adds nothing
+                nodeIndex = -1;
+            } else if (nextRandom(state) * totalImportance < leftImportance) {
+                probability *= leftImportance / totalImportance;
+                nodeIndex = node.left;
+            } else {
+                probability *= rightImportance / totalImportance;
+                nodeIndex = node.right;
+            }
+        }
+        if (nodeIndex < 0) continue;
+        int lightIndex = lights.tree[nodeIndex].lightIndex;
+        selection.positions[selection.count] = lights.position(lightIndex);
+        selection.weights[selection.count] = lights.intensity[lightIndex] / (probability * lightsPerPoint);
+        selection.count++;
+    }
+}
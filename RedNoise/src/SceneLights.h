@@ -0,0 +1,67 @@
+#ifndef REDNOISE_SCENELIGHTS_H
+#define REDNOISE_SCENELIGHTS_H
+
+#include <array>
+#include <string>
+#include <vector>
+#include "glm/glm.hpp"
+#include "AreaLight.h"
+
+// the most lights a shaded point can use, LightSelection keeps them in fixed arrays so shading never allocates
+const int maxSelectedLights = 8;
+
+// node of the light tree, a leaf holds one light and an inner node the sum of its children
+struct LightTreeNode {
+    glm::vec3 boundsMin{};
+    glm::vec3 boundsMax{};
+    float intensity = 0.0f;
+    int left = -1;          // child node indices, -1 for a leaf
+    int right = -1;
+    int lightIndex = -1;    // the light of a leaf, -1 for an inner node
+};
+
+// the point lights of a scene in structure of arrays form, the tree refers to them by index
+struct SceneLights {
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> intensity;
+    std::vector<LightTreeNode> tree;    // node 0 is the root
+    AreaLight areaLight;                // used by the soft shadow mode
+
+    size_t size() const { return intensity.size(); }
+    glm::vec3 position(size_t index) const { return glm::vec3(positionX[index], positionY[index], positionZ[index]); }
+};
+
+struct LightSelectionSettings {
+    int lightsPerPoint = 2;   // scenes with more lights than this pick lights from the tree, at most maxSelectedLights
+};
+
+// the lights that shade one point, weight scales a light's contribution so the picked lights estimate all of them
+struct LightSelection {
+    int count = 0;
+    std::array<glm::vec3, maxSelectedLights> positions;
+    std::array<float, maxSelectedLights> weights;
+};
+
+extern LightSelectionSettings lightSelectionSettings;
+
+// read the lights from the .lights file next to the .obj, lines are
+//   light x y z intensity
+//   arealight cornerX cornerY cornerZ edgeUX edgeUY edgeUZ edgeVX edgeVY edgeVZ
+// positions are in the scaled world space the renderers use, without a file the cornell box light is used
+SceneLights loadSceneLights(const std::string &objFilename);
+
+// split the lights in half along the longest axis of their bounds until every leaf has one light
+void buildLightTree(SceneLights &lights);
+
+// loaded and built the first time a scene is used
+const SceneLights &getSceneLights(const std::string &objFilename);
+
+LightSelection makeSingleLightSelection(const glm::vec3 &position);
+
+// with at most lightsPerPoint lights every light is used with its own intensity as the weight
+// otherwise the tree is walked lightsPerPoint times, choosing a child in proportion to how much light it can send to
+// the point, and each light that is reached is weighted by intensity / (probability * lightsPerPoint)
+// the random sequence is seeded from the point so a frame is the same every time it is rendered
+void selectLights(const SceneLights &lights, const glm::vec3 &point, const glm::vec3 &normal, LightSelection &selection);
+
+#endif //REDNOISE_SCENELIGHTS_H
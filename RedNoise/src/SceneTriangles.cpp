@@ -0,0 +1,24 @@
+#include "SceneTriangles.h"
+
+ModelTriangle TriangleView::toModelTriangle() const {
+    ModelTriangle triangle(positions.vertices[0], positions.vertices[1], positions.vertices[2], shading.materialId);
+    triangle.texturePoints = shading.texturePoints;
+    triangle.vertexIndices = shading.vertexIndices;
+    triangle.normal = shading.normal;
+    return triangle;
+}
+
+void SceneTriangles::push_back(const ModelTriangle &triangle) {
+    positions.push_back(TrianglePositions{triangle.vertices});
+    shading.push_back(TriangleShading{triangle.normal, triangle.texturePoints, triangle.vertexIndices,
+                                      triangle.materialId});
+}
+
+SceneTriangles splitTriangles(const std::vector<ModelTriangle> &triangles, const std::vector<Material> &materials) {
+    SceneTriangles split;
+    split.materials = &materials;
+    split.positions.reserve(triangles.size());
+    split.shading.reserve(triangles.size());
+    for (const ModelTriangle &triangle : triangles) split.push_back(triangle);
+    return split;
+}
@@ -0,0 +1,63 @@
+#ifndef REDNOISE_SCENETRIANGLES_H
+#define REDNOISE_SCENETRIANGLES_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "glm/glm.hpp"
+#include "ModelTriangle.h"
+#include "LoadFile.h"
+#include "RayTriangleIntersection.h"
+
+// what a ray triangle test reads, 36 bytes, a cache line holds almost two of them
+struct TrianglePositions {
+    std::array<glm::vec3, 3> vertices;
+};
+
+// everything else about a triangle, only read for the triangle a ray actually hits
+struct TriangleShading {
+    glm::vec3 normal{};
+    std::array<TexturePoint, 3> texturePoints{};
+    std::array<uint32_t, 3> vertexIndices{};
+    uint16_t materialId = 0;
+};
+
+// one triangle of SceneTriangles, read like a ModelTriangle
+struct TriangleView {
+    const TrianglePositions &positions;
+    const TriangleShading &shading;
+    const Material &material;
+
+    const std::array<glm::vec3, 3> &vertices() const { return positions.vertices; }
+    const glm::vec3 &normal() const { return shading.normal; }
+    const Colour &colour() const { return material.colour; }
+    bool isMirror() const { return material.isMirror; }
+    bool isGlass() const { return material.isGlass; }
+    // for the shading code that still takes a ModelTriangle, like the hit record
+    ModelTriangle toModelTriangle() const;
+};
+
+// the triangles of a scene split into a hot stream of positions the intersection loops walk through and the cold
+// shading data next to it, both indexed the same as the ModelTriangle vector they were made from
+struct SceneTriangles {
+    std::vector<TrianglePositions> positions;
+    std::vector<TriangleShading> shading;
+    const std::vector<Material> *materials = nullptr;   // the table the material ids point into, not owned
+
+    size_t size() const { return positions.size(); }
+    bool empty() const { return positions.empty(); }
+    TriangleView operator[](size_t index) const {
+        return TriangleView{positions[index], shading[index], (*materials)[shading[index].materialId]};
+    }
+    const Material &material(uint16_t materialId) const { return (*materials)[materialId]; }
+    // the material of the triangle a ray hit
+    const Material &material(const RayTriangleIntersection &intersection) const {
+        return (*materials)[intersection.intersectedTriangle.materialId];
+    }
+    void push_back(const ModelTriangle &triangle);
+};
+
+// materials has to outlive the split, getMaterials tables always do
+SceneTriangles splitTriangles(const std::vector<ModelTriangle> &triangles, const std::vector<Material> &materials);
+
+#endif //REDNOISE_SCENETRIANGLES_H
@@ -0,0 +1,162 @@
+#include "ShadowMap.h"
+#include "Parallel.h"
+#include "Log.h"
+#include <algorithm>
+#include <map>
+#include <sstream>
+
+ShadowMode shadowMode = ShadowMode::ShadowRays;
+ShadowMapSettings shadowMapSettings;
+const CubeShadowMap *activeShadowMap = nullptr;
+
+namespace {
+    const float nearPlane = 1e-4f;
+
+    // forward, right and up of every cube face, in the same order as CubeShadowMap::faces
+    struct CubeFace {
+        glm::vec3 forward, right, up;
+    };
+    const std::array<CubeFace, 6> cubeFaces = {{
+            {glm::vec3(1, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0)},
+            {glm::vec3(-1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0)},
+            {glm::vec3(0, 1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, -1)},
+            {glm::vec3(0, -1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1)},
+            {glm::vec3(0, 0, 1), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0)},
+            {glm::vec3(0, 0, -1), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0)},
+    }};
+
+    int faceForDirection(const glm::vec3 &direction) {
+        glm::vec3 absolute = glm::abs(direction);
+        if (absolute.x >= absolute.y && absolute.x >= absolute.z) return direction.x > 0 ? 0 : 1;
+        if (absolute.y >= absolute.z) return direction.y > 0 ? 2 : 3;
+        return direction.z > 0 ? 4 : 5;
+    }
+
+    // the part of the triangle in front of the face, it gains a fourth corner when the near plane cuts it
+    int clipToNearPlane(const std::array<glm::vec3, 3> &corners, std::array<glm::vec3, 4> &clipped) {
+        int count = 0;
+        for (int i = 0; i < 3; i++) {
+            const glm::vec3 &current = corners[i];
+            const glm::vec3 &next = corners[(i + 1) % 3];
+            bool currentInside = current.z >= nearPlane;
+            bool nextInside = next.z >= nearPlane;
+            if (currentInside) clipped[count++] = current;
+            if (currentInside != nextInside) {
+                clipped[count++] = glm::mix(current, next, (nearPlane - current.z) / (next.z - current.z));
+            }
+        }
+        return count;
+    }
+
+    // depth pass for one face: every triangle is projected from the light and the closest distance is kept
+    void renderFace(const std::vector<ModelTriangle> &triangles, const glm::vec3 &lightPosition, const CubeFace &face,
+                    int resolution, std::vector<float> &depths) {
+        depths.assign(size_t(resolution) * resolution, std::numeric_limits<float>::infinity());
+        float halfResolution = resolution * 0.5f;
+
+        for (const ModelTriangle &triangle : triangles) {
+            std::array<glm::vec3, 3> corners;
+            for (int i = 0; i < 3; i++) {
+                glm::vec3 relative = triangle.vertices[i] - lightPosition;
+                corners[i] = glm::vec3(glm::dot(relative, face.right), glm::dot(relative, face.up),
+                                       glm::dot(relative, face.forward));
+            }
+            std::array<glm::vec3, 4> polygon;
+            int cornerCount = clipToNearPlane(corners, polygon);
+
+            // texel coordinates, texel i has its centre at i; z is kept for the perspective correct depth
+            std::array<glm::vec3, 4> projected;
+            for (int i = 0; i < cornerCount; i++) {
+                projected[i] = glm::vec3((polygon[i].x / polygon[i].z + 1.0f) * halfResolution - 0.5f,
+                                         (polygon[i].y / polygon[i].z + 1.0f) * halfResolution - 0.5f,
+                                         polygon[i].z);
+            }
+
+            // draw the clipped polygon as a fan
+            for (int fan = 1; fan + 1 < cornerCount; fan++) {
+                const glm::vec3 &p0 = projected[0], &p1 = projected[fan], &p2 = projected[fan + 1];
+                float area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+                if (std::abs(area) < 1e-12f) continue;
+
+                int minX = std::max(0, int(std::ceil(std::min({p0.x, p1.x, p2.x}))));
+                int maxX = std::min(resolution - 1, int(std::floor(std::max({p0.x, p1.x, p2.x}))));
+                int minY = std::max(0, int(std::ceil(std::min({p0.y, p1.y, p2.y}))));
+                int maxY = std::min(resolution - 1, int(std::floor(std::max({p0.y, p1.y, p2.y}))));
+                for (int y = minY; y <= maxY; y++) {
+                    for (int x = minX; x <= maxX; x++) {
+                        float w0 = ((p1.x - x) * (p2.y - y) - (p1.y - y) * (p2.x - x)) / area;
+                        float w1 = ((p2.x - x) * (p0.y - y) - (p2.y - y) * (p0.x - x)) / area;
+                        float w2 = 1.0f - w0 - w1;
+                        if (w0 < -1e-4f || w1 < -1e-4f || w2 < -1e-4f) continue;
+
+                        float z = 1.0f / (w0 / p0.z + w1 / p1.z + w2 / p2.z);
+                        float u = (x + 0.5f) / halfResolution - 1.0f;
+                        float v = (y + 0.5f) / halfResolution - 1.0f;
+                        // the texel ray goes through (u, v, 1) in face space
+                        float distance = z * std::sqrt(1.0f + u * u + v * v);
+                        float &stored = depths[size_t(y) * resolution + x];
+                        stored = std::min(stored, distance);
+                    }
+                }
+            }
+        }
+    }
+}
+
+CubeShadowMap buildCubeShadowMap(const std::vector<ModelTriangle> &triangles, const glm::vec3 &lightPosition, int resolution) {
+    CubeShadowMap shadowMap;
+    shadowMap.lightPosition = lightPosition;
+    shadowMap.resolution = resolution;
+    parallelFor(cubeFaces.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            renderFace(triangles, lightPosition, cubeFaces[i], resolution, shadowMap.faces[i]);
+        }
+    });
+    return shadowMap;
+}
+
+float sampleCubeShadowMap(const CubeShadowMap &shadowMap, const glm::vec3 &point, const glm::vec3 &normal,
+                          const ShadowMapSettings &settings) {
+    glm::vec3 toLight = shadowMap.lightPosition - point;
+    float distance = glm::length(toLight);
+    // normal offset, push the lookup off the surface on the side facing the light to stop self shadowing
+    float texelSize = 2.0f * distance / shadowMap.resolution;
+    glm::vec3 facingNormal = glm::dot(normal, toLight) < 0 ? -normal : normal;
+    glm::vec3 relative = point + facingNormal * (settings.normalBias * texelSize) - shadowMap.lightPosition;
+
+    const CubeFace &face = cubeFaces[faceForDirection(relative)];
+    int faceIndex = int(&face - &cubeFaces[0]);
+    float z = glm::dot(relative, face.forward);
+    float halfResolution = shadowMap.resolution * 0.5f;
+    int centreX = int(std::floor((glm::dot(relative, face.right) / z + 1.0f) * halfResolution));
+    int centreY = int(std::floor((glm::dot(relative, face.up) / z + 1.0f) * halfResolution));
+    float pointDistance = glm::length(relative) - settings.bias;
+
+    // percentage closer filtering, taps past the face border are clamped to its edge
+    const std::vector<float> &depths = shadowMap.faces[faceIndex];
+    int lit = 0, taps = 0;
+    for (int dy = -settings.pcfRadius; dy <= settings.pcfRadius; dy++) {
+        for (int dx = -settings.pcfRadius; dx <= settings.pcfRadius; dx++) {
+            int x = glm::clamp(centreX + dx, 0, shadowMap.resolution - 1);
+            int y = glm::clamp(centreY + dy, 0, shadowMap.resolution - 1);
+            if (pointDistance <= depths[size_t(y) * shadowMap.resolution + x]) lit++;
+            taps++;
+        }
+    }
+    return float(lit) / taps;
+}
+
+const CubeShadowMap &getCubeShadowMap(const std::string &sceneName, const std::vector<ModelTriangle> &triangles,
+                                      const glm::vec3 &lightPosition) {
+    static std::map<std::string, CubeShadowMap> cache;
+    std::ostringstream key;
+    key << sceneName << "|" << lightPosition.x << "," << lightPosition.y << "," << lightPosition.z
+        << "|" << shadowMapSettings.resolution;
+    auto found = cache.find(key.str());
+    if (found == cache.end()) {
+        LOG_INFO(LogCategory::RayTrace, "Building " << shadowMapSettings.resolution << "x" << shadowMapSettings.resolution
+                                                    << " cube shadow map for " << sceneName);
+        found = cache.emplace(key.str(), buildCubeShadowMap(triangles, lightPosition, shadowMapSettings.resolution)).first;
+    }
+    return found->second;
+}
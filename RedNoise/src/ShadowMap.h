@@ -0,0 +1,45 @@
+#ifndef REDNOISE_SHADOWMAP_H
+#define REDNOISE_SHADOWMAP_H
+
+#include <array>
+#include <string>
+#include <vector>
+#include "glm/glm.hpp"
+#include "ModelTriangle.h"
+
+// how the ray traced modes decide whether a point can see the point light
+enum class ShadowMode {
+    ShadowRays,      // fire an exact shadow ray for every shaded point (default)
+    CubeShadowMap    // look the point up in an omnidirectional depth map rendered from the light
+};
+
+struct ShadowMapSettings {
+    int resolution = 512;     // texels along each side of every cube face
+    float bias = 0.005f;      // depth bias, in scene units
+    float normalBias = 1.5f;  // the lookup point is pushed off the surface by this many texels
+    int pcfRadius = 1;        // filter over (2 * radius + 1)^2 texels, 0 turns filtering off
+};
+
+// one depth image per cube face, order is +X, -X, +Y, -Y, +Z, -Z
+struct CubeShadowMap {
+    glm::vec3 lightPosition{};
+    int resolution = 0;
+    std::array<std::vector<float>, 6> faces;   // distance from the light to the closest surface through each texel
+};
+
+extern ShadowMode shadowMode;
+extern ShadowMapSettings shadowMapSettings;
+// the map the current frame uses, set by the renderers, nullptr when shadow rays are used
+extern const CubeShadowMap *activeShadowMap;
+
+CubeShadowMap buildCubeShadowMap(const std::vector<ModelTriangle> &triangles, const glm::vec3 &lightPosition, int resolution);
+
+// fraction of the filter taps around the point that can see the light, 0 = in shadow, 1 = lit
+float sampleCubeShadowMap(const CubeShadowMap &shadowMap, const glm::vec3 &point, const glm::vec3 &normal,
+                          const ShadowMapSettings &settings);
+
+// the map only depends on the scene and the light, so it is built the first time they are used and reused after that
+const CubeShadowMap &getCubeShadowMap(const std::string &sceneName, const std::vector<ModelTriangle> &triangles,
+                                      const glm::vec3 &lightPosition);
+
+#endif //REDNOISE_SHADOWMAP_H
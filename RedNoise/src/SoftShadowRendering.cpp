@@ -1,23 +1,25 @@
 #include "SoftShadowRendering.h"
+#include "Log.h"
+#include "CameraRays.h"
+#include "AntiAliasing.h"
+#include "Denoiser.h"
 
 
-// for each intersection, it has multiple shadowIntersections with multiple light points
-float FlatShadingSoft(RayTriangleIntersection intersection, const std::vector<RayTriangleIntersection> &shadowIntersections,
-                      const std::vector<glm::vec3> &lightPoints, float ambientLight) {
+// for each intersection, it has multiple samples on the area light and each one knows if it can be seen
+float FlatShadingSoft(RayTriangleIntersection intersection, const std::vector<LightSample> &lightSamples, float ambientLight) {
 
     float totalBrightness = 0.0f;
-    // go through all the shadowIntersections and add up all the brightness
+    // go through all the light samples and add up all the brightness
     // at the end, we will get the average brightness, this is the brightness of the intersection
-    for (size_t i = 0; i < lightPoints.size(); i++) {
+    for (size_t i = 0; i < lightSamples.size(); i++) {
         // Calculate brightness and specular intensity for each light point
         float brightness = calculateLighting(intersection.intersectionPoint,
-                                             intersection.intersectedTriangle.normal, lightPoints[i]);
+                                             intersection.intersectedTriangle.normal, lightSamples[i].position);
         float specularIntensity = calculateSpecularLighting(intersection.intersectionPoint, cameraPosition,
-                                                            lightPoints[i], intersection.intersectedTriangle.normal, shininess);
+                                                            lightSamples[i].position, intersection.intersectedTriangle.normal, shininess);
 
-        // Determine if the point is in shadow for the current light point
-        if (shadowIntersections[i].distanceFromCamera < glm::length(lightPoints[i] - intersection.intersectionPoint) &&
-            shadowIntersections[i].triangleIndex != intersection.triangleIndex) {
+        // Determine if the point is in shadow for the current light sample
+        if (!lightSamples[i].isVisible) {
             // In shadow, only ambient light contributes
             brightness = ambientLight;
         } else {
@@ -30,30 +32,25 @@ float FlatShadingSoft(RayTriangleIntersection intersection, const std::vector<Ra
     }
 
     // Average the brightness from all light sources
-    float averageBrightness = glm::clamp(totalBrightness / lightPoints.size(), 0.0f, 1.0f);
+    float averageBrightness = glm::clamp(totalBrightness / lightSamples.size(), 0.0f, 1.0f);
     return averageBrightness;
 }
 
-float GouraudShadingSoft(RayTriangleIntersection intersection, const std::vector<RayTriangleIntersection> &shadowIntersections,
-                         const std::vector<glm::vec3> &lightPoints, float ambientLight){
+// the light samples belong to this pixel, so unlike the hard shadow mode the vertices cannot be baked and are lit here
+float GouraudShadingSoft(RayTriangleIntersection intersection, const std::vector<LightSample> &lightSamples, float ambientLight){
+    std::array<float, 3> vertexBrightness{};
     for (int i = 0; i < 3; i++) {
         glm::vec3 vertex = intersection.intersectedTriangle.vertices[i];
-        // if this vertex has been calculated before, skip it
-        if (vertexBrightnessGlobal.find(vertex) != vertexBrightnessGlobal.end()){
-            continue;
-        }
-
         glm::vec3 normal = vertexNormals[vertex];
         // calculate the diffuse lighting and specular lighting
         float totalBrightness = 0.0f;
 
         // for every light point, calculate the diffuse lighting and specular lighting
-        for (size_t j = 0; j < lightPoints.size(); j++) {
-            float brightness = calculateLighting(vertex, normal, lightPoints[j]);
-            float specularIntensity = calculateSpecularLighting(vertex, cameraPosition, lightPoints[j], normal, shininess);
+        for (size_t j = 0; j < lightSamples.size(); j++) {
+            float brightness = calculateLighting(vertex, normal, lightSamples[j].position);
+            float specularIntensity = calculateSpecularLighting(vertex, cameraPosition, lightSamples[j].position, normal, shininess);
 
-            if (shadowIntersections[j].distanceFromCamera < glm::length(lightPoints[j] - vertex) &&
-                shadowIntersections[j].triangleIndex != intersection.triangleIndex) {
+            if (!lightSamples[j].isVisible) {
                 brightness = ambientLight;
             } else {
                 brightness += ambientLight;
@@ -63,28 +60,26 @@ float GouraudShadingSoft(RayTriangleIntersection intersection, const std::vector
         }
 
         // combine the brightness from all light sources
-        float averageBrightness = glm::clamp(totalBrightness / lightPoints.size(), 0.0f, 1.0f);
+        float averageBrightness = glm::clamp(totalBrightness / lightSamples.size(), 0.0f, 1.0f);
 
-        vertexBrightnessGlobal[vertex] = averageBrightness;
+        vertexBrightness[i] = averageBrightness;
     }
 
-    glm::vec3 barycentricCoords = calculateBarycentricCoordinates(intersection.intersectionPoint,
-                                                                  intersection.intersectedTriangle.vertices);
+    glm::vec3 barycentricCoords = intersection.barycentricWeights();
 
     // interpolate the brightness
     float ResultVertexBrightness =
-            barycentricCoords.x * vertexBrightnessGlobal[intersection.intersectedTriangle.vertices[0]] +
-            barycentricCoords.y * vertexBrightnessGlobal[intersection.intersectedTriangle.vertices[1]] +
-            barycentricCoords.z * vertexBrightnessGlobal[intersection.intersectedTriangle.vertices[2]];
+            barycentricCoords.x * vertexBrightness[0] +
+            barycentricCoords.y * vertexBrightness[1] +
+            barycentricCoords.z * vertexBrightness[2];
     return ResultVertexBrightness;
 }
 
-float phongShadingSoft(RayTriangleIntersection intersection, const std::vector<RayTriangleIntersection> &shadowIntersections,
-                       const std::vector<glm::vec3> &lightPoints, float ambientLight) {
+float phongShadingSoft(RayTriangleIntersection intersection, const std::vector<LightSample> &lightSamples, float ambientLight) {
     glm::vec3 normal0  = vertexNormals[intersection.intersectedTriangle.vertices[0]];
     glm::vec3 normal1  = vertexNormals[intersection.intersectedTriangle.vertices[1]];
     glm::vec3 normal2  = vertexNormals[intersection.intersectedTriangle.vertices[2]];
-    glm::vec3 barycentricCoords = calculateBarycentricCoordinates(intersection.intersectionPoint, intersection.intersectedTriangle.vertices);
+    glm::vec3 barycentricCoords = intersection.barycentricWeights();
 
     // interpolate the normal
     glm::vec3 interpolatedNormal =
@@ -95,13 +90,12 @@ float phongShadingSoft(RayTriangleIntersection intersection, const std::vector<R
     interpolatedNormal = glm::normalize(interpolatedNormal);
 
     float totalBrightness = 0.0f;
-    for (size_t i = 0; i < lightPoints.size(); i++) {
-        float brightness = calculateLighting(intersection.intersectionPoint, interpolatedNormal, lightPoints[i]);
-        float specularIntensity = calculateSpecularLighting(intersection.intersectionPoint, cameraPosition, lightPoints[i],
+    for (size_t i = 0; i < lightSamples.size(); i++) {
+        float brightness = calculateLighting(intersection.intersectionPoint, interpolatedNormal, lightSamples[i].position);
+        float specularIntensity = calculateSpecularLighting(intersection.intersectionPoint, cameraPosition, lightSamples[i].position,
                                                             interpolatedNormal, shininess);
 
-        if (shadowIntersections[i].distanceFromCamera < glm::length(lightPoints[i] - intersection.intersectionPoint) &&
-            shadowIntersections[i].triangleIndex != intersection.triangleIndex) {
+        if (!lightSamples[i].isVisible) {
             brightness = ambientLight; // In shadow, only ambient light contributes
         } else {
             brightness = glm::max(brightness + ambientLight, ambientLight); // Not in shadow, add ambient light
@@ -111,14 +105,83 @@ float phongShadingSoft(RayTriangleIntersection intersection, const std::vector<R
     }
 
     // Average the brightness from all light sources
-    float averageBrightness = glm::clamp(totalBrightness / lightPoints.size(), 0.0f, 1.0f);
+    float averageBrightness = glm::clamp(totalBrightness / lightSamples.size(), 0.0f, 1.0f);
     return averageBrightness;
 }
 
+namespace {
+    template <ShadingModel shading>
+    float shadeSoft(const RayTriangleIntersection &intersection, const std::vector<LightSample> &lightSamples,
+                    float ambientLight) {
+        if (shading == ShadingModel::Flat) return FlatShadingSoft(intersection, lightSamples, ambientLight);
+        if (shading == ShadingModel::Gouraud) return GouraudShadingSoft(intersection, lightSamples, ambientLight);
+        return phongShadingSoft(intersection, lightSamples, ambientLight);
+    }
+
+    // one instantiation per shading model, so the pixel loop does not check signalForShading
+    template <ShadingModel shading>
+    void renderSoftShadowPixels(DrawingWindow &window, const std::vector<ModelTriangle> &triangles,
+                                const std::vector<Material> &materials, const AreaLight &areaLight,
+                                float ambientLight, float focalLength) {
+        // reused for every pixel so the inner loop does not allocate
+        std::vector<LightSample> lightSamples;
+        lightSamples.reserve(std::max(1, areaLightSettings.maxSamples));
+        long long shadowRayCount = 0;
+        long long shadedPointCount = 0;
+        // the centre ray of every pixel guides the denoiser, so fewer shadow samples are enough
+        GuideBuffers guides;
+        if (areaLightSettings.denoiser.enabled) guides.resize(window.width, window.height);
+
+        // every pixel gets one ray, the edge pixels get a few more
+        const CameraRayTable &rays = getCameraRayTable(window.width, window.height, focalLength, cameraOrientation);
+        renderAdaptiveAntiAliased(window, wholeWindow(window), [&](float x, float y, uint32_t sampleIndex) {
+            // Compute the ray direction for this sample
+            glm::vec3 rayDirection = rays.direction(x, y);
+
+            // Find the closest intersection of this ray with the scene
+            RayTriangleIntersection intersection = getClosestIntersection(cameraPosition, rayDirection, triangles);
+
+            // No intersection found, the pixel keeps the background color
+            PixelSample sample;
+            if (intersection.distanceFromCamera != std::numeric_limits<float>::infinity()) {
+                // here is the key point, this judgement is to say that if we look from outside the wall,
+                // then draw the color directly with the ambientLight, otherwise there will be some shadows
+                float brightness = ambientLight;
+                if (glm::dot(rayDirection, intersection.intersectedTriangle.normal) <= 0) {
+                    // the sample index seeds the light sampling, so every subsample gets its own pattern
+                    shadowRayCount += sampleAreaLight(areaLight, intersection, triangles, areaLightSettings,
+                                                      sampleIndex, lightSamples);
+                    shadedPointCount++;
+                    brightness = shadeSoft<shading>(intersection, lightSamples, ambientLight);
+                }
+                const Colour &colour = materials[intersection.intersectedTriangle.materialId].colour;
+                sample.colour = (255 << 24) |
+                                (int(brightness * colour.red) << 16) |
+                                (int(brightness * colour.green) << 8) |
+                                int(brightness * colour.blue);
+                sample.triangleId = long(intersection.triangleIndex);
+                sample.depth = intersection.distanceFromCamera;
+                if (areaLightSettings.denoiser.enabled && sampleIndex < window.width * window.height) {
+                    glm::vec3 normal = intersection.intersectedTriangle.normal;
+                    guides.write(sampleIndex, intersection, glm::dot(rayDirection, normal) > 0 ? -normal : normal,
+                                 glm::vec3(colour.red, colour.green, colour.blue) / 255.0f);
+                }
+            }
+            return sample;
+        });
+        // a cancelled frame is left half drawn, filtering it would smear the old image into the new one
+        if (areaLightSettings.denoiser.enabled && !isRenderCancelled()) denoiseWindow(window, guides, areaLightSettings.denoiser);
+        if (shadedPointCount > 0) {
+            LOG_INFO(LogCategory::RayTrace, "Soft shadows used " << float(shadowRayCount) / shadedPointCount
+                                            << " shadow rays per shaded point on average");
+        }
+    }
+}
+
 void renderRayTracedSceneSoftShadow(DrawingWindow &window, const std::string& filename, float focalLength,
                                     const std::string& materialFilename,const int signalForShading) {
-    // Load the triangles from the OBJ file.
-    std::vector<ModelTriangle> triangles = loadOBJ(filename, 0.35,materialFilename);
+    // the triangles from the OBJ file, parsed once per file, not on every redraw
+    const std::vector<ModelTriangle> &triangles = getModel(filename, 0.35, materialFilename);
 
     glm::vec3 ModelCenter = calculateModelCenter(triangles);
 //    float degree = 1.0f;
@@ -128,67 +191,18 @@ void renderRayTracedSceneSoftShadow(DrawingWindow &window, const std::string& fi
     // Rotate the camera to look at the model center
     cameraOrientation = lookAt(ModelCenter);
 
-    std::cout << "Loaded " << triangles.size() << " triangles for ray tracing" << std::endl;
+    LOG_INFO(LogCategory::RayTrace, "Loaded " << triangles.size() << " triangles for ray tracing");
 
-    // Define multi-point light source
-    std::vector<glm::vec3> lightPoints = {{0.01, 0.89, -0.2},{0.02,0.89,0},{0.03,0.89,0.1},
-                                          {0.04,0.89,0.2},{0.05,0.89,0.3},{0.06,0.89,-0.1}};
+    // rectangular light under the lamp, sampled more densely only where the shadow is partial
+    const AreaLight &areaLight = getSceneLights(filename).areaLight;
     float ambientLight = 0.3f;  // ambient light intensity
 
-    // Loop over each pixel on the image plane
-    for (int y = 0; y < int(window.height); y++) {
-        for (int x = 0; x < int(window.width); x++) {
-            // Compute the ray direction for this pixel
-            glm::vec3 rayDirection = computeRayDirection(window.width, window.height, x, y, focalLength, cameraOrientation);
-
-            // Find the closest intersection of this ray with the scene
-            RayTriangleIntersection intersection = getClosestIntersection(cameraPosition, rayDirection, triangles);
-
-            // If an intersection was found, color the pixel accordingly
-            if (intersection.distanceFromCamera != std::numeric_limits<float>::infinity()) {
-                // here is the key point, this judgement is to say that if we look from outside the wall,
-                // then draw the color directly with the ambientLight, otherwise there will be some shadows
-                if (glm::dot(rayDirection, intersection.intersectedTriangle.normal)>0) {
-                    Colour colour = intersection.intersectedTriangle.colour;
-                    float brightness = ambientLight;
-                    uint32_t rgbColour = (255 << 24) |
-                                         (int(brightness*colour.red) << 16) |
-                                         (int(brightness*colour.green) << 8) |
-                                         int(brightness*colour.blue);
-                    window.setPixelColour(x, y, rgbColour);
-                }else{
-                    // Initialize combined brightness
-                    std::vector<RayTriangleIntersection> AllshadowIntersection;
-                    // Iterate over each point light to calculate soft shadows
-                    // combined all shadowIntersections in a list
-                    for (const auto& lightPoint : lightPoints) {
-                        glm::vec3 shadowRay = glm::normalize(lightPoint - intersection.intersectionPoint);
-                        RayTriangleIntersection shadowIntersection = getClosestIntersection(intersection.intersectionPoint + shadowRay * 0.002f, shadowRay, triangles);
-                        AllshadowIntersection.push_back(shadowIntersection);
-                    }
-
-                    float combinedBrightness;
-                    if (signalForShading == 1){
-                        combinedBrightness = FlatShadingSoft(intersection, AllshadowIntersection, lightPoints, ambientLight);
-                    } else if (signalForShading == 2){
-                        combinedBrightness = GouraudShadingSoft(intersection, AllshadowIntersection, lightPoints, ambientLight);
-                    } else if (signalForShading == 3){
-                        combinedBrightness = phongShadingSoft(intersection, AllshadowIntersection, lightPoints, ambientLight);
-                    } else {
-                        std::cout << "Please enter the correct signal for shading" << std::endl;
-                        exit(1);
-                    }
-                    Colour colour = intersection.intersectedTriangle.colour;
-                    uint32_t rgbColour = (255 << 24) |
-                                         (int(combinedBrightness * colour.red) << 16) |
-                                         (int(combinedBrightness * colour.green) << 8) |
-                                         int(combinedBrightness * colour.blue);
-                    window.setPixelColour(x, y, rgbColour);
-                }
-            } else {
-                // No intersection found, set the pixel to the background color
-                window.setPixelColour(x, y, 0);
-            }
-        }
+    ShadingModel shading = getShadingModel(signalForShading);
+    if (shading == ShadingModel::Flat) {
+        renderSoftShadowPixels<ShadingModel::Flat>(window, triangles, getMaterials(materialFilename), areaLight, ambientLight, focalLength);
+    } else if (shading == ShadingModel::Gouraud) {
+        renderSoftShadowPixels<ShadingModel::Gouraud>(window, triangles, getMaterials(materialFilename), areaLight, ambientLight, focalLength);
+    } else {
+        renderSoftShadowPixels<ShadingModel::Phong>(window, triangles, getMaterials(materialFilename), areaLight, ambientLight, focalLength);
     }
 }
\ No newline at end of file
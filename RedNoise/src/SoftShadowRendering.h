@@ -7,12 +7,10 @@
 
 
 #include "HardShadowRendering.h"
-float FlatShadingSoft(RayTriangleIntersection intersection, const std::vector<RayTriangleIntersection> &shadowIntersections,
-                      const std::vector<glm::vec3> &lightPoints, float ambientLight);
-float GouraudShadingSoft(RayTriangleIntersection intersection, const std::vector<RayTriangleIntersection> &shadowIntersections,
-                         const std::vector<glm::vec3> &lightPoints, float ambientLight);
-float phongShadingSoft(RayTriangleIntersection intersection, const std::vector<RayTriangleIntersection> &shadowIntersections,
-                       const std::vector<glm::vec3> &lightPoints, float ambientLight);
+#include "SceneLights.h"
+float FlatShadingSoft(RayTriangleIntersection intersection, const std::vector<LightSample> &lightSamples, float ambientLight);
+float GouraudShadingSoft(RayTriangleIntersection intersection, const std::vector<LightSample> &lightSamples, float ambientLight);
+float phongShadingSoft(RayTriangleIntersection intersection, const std::vector<LightSample> &lightSamples, float ambientLight);
 void renderRayTracedSceneSoftShadow(DrawingWindow &window, const std::string& filename, float focalLength,
                                     const std::string& materialFilename,const int signalForShading);
 
@@ -0,0 +1,108 @@
+#include "VertexLighting.h"
+#include "HardShadowRendering.h"
+#include "Parallel.h"
+#include "Log.h"
+#include <cstring>
+#include <mutex>
+#include <sstream>
+
+thread_local const VertexLighting *activeVertexLighting = nullptr;
+
+namespace {
+    // whether the vertex can see the light, a hit on one of the triangles around the vertex itself does not count
+    float calculateVertexVisibility(uint32_t vertexIndex, const glm::vec3 &position, const glm::vec3 &normal,
+                                    const std::vector<ModelTriangle> &triangles, const glm::vec3 &lightPosition) {
+        if (shadowMode == ShadowMode::CubeShadowMap && activeShadowMap != nullptr &&
+            activeShadowMap->lightPosition == lightPosition) {
+            return sampleCubeShadowMap(*activeShadowMap, position, normal, shadowMapSettings);
+        }
+        glm::vec3 shadowRay = glm::normalize(lightPosition - position);
+        glm::vec3 origin = position + shadowRay * 0.001f;
+        RayTriangleIntersection shadowIntersection = getClosestIntersection(origin, shadowRay, triangles);
+        if (shadowIntersection.distanceFromCamera >= glm::length(lightPosition - origin)) return 1.0f;
+        const std::array<uint32_t, 3> &corners = shadowIntersection.intersectedTriangle.vertexIndices;
+        bool touchesVertex = corners[0] == vertexIndex || corners[1] == vertexIndex || corners[2] == vertexIndex;
+        return touchesVertex ? 1.0f : 0.0f;
+    }
+
+    // FNV-1a over the raw bits, any change to a light changes the hash
+    uint64_t hashLights(const SceneLights &lights) {
+        uint64_t hash = 14695981039346656037ull;
+        for (const std::vector<float> *values : {&lights.positionX, &lights.positionY, &lights.positionZ, &lights.intensity}) {
+            for (float value : *values) {
+                uint32_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                hash = (hash ^ bits) * 1099511628211ull;
+            }
+        }
+        return hash;
+    }
+}
+
+void bakeVertexLighting(VertexLighting &lighting, const std::vector<ModelTriangle> &triangles,
+                        const SceneLights &lights, float ambientLight) {
+    size_t vertexCount = 0;
+    for (const ModelTriangle &triangle : triangles) {
+        for (uint32_t index : triangle.vertexIndices) vertexCount = std::max(vertexCount, size_t(index) + 1);
+    }
+
+    // gather the position and normal of every vertex first, the normal map must not be touched by the worker threads
+    std::vector<glm::vec3> positions(vertexCount), normals(vertexCount);
+    std::vector<bool> isUsed(vertexCount, false);
+    for (const ModelTriangle &triangle : triangles) {
+        for (int i = 0; i < 3; i++) {
+            uint32_t index = triangle.vertexIndices[i];
+            if (isUsed[index]) continue;
+            isUsed[index] = true;
+            positions[index] = triangle.vertices[i];
+            auto found = vertexNormals.find(triangle.vertices[i]);
+            normals[index] = found != vertexNormals.end() ? found->second : triangle.normal;
+        }
+    }
+
+    lighting.brightness.assign(vertexCount, ambientLight);
+    glm::vec3 eye = cameraPosition;
+    parallelFor(vertexCount, [&](size_t begin, size_t end) {
+        for (size_t vertex = begin; vertex < end; vertex++) {
+            if (!isUsed[vertex]) continue;
+            float brightness = ambientLight;
+            for (size_t light = 0; light < lights.size(); light++) {
+                glm::vec3 lightPosition = lights.position(light);
+                float diffuse = calculateLighting(positions[vertex], normals[vertex], lightPosition);
+                float specularIntensity = calculateSpecularLighting(positions[vertex], eye, lightPosition,
+                                                                    normals[vertex], shininess);
+                // the shadow only removes the diffuse light, so there is no need to test it when there is none
+                float visibility = diffuse > 0.0f ? calculateVertexVisibility(uint32_t(vertex), positions[vertex], normals[vertex],
+                                                                              triangles, lightPosition) : 0.0f;
+                brightness += lights.intensity[light] * visibility * diffuse;
+                brightness += lights.intensity[light] * specularIntensity;
+            }
+            lighting.brightness[vertex] = glm::clamp(brightness, 0.0f, 1.0f);
+        }
+    });
+}
+
+std::shared_ptr<const VertexLighting> getVertexLighting(const std::string &sceneName, const std::string &materialName,
+                                                        const std::vector<ModelTriangle> &triangles,
+                                                        const SceneLights &lights, float ambientLight) {
+    static std::mutex mutex;
+    static std::shared_ptr<VertexLighting> cache;
+    std::ostringstream key;
+    key << std::hexfloat << sceneName << "|" << materialName << "|" << cameraPosition.x << "," << cameraPosition.y
+        << "," << cameraPosition.z << "|" << shininess << "|" << ambientLight << "|" << hashLights(lights)
+        << "|" << int(shadowMode);
+    if (shadowMode == ShadowMode::CubeShadowMap) {
+        key << "|" << shadowMapSettings.resolution << "," << shadowMapSettings.bias << ","
+            << shadowMapSettings.normalBias << "," << shadowMapSettings.pcfRadius;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!cache || cache->key != key.str()) {
+        // only the cache can hand out copies, so when it holds the last one nobody else is shading with it and the
+        // bake can reuse its memory
+        if (cache.use_count() != 1) cache = std::make_shared<VertexLighting>();
+        bakeVertexLighting(*cache, triangles, lights, ambientLight);
+        cache->key = key.str();
+        LOG_DEBUG(LogCategory::RayTrace, "Baked gouraud lighting for " << cache->brightness.size() << " vertices of " << sceneName);
+    }
+    return cache;
+}
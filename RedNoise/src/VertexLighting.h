@@ -0,0 +1,32 @@
+#ifndef REDNOISE_VERTEXLIGHTING_H
+#define REDNOISE_VERTEXLIGHTING_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "ModelTriangle.h"
+#include "SceneLights.h"
+
+// gouraud brightness of every vertex, baked once and then only interpolated while shading
+struct VertexLighting {
+    std::string key;                 // the scene, materials, camera, lights and shadow settings it was baked for
+    std::vector<float> brightness;   // indexed by ModelTriangle::vertexIndices
+};
+
+// the lighting the current frame uses, set by the renderers before gouraud shading, one per thread like the camera,
+// whoever sets it keeps the bake alive until it is set again
+extern thread_local const VertexLighting *activeVertexLighting;
+
+// ambient, diffuse, specular and shadow of every light at every vertex, the vertices are split over the worker threads
+void bakeVertexLighting(VertexLighting &lighting, const std::vector<ModelTriangle> &triangles,
+                        const SceneLights &lights, float ambientLight);
+
+// the bake is reused until anything it depends on changes: the scene, its materials, the camera position, shininess,
+// the lights or the shadow settings, turning the camera alone does not change it
+// safe to call from several threads, a bake another thread still holds is never baked over, a changed key gets a new
+// one and the old one lives until its last holder lets go
+std::shared_ptr<const VertexLighting> getVertexLighting(const std::string &sceneName, const std::string &materialName,
+                                                        const std::vector<ModelTriangle> &triangles,
+                                                        const SceneLights &lights, float ambientLight);
+
+#endif //REDNOISE_VERTEXLIGHTING_H
@@ -0,0 +1,217 @@
+#include "Wireframe.h"
+#include "Globals.h"
+#include "Rasterising.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <map>
+
+// wireframe backend: every edge is projected and clipped once, then drawn with a fixed point DDA
+// straight into the frame buffer, so there are no per pixel bounds checks and no edge is drawn twice
+
+namespace {
+    const float nearPlane = 0.001f;
+
+    // Cohen-Sutherland region codes
+    const int insideRegion = 0;
+    const int leftRegion = 1;
+    const int rightRegion = 2;
+    const int belowRegion = 4;
+    const int aboveRegion = 8;
+
+    int regionCode(const glm::vec2 &point, const glm::vec2 &minCorner, const glm::vec2 &maxCorner) {
+        int code = insideRegion;
+        if (point.x < minCorner.x) code |= leftRegion;
+        else if (point.x > maxCorner.x) code |= rightRegion;
+        if (point.y < minCorner.y) code |= belowRegion;
+        else if (point.y > maxCorner.y) code |= aboveRegion;
+        return code;
+    }
+
+    // smallest step in [0, steps + 1] for which the (monotonic) predicate is true
+    template <typename Predicate>
+    int firstStepWhere(int steps, Predicate predicate) {
+        int low = 0, high = steps + 1;
+        while (low < high) {
+            int middle = (low + high) / 2;
+            if (predicate(middle)) high = middle;
+            else low = middle + 1;
+        }
+        return low;
+    }
+
+    // integer DDA in 16.16 fixed point, only the rows rowMin..rowMax are written
+    // the row changes monotonically along the line, so the band finds its first and last step by binary search
+    // instead of walking the parts of the line that belong to other bands
+    void drawLineInRows(uint32_t *pixels, int width, const std::array<int, 4> &line, uint32_t colour,
+                        int rowMin, int rowMax) {
+        int x0 = line[0], y0 = line[1], x1 = line[2], y1 = line[3];
+        if (std::max(y0, y1) < rowMin || std::min(y0, y1) > rowMax) return;
+
+        int steps = std::max(std::abs(x1 - x0), std::abs(y1 - y0));
+        const int64_t half = 1 << 15;
+        int64_t xStart = (int64_t(x0) << 16) + half;
+        int64_t yStart = (int64_t(y0) << 16) + half;
+        int64_t xStep = steps == 0 ? 0 : (int64_t(x1 - x0) << 16) / steps;
+        int64_t yStep = steps == 0 ? 0 : (int64_t(y1 - y0) << 16) / steps;
+
+        auto rowAt = [&](int step) { return int((yStart + step * yStep) >> 16); };
+        int firstStep, lastStep;
+        if (yStep >= 0) {
+            firstStep = firstStepWhere(steps, [&](int step) { return rowAt(step) >= rowMin; });
+            lastStep = firstStepWhere(steps, [&](int step) { return rowAt(step) > rowMax; }) - 1;
+        } else {
+            firstStep = firstStepWhere(steps, [&](int step) { return rowAt(step) <= rowMax; });
+            lastStep = firstStepWhere(steps, [&](int step) { return rowAt(step) < rowMin; }) - 1;
+        }
+
+        for (int step = firstStep; step <= lastStep; step++) {
+            int x = int((xStart + step * xStep) >> 16);
+            pixels[size_t(rowAt(step)) * width + x] = colour;
+        }
+    }
+}
+
+WireframeMesh buildWireframeMesh(const std::vector<ModelTriangle> &triangles, const std::vector<Material> &materials) {
+    WireframeMesh mesh;
+    // the loader gives every triangle its own copy of the vertices, weld them back together by position
+    std::map<glm::vec3, uint32_t, Vec3Comparator> vertexIds;
+
+    // an edge is the (smaller id, larger id) pair packed in 64 bits, order keeps the first triangle's colour
+    struct EdgeEntry {
+        uint64_t key;
+        uint32_t order;
+        uint32_t colour;
+    };
+    std::vector<EdgeEntry> entries;
+    entries.reserve(triangles.size() * 3);
+
+    for (const ModelTriangle &triangle : triangles) {
+        std::array<uint32_t, 3> ids;
+        for (int i = 0; i < 3; i++) {
+            auto inserted = vertexIds.emplace(triangle.vertices[i], uint32_t(mesh.vertices.size()));
+            if (inserted.second) mesh.vertices.push_back(triangle.vertices[i]);
+            ids[i] = inserted.first->second;
+        }
+        const Colour &edgeColour = materials[triangle.materialId].colour;
+        uint32_t colour = (255 << 24) | (edgeColour.red << 16) | (edgeColour.green << 8) | edgeColour.blue;
+        for (int i = 0; i < 3; i++) {
+            uint32_t a = ids[i], b = ids[(i + 1) % 3];
+            if (a == b) continue;
+            uint64_t key = (uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+            entries.push_back({key, uint32_t(entries.size()), colour});
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const EdgeEntry &a, const EdgeEntry &b) {
+        return a.key != b.key ? a.key < b.key : a.order < b.order;
+    });
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (i > 0 && entries[i].key == entries[i - 1].key) continue;
+        mesh.edges.push_back({{uint32_t(entries[i].key >> 32), uint32_t(entries[i].key & 0xFFFFFFFF)}});
+        mesh.edgeColours.push_back(entries[i].colour);
+    }
+
+    // middle of the bounding box, same as calculateModelCenter
+    glm::vec3 minCoords = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 maxCoords = glm::vec3(std::numeric_limits<float>::lowest());
+    for (const glm::vec3 &vertex : mesh.vertices) {
+        minCoords = glm::min(minCoords, vertex);
+        maxCoords = glm::max(maxCoords, vertex);
+    }
+    mesh.modelCenter = (minCoords + maxCoords) / 2.0f;
+    return mesh;
+}
+
+bool clipLineToRectangle(glm::vec2 &from, glm::vec2 &to, const glm::vec2 &minCorner, const glm::vec2 &maxCorner) {
+    int codeFrom = regionCode(from, minCorner, maxCorner);
+    int codeTo = regionCode(to, minCorner, maxCorner);
+    while (true) {
+        // both ends inside, nothing left to clip
+        if ((codeFrom | codeTo) == insideRegion) return true;
+        // both ends on the same outer side, the whole line is outside
+        if ((codeFrom & codeTo) != insideRegion) return false;
+
+        // move the end point that is outside onto the border it crosses
+        int code = codeFrom != insideRegion ? codeFrom : codeTo;
+        glm::vec2 point;
+        if (code & aboveRegion) {
+            point.x = from.x + (to.x - from.x) * (maxCorner.y - from.y) / (to.y - from.y);
+            point.y = maxCorner.y;
+        } else if (code & belowRegion) {
+            point.x = from.x + (to.x - from.x) * (minCorner.y - from.y) / (to.y - from.y);
+            point.y = minCorner.y;
+        } else if (code & rightRegion) {
+            point.y = from.y + (to.y - from.y) * (maxCorner.x - from.x) / (to.x - from.x);
+            point.x = maxCorner.x;
+        } else {
+            point.y = from.y + (to.y - from.y) * (minCorner.x - from.x) / (to.x - from.x);
+            point.x = minCorner.x;
+        }
+
+        if (code == codeFrom) {
+            from = point;
+            codeFrom = regionCode(from, minCorner, maxCorner);
+        } else {
+            to = point;
+            codeTo = regionCode(to, minCorner, maxCorner);
+        }
+    }
+}
+
+void drawWireframeMesh(DrawingWindow &window, const WireframeMesh &mesh, float focalLength) {
+    uint32_t *pixels = window.getPixelBuffer();
+    int width = int(window.width);
+    int height = int(window.height);
+
+    // camera space position of every unique vertex, shared by all the edges that use it
+    std::vector<glm::vec3> cameraSpaceVertices(mesh.vertices.size());
+    glm::vec3 eye = cameraPosition;
+    glm::mat3 orientation = cameraOrientation;
+    parallelFor(mesh.vertices.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            cameraSpaceVertices[i] = (mesh.vertices[i] - eye) * orientation;
+        }
+    });
+
+    // same projection as getCanvasIntersectionPoint
+    auto project = [&](const glm::vec3 &point) {
+        return glm::vec2(focalLength * (point.x / point.z) * imagePlaneScale(width) + width / 2.0f,
+                         focalLength * (point.y / point.z) * imagePlaneScale(width) + height / 2.0f);
+    };
+
+    // clip every edge once, what is left are integer end points that are guaranteed to be on screen
+    std::vector<std::array<int, 4>> lines(mesh.edges.size());
+    std::vector<char> isVisible(mesh.edges.size(), 0);
+    glm::vec2 minCorner(0.0f), maxCorner(width - 1, height - 1);
+    parallelFor(mesh.edges.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            glm::vec3 a = cameraSpaceVertices[mesh.edges[i][0]];
+            glm::vec3 b = cameraSpaceVertices[mesh.edges[i][1]];
+            // cut the edge where it passes behind the camera
+            if (a.z <= nearPlane && b.z <= nearPlane) continue;
+            if (a.z < nearPlane) a = glm::mix(a, b, (nearPlane - a.z) / (b.z - a.z));
+            else if (b.z < nearPlane) b = glm::mix(b, a, (nearPlane - b.z) / (a.z - b.z));
+
+            glm::vec2 from = project(a), to = project(b);
+            if (!clipLineToRectangle(from, to, minCorner, maxCorner)) continue;
+            lines[i] = {{glm::clamp(int(std::lround(from.x)), 0, width - 1),
+                         glm::clamp(int(std::lround(from.y)), 0, height - 1),
+                         glm::clamp(int(std::lround(to.x)), 0, width - 1),
+                         glm::clamp(int(std::lround(to.y)), 0, height - 1)}};
+            isVisible[i] = 1;
+        }
+    });
+
+    // one band of rows per thread, so no two threads ever write the same pixel
+    size_t bandCount = std::min<size_t>(workerThreadCount(), size_t(height));
+    int bandHeight = int((height + bandCount - 1) / bandCount);
+    parallelFor(bandCount, [&](size_t begin, size_t end) {
+        for (size_t band = begin; band < end; band++) {
+            int rowMin = int(band) * bandHeight;
+            int rowMax = std::min(height - 1, rowMin + bandHeight - 1);
+            for (size_t i = 0; i < lines.size(); i++) {
+                if (isVisible[i]) drawLineInRows(pixels, width, lines[i], mesh.edgeColours[i], rowMin, rowMax);
+            }
+        }
+    });
+}
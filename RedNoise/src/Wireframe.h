@@ -0,0 +1,28 @@
+#ifndef REDNOISE_WIREFRAME_H
+#define REDNOISE_WIREFRAME_H
+
+#include <array>
+#include <vector>
+#include <glm/glm.hpp>
+#include "DrawingWindow.h"
+#include "ModelTriangle.h"
+#include "LoadFile.h"
+
+// the edges of a model with every shared edge stored once
+struct WireframeMesh {
+    std::vector<glm::vec3> vertices;              // unique vertex positions
+    std::vector<std::array<uint32_t, 2>> edges;   // indices into vertices
+    std::vector<uint32_t> edgeColours;            // packed colour of the first triangle that uses the edge
+    glm::vec3 modelCenter{};
+};
+
+WireframeMesh buildWireframeMesh(const std::vector<ModelTriangle> &triangles, const std::vector<Material> &materials);
+
+// Cohen-Sutherland, shrinks the line to the part inside the rectangle, returns false if none of it is inside
+bool clipLineToRectangle(glm::vec2 &from, glm::vec2 &to, const glm::vec2 &minCorner, const glm::vec2 &maxCorner);
+
+// project, clip and draw every edge straight into the frame buffer
+// the screen is split into horizontal bands and each thread only writes the rows of its own band
+void drawWireframeMesh(DrawingWindow &window, const WireframeMesh &mesh, float focalLength);
+
+#endif //REDNOISE_WIREFRAME_H
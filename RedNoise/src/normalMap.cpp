@@ -1,4 +1,7 @@
 #include "normalMap.h"
+#include "Log.h"
+#include "CameraRays.h"
+#include "RenderJob.h"
 
 // There is a little bug in this class, cannot get the correct texture color from the texture map.
 
@@ -45,24 +48,26 @@ void renderRayTracedSceneNormal(DrawingWindow &window, const std::string& filena
     cameraPosition = orbitCameraAroundY(cameraPosition, orbitRotationSpeed, ModelCenter);
     // Rotate the camera to look at the model center
     cameraOrientation = lookAt(ModelCenter);
-    std::cout << "Loaded " << triangles.size() << " triangles for ray tracing" << std::endl;
+    LOG_INFO(LogCategory::RayTrace, "Loaded " << triangles.size() << " triangles for ray tracing");
 
     glm::vec3 sourceLight = glm::vec3(0.5, 0.5, 1);
     float ambientLight = 0.9f;  // ambient light intensity
     // Loop over each pixel on the image plane
+    const CameraRayTable &rays = getCameraRayTable(window.width, window.height, focalLength, cameraOrientation);
     for (int y = 0; y < int(window.height); y++) {
+        if (isRenderCancelled()) return;
+        showRenderProgress(window);
         for (int x = 0; x < int(window.width); x++) {
             // Compute the ray direction for this pixel
-            glm::vec3 rayDirection = computeRayDirection(window.width, window.height, x, y, focalLength,cameraOrientation);
+            glm::vec3 rayDirection = rays.direction(float(x), float(y));
 
             // Find the closest intersection of this ray with the scene
             RayTriangleIntersection intersection = getClosestIntersection(cameraPosition, rayDirection, triangles);
 
             // If an intersection was found, color the pixel accordingly
             if (intersection.distanceFromCamera != std::numeric_limits<float>::infinity()) {
-                // calculate the barycentric coordinates of the intersection point
-                glm::vec3 barycentricCoords = calculateBarycentricCoordinates(intersection.intersectionPoint,
-                                                                              intersection.intersectedTriangle.vertices);
+                // the barycentric coordinates of the intersection point come with the hit
+                glm::vec3 barycentricCoords = intersection.barycentricWeights();
                 // interpolate the texture point coordinate by using the barycentric coordinates
                 TexturePoint intersectTexturePoints ={barycentricCoords.x * intersection.intersectedTriangle.texturePoints[0].x +
                                                       barycentricCoords.y * intersection.intersectedTriangle.texturePoints[1].x +